@@ -100,6 +100,62 @@ namespace Application
                     ImGui::SliderFloat("Stiffness Global", &UI::stiffnessGlobal, 0, 1);
                     ImGui::SliderFloat("Range Global Constraint", &UI::effectiveRangeGlobal, 0, 1);
                     ImGui::SliderFloat("Capsule radius", &UI::capsuleRadius, 0, 0.2f);
+                    ImGui::Separator();
+
+                    ImGui::Text("Stats");
+                    ImGui::Text("Animation update %.3f ms/step", UI::animationUpdateMs);
+                    ImGui::Checkbox("Multithreaded animation", &UI::multithreadedAnimation);
+                    // loads the ellen_joe rig the first time, see the log for the palette math alone
+                    if (ImGui::Button("Benchmark ellen_joe animation"))
+                        UI::benchmarkAnimation = true;
+                    ImGui::Text("16 ellen_joe: %.3f ms on one thread, %.3f ms on the job threads", UI::ellenSingleThreadMs, UI::ellenJobThreadsMs);
+                    ImGui::Text("Queue submits per frame: graphics %u, compute %u", UI::graphicsSubmits, UI::computeSubmits);
+                    // compare binds with and without sorting
+                    ImGui::Checkbox("Sort draws", &UI::sortDraws);
+                    ImGui::Text("Binds per frame: %u for %u draws", UI::bindsPerFrame, UI::drawsPerFrame);
+                    ImGui::Checkbox("Parallel draw recording", &UI::parallelRecording);
+                    ImGui::Text("Queue recording %.3f ms on %u threads", UI::drawRecordingMs, UI::drawRecordingThreads);
+                    // culled meshes are not drawn, skinned or dispatched
+                    ImGui::Checkbox("Frustum culling", &UI::frustumCulling);
+                    ImGui::Text("Meshes culled: %u of %u", UI::culledMeshes, UI::cullableMeshes);
+                    ImGui::Text("Picked (right click): %s, %.2f m", UI::pickedMesh.c_str(), UI::pickedDistance);
+                    // random scenes of 10k to 100k boxes, see the log for each size
+                    if (ImGui::Button("Benchmark scene BVH"))
+                        UI::benchmarkSceneBVH = true;
+                    ImGui::Text("100k objects: refit %.3f ms, frustum %.3f ms (linear %.3f ms)", UI::bvhRefitMs, UI::bvhFrustumMs, UI::bvhLinearFrustumMs);
+                    ImGui::Checkbox("GPU culling", &UI::gpuCulling);
+                    ImGui::Text("Indirect objects: %u in %u draws", UI::indirectObjects, UI::indirectGroups);
+                    // reads back the commands of the last frame and compares with the cpu, see the log
+                    if (ImGui::Button("Validate GPU culling"))
+                        UI::validateGpuCulling = true;
+                    ImGui::Text("GPU culling mismatches: %u", UI::gpuCullingMismatches);
+                    ImGui::Checkbox("Depth pre-pass", &UI::depthPrepass);
+                    // needs the pre-pass, hidden objects are found with the previous frame's depth then this frame's
+                    ImGui::Checkbox("Occlusion culling", &UI::occlusionCulling);
+                    ImGui::Text("Culled per frame: %.1f%% frustum, %.1f%% occluded (%u drawn by the second phase)",
+                        UI::frustumCulledFraction * 100.f, UI::occludedFraction * 100.f, UI::occlusionRescued);
+                    ImGui::Checkbox("Batch vertex compute", &UI::batchVertexCompute);
+                    ImGui::Text("Skinning dispatches skipped per frame: %u", UI::skippedVertexDispatchesPerFrame);
+                    // compare ms/frame above between the two paths
+                    ImGui::Checkbox("Vertex shader skinning", &UI::vertexShaderSkinning);
+                    int cpuSkinningMaxVertices = UI::cpuSkinningMaxVertices;
+                    ImGui::SliderInt("CPU skinning max vertices", &cpuSkinningMaxVertices, 0, 4096);
+                    UI::cpuSkinningMaxVertices = cpuSkinningMaxVertices;
+                    ImGui::Text("CPU skinned meshes: %u, %.3f ms/frame", UI::cpuSkinnedMeshes, UI::cpuSkinningMs);
+                    // compares the compute output with the cpu kernel, see the log for each mesh
+                    if (ImGui::Button("Validate vertex compute"))
+                        UI::validateVertexCompute = true;
+                    ImGui::Text("Vertex compute max difference: %g", UI::vertexComputeMaxDifference);
+                    // baked vertex animation, one instanced draw per skinned mesh
+                    ImGui::Checkbox("Show crowd", &UI::showCrowd);
+                    int crowdInstances = UI::crowdInstances;
+                    ImGui::SliderInt("Crowd instances", &crowdInstances, 0, 4096);
+                    UI::crowdInstances = crowdInstances;
+                    // shares the first lain's vertex, index and texture memory, see the log for load and instantiate time
+                    ImGui::Checkbox("Show second lain", &UI::showSecondLain);
+                    // one vkAllocateMemory per block, resources are sub-allocated
+                    ImGui::Text("Device memory: %u blocks, %u resources", UI::memoryBlocks, UI::memoryAllocations);
+                    ImGui::Text("%.1f of %.1f MB used, fragmentation %.2f", UI::memoryUsedMB, UI::memoryReservedMB, UI::memoryFragmentation);
                 }
                 ImGui::End();
                 ImGui::Render();
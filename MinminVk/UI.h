@@ -20,4 +20,64 @@ namespace UI
 	vec3 lightDirection = vec3(0.f, 1.f, 1.f);
 	vec3 lightIntensity = vec3(1.f, 1.f, 1.f);
 	bool hideStaticHair = false;
+
+	// Stats
+	f32 animationUpdateMs = 0;
+	bool multithreadedAnimation = true;
+	bool benchmarkAnimation = false;
+	// 16 ellen_joe copies, per update
+	f32 ellenSingleThreadMs = 0;
+	f32 ellenJobThreadsMs = 0;
+	u32 graphicsSubmits = 0;
+	u32 computeSubmits = 0;
+	// meshes drawn in sort key order instead of load order
+	bool sortDraws = true;
+	u32 bindsPerFrame = 0;
+	u32 drawsPerFrame = 0;
+	// the opaque and transparent queues recorded in chunks on the job threads, into secondary command lists
+	bool parallelRecording = true;
+	f32 drawRecordingMs = 0;
+	u32 drawRecordingThreads = 1;
+	bool frustumCulling = true;
+	u32 culledMeshes = 0;
+	u32 cullableMeshes = 0;
+	// right click a mesh
+	String pickedMesh = "none";
+	f32 pickedDistance = 0;
+	bool benchmarkSceneBVH = false;
+	// 100k objects, a tenth of them moved
+	f32 bvhRefitMs = 0;
+	f32 bvhFrustumMs = 0;
+	f32 bvhLinearFrustumMs = 0;
+	// static opaque meshes culled by a compute pass and drawn with one indirect draw per group
+	bool gpuCulling = false;
+	u32 indirectObjects = 0;
+	u32 indirectGroups = 0;
+	bool validateGpuCulling = false;
+	u32 gpuCullingMismatches = 0;
+	// depth of the gpu culled meshes drawn before the forward pass, and the objects behind it culled through a depth pyramid
+	bool depthPrepass = false;
+	bool occlusionCulling = false;
+	// of the indirect objects in the last finished frame
+	f32 frustumCulledFraction = 0;
+	f32 occludedFraction = 0;
+	u32 occlusionRescued = 0;
+	bool batchVertexCompute = true;
+	u32 skippedVertexDispatches = 0;
+	u32 skippedVertexDispatchesPerFrame = 0;
+	bool vertexShaderSkinning = false;
+	// animated meshes with at most this many vertices are skinned on the cpu instead of a dispatch
+	u32 cpuSkinningMaxVertices = 512;
+	u32 cpuSkinnedMeshes = 0;
+	f32 cpuSkinningMs = 0;
+	bool validateVertexCompute = false;
+	f32 vertexComputeMaxDifference = 0;
+	bool showCrowd = false;
+	bool showSecondLain = false;
+	u32 crowdInstances = 1024;
+	u32 memoryBlocks = 0;
+	u32 memoryAllocations = 0;
+	f32 memoryUsedMB = 0;
+	f32 memoryReservedMB = 0;
+	f32 memoryFragmentation = 0;
 }
\ No newline at end of file
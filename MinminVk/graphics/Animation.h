@@ -64,6 +64,27 @@ namespace Graphics
 			return res;
 		}
 
+		// all morph target weights, out keeps its size
+		void SampleWeights(f32 timer, Vector<f32>& out)
+		{
+			assert(outputType == OutputType::SCALAR);
+			u32 numWeights = Min(static_cast<u32>(out.size()), numWeightsMorphTarget);
+			u32 i = 0;
+			while (i < input.size() && input[i] <= timer)
+				++i;
+			if (i == 0 || i == input.size())
+			{
+				// before the start or clamp to end
+				u32 key = i == 0 ? 0 : i - 1;
+				for (u32 morphI = 0; morphI < numWeights; ++morphI)
+					out[morphI] = scalarOutput[key * numWeightsMorphTarget + morphI];
+				return;
+			}
+			f32 a = (input[i] - timer) / (input[i] - input[i - 1]);
+			for (u32 morphI = 0; morphI < numWeights; ++morphI)
+				out[morphI] = glm::mix(scalarOutput[i * numWeightsMorphTarget + morphI], scalarOutput[(i - 1) * numWeightsMorphTarget + morphI], a);
+		}
+
 		vec4 Sample(f32 timer)
 		{
 			f32 samplingTime = timer;
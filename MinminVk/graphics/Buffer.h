@@ -3,6 +3,7 @@
 #include <util/Type.h>
 #include <graphics/Resource.h>
 #include <graphics/Material.h>
+#include <atomic>
 
 namespace Graphics
 {
@@ -19,7 +20,8 @@ namespace Graphics
             BUFFER_STORAGE = 4,
             BUFFER_TRANSFER_SRC = 8,
             BUFFER_INDEX = 16,
-            BUFFER_UNIFORM = 32
+            BUFFER_UNIFORM = 32,
+            BUFFER_INDIRECT = 64
         };
         enum class AccessType { READONLY, WRITE };
         // sometimes a buffer is needed for each frame in flight. don't want to declare multiple buffers for each, managed by backend
@@ -113,118 +115,233 @@ namespace Graphics
 
     };
 
-    struct SkeletonUniformBuffer : UniformBuffer
+    // palettes of every skin packed in one storage buffer per frame in flight.
+    // a joint is stored as the top three rows of its affine matrix
+    struct SkinPaletteBuffer : Buffer
     {
-        static const u32 jointMatricesSize = 512;
+        static const u32 rowsPerJoint = 3;
 
-        Vector<mat4> data;
+        u32 numJoints;
+        ResourceBinding binding;
+        // palette version each copy holds, by the skin's first joint
+        Vector<Vector<u32>> copyVersions;
 
-        void *GetData() override
+        const ResourceBinding GetBinding() const override
+        {
+            return binding;
+        }
+
+        const BufferType GetBufferType() const override { return Buffer::BufferType::STRUCTURED; }
+        const AccessType GetAccessType() const override 
         {
-            return (void*)data.data();
+            return AccessType::READONLY;
         }
+        const u32 GetBufferSize() const override { return numJoints * rowsPerJoint * sizeof(vec4); }
+        const BufferUsageType GetUsageType() const override {
+            return Buffer::BufferUsageType::BUFFER_STORAGE;
+        }
+
+        void Init();
+
+        // write palette to the joints starting at offset, in the copy of this frame.
+        // skipped when that copy already holds this version of the palette
+        void Write(int frameID, u32 offset, const Vector<mat4>& palette, u32 version);
+
+        SkinPaletteBuffer(u32 numJoints, ResourceBinding& binding) : numJoints{ Max(numJoints, 1u) }, binding{ binding } { Init(); }
+
+    };
+    
+    // morph target weights of one mesh, sized to its target count
+    struct BlendWeightsBuffer : Buffer
+    {
+        u32 numWeights;
 
         const ResourceBinding GetBinding() const override
         {
-            ResourceBinding uboBinding;
-            uboBinding.binding = 3;
-            uboBinding.shaderStageType = ResourceBinding::ShaderStageType::COMPUTE;
-            return uboBinding;
+            ResourceBinding ssboBinding;
+            ssboBinding.binding = 4;
+            ssboBinding.shaderStageType = ResourceBinding::ShaderStageType::COMPUTE;
+            return ssboBinding;
         }
 
-        const BufferType GetBufferType() const override { return Buffer::BufferType::UNIFORM; }
+        const BufferType GetBufferType() const override { return Buffer::BufferType::STRUCTURED; }
         const AccessType GetAccessType() const override 
         {
             return AccessType::READONLY;
         }
-        const u32 GetBufferSize() const override { return data.size() * sizeof(mat4); }
+        const u32 GetBufferSize() const override { return numWeights * sizeof(f32); }
         const BufferUsageType GetUsageType() const override {
-            return Buffer::BufferUsageType::BUFFER_UNIFORM;
+            return Buffer::BufferUsageType::BUFFER_STORAGE;
         }
 
-        SkeletonUniformBuffer() { data.resize(jointMatricesSize); Init(); }
+        void Init();
+
+        // write weights in the copy of this frame
+        void Write(int frameID, const Vector<f32>& weights);
+
+        BlendWeightsBuffer(u32 numWeights) : numWeights{ Max(numWeights, 1u) } { Init(); }
 
     };
-    
-    struct BlendWeightsUniformBuffer : UniformBuffer
+
+    // MaterialData of every material in one device local storage buffer shared by the frames in flight,
+    // indexed by PBRMaterial::materialIndex
+    struct MaterialTableBuffer : Buffer
     {
-        static const u32 blendWeightsSize = 8;
+        u32 numMaterials;
 
-        Vector<f32> data;
+        const ResourceBinding GetBinding() const override
+        {
+            ResourceBinding ssboBinding;
+            ssboBinding.binding = 1;
+            ssboBinding.shaderStageType = ResourceBinding::ShaderStageType::ALL_GRAPHICS;
+            return ssboBinding;
+        }
 
-        void *GetData() override
+        const BufferType GetBufferType() const override { return Buffer::BufferType::STRUCTURED; }
+        const AccessType GetAccessType() const override
         {
-            return (void*)data.data();
+            return AccessType::READONLY;
         }
+        const u32 GetBufferSize() const override { return numMaterials * sizeof(PBRMaterial::MaterialData); }
+        const BufferUsageType GetUsageType() const override {
+            return EnumBitwiseOr(Buffer::BufferUsageType::BUFFER_STORAGE, Buffer::BufferUsageType::BUFFER_TRANSFER_DST);
+        }
+
+        void Init();
+
+        // copy the material's row through the upload batch, seen by the next frame submitted
+        void Upload(const PBRMaterial& material);
+
+        MaterialTableBuffer(u32 numMaterials) : numMaterials{ Max(numMaterials, 1u) } { Init(); }
+
+    };
+
+    // world matrix of every draw recorded in a frame, one region per frame in flight in one mapped storage buffer.
+    // filled while recording, draws push the index of their matrix. slots are claimed atomically since secondary
+    // command lists are recorded on several threads
+    struct TransformBuffer : Buffer
+    {
+        u32 numTransformsPerFrame;
+        u32 numFrames;
+        u32 frameID = 0;
+        std::atomic<u32> count{ 0 };
 
         const ResourceBinding GetBinding() const override
         {
-            ResourceBinding uboBinding;
-            uboBinding.binding = 4;
-            uboBinding.shaderStageType = ResourceBinding::ShaderStageType::COMPUTE;
-            return uboBinding;
+            ResourceBinding ssboBinding;
+            ssboBinding.binding = 2;
+            ssboBinding.shaderStageType = ResourceBinding::ShaderStageType::VERTEX;
+            return ssboBinding;
         }
 
-        const BufferType GetBufferType() const override { return Buffer::BufferType::UNIFORM; }
-        const AccessType GetAccessType() const override 
+        const BufferType GetBufferType() const override { return Buffer::BufferType::STRUCTURED; }
+        const AccessType GetAccessType() const override
         {
             return AccessType::READONLY;
         }
-        const u32 GetBufferSize() const override { return data.size() * sizeof(f32); }
+        const u32 GetBufferSize() const override { return numTransformsPerFrame * numFrames * sizeof(mat4); }
         const BufferUsageType GetUsageType() const override {
-            return Buffer::BufferUsageType::BUFFER_UNIFORM;
+            return Buffer::BufferUsageType::BUFFER_STORAGE;
         }
 
-        BlendWeightsUniformBuffer() { data.resize(blendWeightsSize); Init(); }
+        void Init();
+
+        // start over in the region of this frame, its previous draws have completed
+        void Reset(int frameID);
+
+        // write the matrix to the next free slot of the frame, returns its index in the whole buffer. any thread
+        u32 Allocate(const mat4& model);
+
+        TransformBuffer(u32 numTransformsPerFrame, u32 numFrames) : numTransformsPerFrame{ Max(numTransformsPerFrame, 1u) }, numFrames{ numFrames } { Init(); }
 
     };
 
-    struct PBRUniformBuffer : UniformBuffer
+    // vertices written by the cpu every frame, one mapped copy per frame in flight
+    struct HostVertexBuffer : Buffer
     {
-      
-        PBRMaterial* pbrMaterial;
-        PBRMaterial defaultPBRMaterial;
+        u32 dataSize;
 
-        void* GetData() override
+        const ResourceBinding GetBinding() const override
         {
-            if (!pbrMaterial)
-                return (void*)defaultPBRMaterial.GetData();
-            return pbrMaterial->GetData();
+            return ResourceBinding{};
         }
 
-        const ResourceBinding GetBinding() const override
+        const BufferType GetBufferType() const override { return Buffer::BufferType::VERTEX; }
+        const AccessType GetAccessType() const override 
         {
-            ResourceBinding uboBinding;
-            uboBinding.binding = 5;
-            uboBinding.shaderStageType = ResourceBinding::ShaderStageType::ALL_GRAPHICS;
-            return uboBinding;
+            return AccessType::WRITE;
+        }
+        const u32 GetBufferSize() const override { return dataSize; }
+        const BufferUsageType GetUsageType() const override {
+            return Buffer::BufferUsageType::BUFFER_VERTEX;
         }
 
-        const BufferType GetBufferType() const override 
+        void Init();
+
+        // copy of this frame, free once its recording began
+        void* Map(int frameID);
+
+        HostVertexBuffer(u32 dataSize) : dataSize{ Max(dataSize, 1u) } { Init(); }
+
+    };
+
+    // small storage buffer the cpu fills and reads back every frame, one mapped copy per frame in flight
+    struct HostStorageBuffer : Buffer
+    {
+        u32 dataSize;
+        ResourceBinding binding;
+
+        const ResourceBinding GetBinding() const override
         {
-            return Buffer::BufferType::UNIFORM;
+            return binding;
         }
 
+        const BufferType GetBufferType() const override { return Buffer::BufferType::STRUCTURED; }
         const AccessType GetAccessType() const override
         {
-            return AccessType::READONLY;
+            return AccessType::WRITE;
         }
-
-        const u32 GetBufferSize() const override 
-        { 
-            return sizeof(PBRMaterial::MaterialData);
+        const u32 GetBufferSize() const override { return dataSize; }
+        const BufferUsageType GetUsageType() const override {
+            return Buffer::BufferUsageType::BUFFER_STORAGE;
         }
 
-        const BufferUsageType GetUsageType() const override 
+        void Init();
+
+        // copy of this frame, written by its last submit once its recording began
+        void* Map(int frameID);
+
+        HostStorageBuffer(u32 dataSize, ResourceBinding& binding) : dataSize{ Max(dataSize, 4u) }, binding{ binding } { Init(); }
+
+    };
+
+    // storage buffer only the gpu reads and writes, one device local copy shared by the frames in flight. contents start undefined
+    struct DeviceStorageBuffer : Buffer
+    {
+        u32 dataSize;
+        ResourceBinding binding;
+
+        const ResourceBinding GetBinding() const override
         {
-            return Buffer::BufferUsageType::BUFFER_UNIFORM;
+            return binding;
         }
 
-        PBRUniformBuffer() 
+        const BufferType GetBufferType() const override { return Buffer::BufferType::STRUCTURED; }
+        const AccessType GetAccessType() const override
         {
-            Init(); 
-            pbrMaterial = &defaultPBRMaterial;
+            return AccessType::WRITE;
         }
+        const u32 GetBufferSize() const override { return dataSize; }
+        const BufferUsageType GetUsageType() const override {
+            return EnumBitwiseOr(Buffer::BufferUsageType::BUFFER_STORAGE, Buffer::BufferUsageType::BUFFER_TRANSFER_DST);
+        }
+
+        void Init();
+
+        // new size, the contents are lost. waits for the device, descriptor sets holding the buffer must be written again
+        void Resize(u32 dataSize);
+
+        DeviceStorageBuffer(u32 dataSize, ResourceBinding& binding) : dataSize{ Max(dataSize, 4u) }, binding{ binding } { Init(); }
 
     };
 
@@ -236,14 +353,17 @@ namespace Graphics
 
         Vector<BufferUsageType> usageTypes;
 
+        // one gpu copy used by every frame in flight, for data the gpu only reads
+        bool sharedAcrossFrames = false;
+
         StructuredBuffer(Vector<f32> &data, ResourceBinding &binding, Vector<BufferUsageType> usageTypes)
             : bufferData{ data }, binding{ binding }, usageTypes{ usageTypes } 
         {
             Init();
         }
         
-        StructuredBuffer(u8 *data, u32 dataSize, ResourceBinding &binding, Vector<BufferUsageType> usageTypes)
-            :  binding{ binding }, usageTypes{ usageTypes } 
+        StructuredBuffer(u8 *data, u32 dataSize, ResourceBinding &binding, Vector<BufferUsageType> usageTypes, bool sharedAcrossFrames = false)
+            :  binding{ binding }, usageTypes{ usageTypes }, sharedAcrossFrames{ sharedAcrossFrames } 
         {
             bufferData.resize(dataSize * sizeof(u8) / sizeof(f32));
             u32 numf32 = dataSize * sizeof(u8) / sizeof(f32);
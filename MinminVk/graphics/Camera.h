@@ -77,6 +77,22 @@ namespace Graphics
 			return position;
 		}
 
+		// world space ray through a cursor position in window pixels, from the near plane
+		void GetRay(vec2 cursor, vec3& origin, vec3& rayDirection)
+		{
+			mat4 inverseViewProj = Math::Inverse(GetProjectionMatrix() * GetCameraMatrix());
+			vec2 ndc(cursor.x / width * 2.f - 1.f, 1.f - cursor.y / height * 2.f);
+			vec4 nearPoint = inverseViewProj * vec4(ndc, 0, 1);
+			vec4 farPoint = inverseViewProj * vec4(ndc, 1, 1);
+			origin = vec3(nearPoint) / nearPoint.w;
+			rayDirection = Math::Normalize(vec3(farPoint) / farPoint.w - origin);
+		}
+
+		float GetFarPlane()
+		{
+			return zfar;
+		}
+
 		void Update(float deltaTime)
 		{
 			vec3 keyboardMovement(0);
@@ -0,0 +1,228 @@
+#include "CpuSkinning.h"
+#include <util/Jobs.h>
+#include <cmath>
+
+#if defined(__AVX2__)
+#define CPU_SKINNING_AVX2
+#include <immintrin.h>
+#endif
+
+namespace Graphics
+{
+	namespace
+	{
+		using DynamicVertex = BasicVertex::DynamicVertex;
+		using JointWeightVertex = BasicVertex::JointWeightVertex;
+
+		// 3 rows of 4 floats per joint, same layout as SkinPaletteBuffer
+		const u32 floatsPerJoint = 12;
+
+		// glsl normalize written out, the avx2 path rounds the same way
+		inline vec3 Normalize(const vec3& v)
+		{
+			f32 invLength = 1.f / std::sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
+			return vec3(v.x * invLength, v.y * invLength, v.z * invLength);
+		}
+
+		// source attributes with the morph deltas added
+		void Morph(const BasicVertex& vertexData, const VertexDesc::ComputeVertexConstant& params, const Vector<f32>& weights,
+			u32 first, u32 last, DynamicVertex* out)
+		{
+			const u32* offsets = vertexData.blendData.data();
+			const BasicVertex::BlendVertexData* deltas = params.hasBlendShape ?
+				reinterpret_cast<const BasicVertex::BlendVertexData*>(offsets + params.vertexCount + 1) : nullptr;
+			for (u32 i = first; i < last; ++i)
+			{
+				const BasicVertex::Vertex& src = vertexData.vertices[i];
+				DynamicVertex& dst = out[i];
+				dst.pos = src.pos;
+				dst.normal = src.normal;
+				dst.tangent = src.tangent;
+				if (!params.hasBlendShape)
+					continue;
+
+				vec3 blendPosition(0);
+				vec3 blendNormal(0);
+				vec3 blendTangent(0);
+				for (u32 d = offsets[i]; d < offsets[i + 1]; ++d)
+				{
+					assert(deltas[d].target < weights.size());
+					f32 w = weights[deltas[d].target];
+					if (std::abs(w) > 0.00001f)
+					{
+						blendPosition += deltas[d].position * w;
+						if (params.hasNormal)
+							blendNormal += deltas[d].normal * w;
+						if (params.hasTangent)
+							blendTangent += deltas[d].tangent * w;
+					}
+				}
+				dst.pos += blendPosition;
+				dst.normal = Normalize(dst.normal + blendNormal);
+				dst.tangent = vec4(Normalize(vec3(dst.tangent) + blendTangent), dst.tangent.w);
+			}
+		}
+
+		void SkinVertex(const f32* rows, const JointWeightVertex& jointWeights, DynamicVertex& vertex)
+		{
+			// weighted sum of the palette rows in joint order, like the shader
+			f32 m[floatsPerJoint];
+			const f32* joint0 = rows + jointWeights.joints[0] * floatsPerJoint;
+			for (u32 k = 0; k < floatsPerJoint; ++k)
+				m[k] = jointWeights.weights[0] * joint0[k];
+			for (u32 j = 1; j < 4; ++j)
+			{
+				const f32* joint = rows + jointWeights.joints[j] * floatsPerJoint;
+				for (u32 k = 0; k < floatsPerJoint; ++k)
+					m[k] = m[k] + jointWeights.weights[j] * joint[k];
+			}
+
+			const vec3 p = vertex.pos;
+			const vec3 n = vertex.normal;
+			const vec3 t = vec3(vertex.tangent);
+			vec3 position, normal, tangent;
+			for (u32 r = 0; r < 3; ++r)
+			{
+				const f32* row = m + r * 4;
+				position[r] = row[0] * p.x + row[1] * p.y + row[2] * p.z + row[3];
+				normal[r] = row[0] * n.x + row[1] * n.y + row[2] * n.z;
+				tangent[r] = row[0] * t.x + row[1] * t.y + row[2] * t.z;
+			}
+			vertex.pos = position;
+			vertex.normal = Normalize(normal);
+			vertex.tangent = vec4(Normalize(tangent), vertex.tangent.w);
+		}
+
+#ifdef CPU_SKINNING_AVX2
+		// 8 vertices per iteration, count is a multiple of 8. the morphed attributes in vertices are skinned in place
+		void SkinVerticesAVX2(const f32* rows, const JointWeightVertex* jointWeights, DynamicVertex* vertices, u32 count)
+		{
+			static_assert(sizeof(DynamicVertex) == 10 * sizeof(f32));
+			static_assert(sizeof(JointWeightVertex) == 8 * sizeof(u32));
+			const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+			const __m256i vertexLanes = _mm256_mullo_epi32(lanes, _mm256_set1_epi32(10));
+			const __m256i jointLanes = _mm256_mullo_epi32(lanes, _mm256_set1_epi32(8));
+			const __m256i jointStride = _mm256_set1_epi32(floatsPerJoint);
+			const __m256 one = _mm256_set1_ps(1.f);
+
+			auto dot3 = [](__m256 ax, __m256 ay, __m256 az, __m256 bx, __m256 by, __m256 bz)
+			{
+				return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax, bx), _mm256_mul_ps(ay, by)), _mm256_mul_ps(az, bz));
+			};
+
+			for (u32 i = 0; i < count; i += 8)
+			{
+				const i32* joints = reinterpret_cast<const i32*>(jointWeights + i);
+				const f32* weights = reinterpret_cast<const f32*>(jointWeights + i) + 4;
+				__m256 m[floatsPerJoint];
+				for (u32 j = 0; j < 4; ++j)
+				{
+					__m256i rowIndex = _mm256_mullo_epi32(_mm256_i32gather_epi32(joints + j, jointLanes, 4), jointStride);
+					__m256 weight = _mm256_i32gather_ps(weights + j, jointLanes, 4);
+					for (u32 k = 0; k < floatsPerJoint; ++k)
+					{
+						__m256 term = _mm256_mul_ps(weight, _mm256_i32gather_ps(rows + k, rowIndex, 4));
+						m[k] = j == 0 ? term : _mm256_add_ps(m[k], term);
+					}
+				}
+
+				// pos, normal, tangent xyz. tangent w is left as is
+				const f32* src = reinterpret_cast<const f32*>(vertices + i);
+				__m256 in[9];
+				for (u32 c = 0; c < 9; ++c)
+					in[c] = _mm256_i32gather_ps(src + c, vertexLanes, 4);
+
+				__m256 res[9];
+				for (u32 r = 0; r < 3; ++r)
+				{
+					const __m256* row = m + r * 4;
+					res[r] = _mm256_add_ps(dot3(row[0], row[1], row[2], in[0], in[1], in[2]), row[3]);
+					res[3 + r] = dot3(row[0], row[1], row[2], in[3], in[4], in[5]);
+					res[6 + r] = dot3(row[0], row[1], row[2], in[6], in[7], in[8]);
+				}
+				for (u32 c = 3; c < 9; c += 3)
+				{
+					__m256 invLength = _mm256_div_ps(one, _mm256_sqrt_ps(dot3(res[c], res[c + 1], res[c + 2], res[c], res[c + 1], res[c + 2])));
+					for (u32 k = 0; k < 3; ++k)
+						res[c + k] = _mm256_mul_ps(res[c + k], invLength);
+				}
+
+				// no scatter in avx2
+				alignas(32) f32 out[9][8];
+				for (u32 c = 0; c < 9; ++c)
+					_mm256_store_ps(out[c], res[c]);
+				for (u32 lane = 0; lane < 8; ++lane)
+				{
+					DynamicVertex& vertex = vertices[i + lane];
+					vertex.pos = vec3(out[0][lane], out[1][lane], out[2][lane]);
+					vertex.normal = vec3(out[3][lane], out[4][lane], out[5][lane]);
+					vertex.tangent = vec4(out[6][lane], out[7][lane], out[8][lane], vertex.tangent.w);
+				}
+			}
+		}
+#endif
+	}
+
+	void CpuSkinning::Skin(const BasicVertex& vertexData, const VertexDesc::ComputeVertexConstant& params,
+		const Vector<mat4>& palette, const Vector<f32>& morphWeights, BasicVertex::DynamicVertex* out)
+	{
+		const u32 count = params.vertexCount;
+		assert(count == vertexData.vertices.size());
+
+		Vector<f32> rows;
+		if (params.hasSkeleton)
+		{
+			rows.resize(palette.size() * floatsPerJoint);
+			f32* row = rows.data();
+			for (const auto& m : palette)
+			{
+				for (u32 r = 0; r < 3; ++r, row += 4)
+				{
+					row[0] = m[0][r];
+					row[1] = m[1][r];
+					row[2] = m[2][r];
+					row[3] = m[3][r];
+				}
+			}
+		}
+
+		const u32 numJobs = (count + verticesPerJob - 1) / verticesPerJob;
+		Util::Jobs::ParallelFor(numJobs, [&](u32 job)
+		{
+			const u32 first = job * verticesPerJob;
+			const u32 last = Min(first + verticesPerJob, count);
+			Morph(vertexData, params, morphWeights, first, last, out);
+			if (!params.hasSkeleton)
+				return;
+
+			u32 i = first;
+#ifdef CPU_SKINNING_AVX2
+			const u32 simdCount = (last - first) & ~7u;
+			SkinVerticesAVX2(rows.data(), vertexData.jointVertices.data() + first, out + first, simdCount);
+			i += simdCount;
+#endif
+			for (; i < last; ++i)
+				SkinVertex(rows.data(), vertexData.jointVertices[i], out[i]);
+		});
+	}
+
+	f32 CpuSkinning::MaxDifference(const BasicVertex::DynamicVertex* a, const BasicVertex::DynamicVertex* b, u32 count)
+	{
+		const f32* fa = reinterpret_cast<const f32*>(a);
+		const f32* fb = reinterpret_cast<const f32*>(b);
+		const u32 numFloats = count * sizeof(BasicVertex::DynamicVertex) / sizeof(f32);
+		f32 maxDifference = 0.f;
+		for (u32 i = 0; i < numFloats; ++i)
+			maxDifference = Max(maxDifference, std::abs(fa[i] - fb[i]));
+		return maxDifference;
+	}
+
+	bool CpuSkinning::HasAVX2()
+	{
+#ifdef CPU_SKINNING_AVX2
+		return true;
+#else
+		return false;
+#endif
+	}
+}
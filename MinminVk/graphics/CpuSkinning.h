@@ -0,0 +1,26 @@
+#pragma once
+
+#include <util/Type.h>
+#include <graphics/Geometry.h>
+
+namespace Graphics
+{
+	// cpu version of computevertex.comp. same inputs as a dispatch and the same order of float operations
+	// per vertex, so the avx2 and scalar paths give identical bits and the compute output only differs by
+	// gpu rounding (fma, inversesqrt). used to check the compute pass and to skin meshes too small for a dispatch
+	struct CpuSkinning
+	{
+		// vertices handed to one job
+		static const u32 verticesPerJob = 1024;
+
+		// params is the push constant block of the dispatch, paletteOffset is ignored and palette is the mesh's own skin.
+		// out has one DynamicVertex per vertex
+		static void Skin(const BasicVertex& vertexData, const VertexDesc::ComputeVertexConstant& params,
+			const Vector<mat4>& palette, const Vector<f32>& morphWeights, BasicVertex::DynamicVertex* out);
+
+		// largest difference of any component, to compare against the compute output
+		static f32 MaxDifference(const BasicVertex::DynamicVertex* a, const BasicVertex::DynamicVertex* b, u32 count);
+
+		static bool HasAVX2();
+	};
+}
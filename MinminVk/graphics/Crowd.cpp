@@ -0,0 +1,92 @@
+#include "Crowd.h"
+#include <graphics/CpuSkinning.h>
+#include <graphics/Skeleton.h>
+#include <glm/packing.hpp>
+#include <glm/gtc/packing.hpp>
+#include <cstring>
+
+namespace Graphics
+{
+	namespace
+	{
+		vec2 EncodeOctahedral(vec3 n)
+		{
+			n /= std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+			if (n.z >= 0.f)
+				return vec2(n.x, n.y);
+			return vec2((1.f - std::abs(n.y)) * (n.x >= 0.f ? 1.f : -1.f), (1.f - std::abs(n.x)) * (n.y >= 0.f ? 1.f : -1.f));
+		}
+
+		VertexAnimation::Texel Pack(const BasicVertex::DynamicVertex& vertex)
+		{
+			VertexAnimation::Texel texel;
+			texel.positionXY = glm::packHalf2x16(vec2(vertex.pos.x, vertex.pos.y));
+			texel.positionZNormal = glm::packHalf1x16(vertex.pos.z) | (static_cast<u32>(glm::packSnorm2x8(EncodeOctahedral(vertex.normal))) << 16);
+			return texel;
+		}
+	}
+
+	SharedPtr<VertexAnimation> VertexAnimation::Bake(GLTFMesh& mesh, f32 frameRate)
+	{
+		auto skin = mesh.GetSkin();
+		assert(skin && skin->skeleton);
+		auto skeleton = skin->skeleton;
+
+		auto animation = MakeShared<VertexAnimation>();
+		animation->frameRate = frameRate;
+		animation->duration = Max(skeleton->maxAnimationTime - skeleton->minAnimationTime, 0.f);
+		animation->frameCount = static_cast<u32>(std::ceil(animation->duration * frameRate)) + 1;
+		animation->vertexCount = mesh.GetVertexData()->GetVerticesCount();
+		animation->texels.resize(animation->frameCount * animation->vertexCount);
+
+		// same kernel inputs as a dispatch
+		mesh.Update(0.f);
+		auto vertexData = std::static_pointer_cast<BasicVertex>(mesh.GetVertexData());
+		Vector<BasicVertex::DynamicVertex> vertices(animation->vertexCount);
+		const f32 timer = skeleton->timer;
+		for (u32 frame = 0; frame < animation->frameCount; ++frame)
+		{
+			skeleton->timer = Min(skeleton->minAnimationTime + frame / frameRate, skeleton->maxAnimationTime);
+			skeleton->Update(0.f);
+			skin->Update();
+			CpuSkinning::Skin(*vertexData, mesh.vertexConstant, skin->palette, mesh.node->morphWeights, vertices.data());
+
+			Texel* texels = animation->texels.data() + frame * animation->vertexCount;
+			for (u32 i = 0; i < animation->vertexCount; ++i)
+				texels[i] = Pack(vertices[i]);
+		}
+		skeleton->timer = timer;
+		skeleton->Update(0.f);
+		skin->Update();
+
+		DebugPrint("baked %s: %u frames, %u vertices, %zu KB\n", mesh.node->name.c_str(), animation->frameCount, animation->vertexCount,
+			animation->texels.size() * sizeof(Texel) / 1024);
+		return animation;
+	}
+
+	Crowd::Crowd(SharedPtr<GLTFMesh> mesh, SharedPtr<VertexAnimation> animation, SharedPtr<StructuredBuffer> instanceBuffer)
+		: mesh{ mesh }, animation{ animation }, instanceBuffer{ instanceBuffer }
+	{
+		Vector<u32> data(4 + animation->texels.size() * 2);
+		data[0] = animation->frameCount;
+		data[1] = animation->vertexCount;
+		memcpy(&data[2], &animation->frameRate, sizeof(f32));
+		memcpy(&data[3], &animation->duration, sizeof(f32));
+		memcpy(&data[4], animation->texels.data(), animation->texels.size() * sizeof(VertexAnimation::Texel));
+
+		ResourceBinding animationBinding;
+		animationBinding.binding = 1;
+		animationBinding.shaderStageType = ResourceBinding::ShaderStageType::VERTEX;
+		Vector<Buffer::BufferUsageType> usage{ Buffer::BufferUsageType::BUFFER_STORAGE, Buffer::BufferUsageType::BUFFER_TRANSFER_DST };
+		animationBuffer = MakeShared<StructuredBuffer>((u8*)data.data(), static_cast<u32>(data.size() * sizeof(u32)), animationBinding, usage, true);
+	}
+
+	SharedPtr<StructuredBuffer> Crowd::CreateInstanceBuffer(const Vector<Instance>& instances)
+	{
+		ResourceBinding instanceBinding;
+		instanceBinding.binding = 2;
+		instanceBinding.shaderStageType = ResourceBinding::ShaderStageType::VERTEX;
+		Vector<Buffer::BufferUsageType> usage{ Buffer::BufferUsageType::BUFFER_STORAGE, Buffer::BufferUsageType::BUFFER_TRANSFER_DST };
+		return MakeShared<StructuredBuffer>((u8*)instances.data(), static_cast<u32>(instances.size() * sizeof(Instance)), instanceBinding, usage, true);
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <util/Type.h>
+#include <graphics/Geometry.h>
+
+namespace Graphics
+{
+	// skinned clip of a mesh sampled at a fixed rate on the cpu. frame major, one texel per vertex:
+	// half float position xyz, octahedral normal as two snorm8 in the last half
+	struct VertexAnimation
+	{
+		struct Texel
+		{
+			u32 positionXY;
+			u32 positionZNormal;
+		};
+
+		u32 frameCount = 0;
+		u32 vertexCount = 0;
+		f32 frameRate = 0.f;
+		f32 duration = 0.f;
+		Vector<Texel> texels;
+
+		// plays the skeleton's clip through CpuSkinning, the pose is restored after
+		static SharedPtr<VertexAnimation> Bake(GLTFMesh& mesh, f32 frameRate);
+	};
+
+	// copies of one mesh playing its baked animation, drawn with one instanced call.
+	// no palette or dispatch per copy, the vertex shader reads positions and normals from the animation
+	struct Crowd
+	{
+		struct Instance
+		{
+			// world offset from the mesh, rotation around y
+			vec4 positionYaw;
+			// seconds added to the crowd time, playback rate
+			vec4 timeOffsetRate;
+		};
+
+		SharedPtr<GLTFMesh> mesh;
+		SharedPtr<VertexAnimation> animation;
+		// header (frame count, vertex count, frame rate, duration) then the texels
+		SharedPtr<StructuredBuffer> animationBuffer;
+		// shared by the crowds of every primitive of a character
+		SharedPtr<StructuredBuffer> instanceBuffer;
+		// variant of the pass pipeline with the animation at binding 1 and the instances at binding 2
+		SharedPtr<GraphicsPipeline> pipeline;
+
+		Crowd(SharedPtr<GLTFMesh> mesh, SharedPtr<VertexAnimation> animation, SharedPtr<StructuredBuffer> instanceBuffer);
+
+		static SharedPtr<StructuredBuffer> CreateInstanceBuffer(const Vector<Instance>& instances);
+
+		void Draw(RenderContext& context, u32 instanceCount, f32 time);
+	};
+}
@@ -0,0 +1,96 @@
+#include "Culling.h"
+#include <cmath>
+
+namespace Graphics
+{
+	void Culling::InitAnimatedBounds(GLTFMesh& mesh)
+	{
+		auto vertexData = std::static_pointer_cast<BasicVertex>(mesh.GetVertexData());
+		mesh.restBounds = mesh.bounds;
+		if (vertexData->hasSkeleton)
+		{
+			for (u32 i = 0; i < vertexData->jointVertices.size(); ++i)
+			{
+				const auto& jointWeights = vertexData->jointVertices[i];
+				for (u32 k = 0; k < 4; ++k)
+				{
+					if (jointWeights.weights[k] <= 0.f)
+						continue;
+					u32 joint = jointWeights.joints[k];
+					if (joint >= mesh.jointBounds.size())
+						mesh.jointBounds.resize(joint + 1);
+					mesh.jointBounds[joint].Extend(vertexData->vertices[i].pos);
+				}
+			}
+		}
+		if (vertexData->hasBlends)
+		{
+			mesh.morphDisplacements.assign(vertexData->blendTargetCount, 0.f);
+			const u32 vertexCount = static_cast<u32>(vertexData->vertices.size());
+			const u32* offsets = vertexData->blendData.data();
+			const BasicVertex::BlendVertexData* deltas = reinterpret_cast<const BasicVertex::BlendVertexData*>(offsets + vertexCount + 1);
+			for (u32 d = 0; d < offsets[vertexCount]; ++d)
+			{
+				assert(deltas[d].target < mesh.morphDisplacements.size());
+				f32& displacement = mesh.morphDisplacements[deltas[d].target];
+				displacement = Max(displacement, glm::length(deltas[d].position));
+			}
+		}
+	}
+
+	void Culling::UpdateAnimatedBounds(GLTFMesh& mesh)
+	{
+		auto vertexData = mesh.GetVertexData();
+		if (!vertexData->hasSkeleton && !vertexData->hasBlends)
+			return;
+
+		f32 displacement = 0.f;
+		const auto& weights = mesh.node->morphWeights;
+		for (u32 t = 0; t < Min(weights.size(), mesh.morphDisplacements.size()); ++t)
+			displacement += std::abs(weights[t]) * mesh.morphDisplacements[t];
+		const vec3 grow(displacement);
+
+		auto skin = mesh.GetSkin();
+		if (!vertexData->hasSkeleton || !skin)
+		{
+			mesh.bounds.min = mesh.restBounds.min - grow;
+			mesh.bounds.max = mesh.restBounds.max + grow;
+			return;
+		}
+		mesh.bounds = Math::AABB{};
+		const u32 jointCount = static_cast<u32>(Min(mesh.jointBounds.size(), skin->palette.size()));
+		for (u32 j = 0; j < jointCount; ++j)
+		{
+			Math::AABB box = mesh.jointBounds[j];
+			if (box.IsEmpty())
+				continue;
+			box.min -= grow;
+			box.max += grow;
+			mesh.bounds.Extend(Math::Transform(box, skin->palette[j]));
+		}
+	}
+
+	Math::AABB Culling::WorldBounds(Geometry& geometry)
+	{
+		return Math::Transform(geometry.bounds, geometry.node->worldMatrix);
+	}
+
+	Math::AABB Culling::WorldBounds(GLTFMesh& mesh)
+	{
+		const Math::AABB& bounds = mesh.instanceMatrices.empty() ? mesh.bounds : mesh.instanceBounds;
+		return Math::Transform(bounds, mesh.node->worldMatrix);
+	}
+
+	bool Culling::Cull(const Math::Frustum& frustum, Geometry& geometry)
+	{
+		geometry.isVisible = frustum.Intersects(WorldBounds(geometry));
+		return geometry.isVisible;
+	}
+
+	bool Culling::Cull(const Math::Frustum& frustum, GLTFMesh& mesh)
+	{
+		UpdateAnimatedBounds(mesh);
+		mesh.isVisible = frustum.Intersects(WorldBounds(mesh));
+		return mesh.isVisible;
+	}
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <util/Type.h>
+#include <util/Math.h>
+#include <graphics/Geometry.h>
+
+namespace Graphics
+{
+	// cpu frustum culling of node space bounds moved by the node's world matrix.
+	// a skinned vertex is a blend of its joints' transforms, so it stays inside the union of the boxes of
+	// each joint's vertices moved by that joint. morph targets grow the boxes by their longest delta times the weight
+	struct Culling
+	{
+		// joint boxes and morph target deltas from the rest pose, at load
+		static void InitAnimatedBounds(GLTFMesh& mesh);
+
+		// bounds of the current pose, after the skin palette and morph weights are updated
+		static void UpdateAnimatedBounds(GLTFMesh& mesh);
+
+		// world space box of the current bounds, instanced meshes use the bounds of all their instances
+		static Math::AABB WorldBounds(Geometry& geometry);
+		static Math::AABB WorldBounds(GLTFMesh& mesh);
+
+		// sets isVisible, instanced meshes are tested with the bounds of all their instances
+		static bool Cull(const Math::Frustum& frustum, Geometry& geometry);
+		static bool Cull(const Math::Frustum& frustum, GLTFMesh& mesh);
+	};
+}
@@ -0,0 +1,49 @@
+#include "DepthPyramid.h"
+
+namespace Graphics
+{
+	DepthPyramid::DepthPyramid(SharedPtr<Presentation> presentation, u32 sampleCount, SharedPtr<Shader> buildShader) : sampleCount{ sampleCount }
+	{
+		static_assert(sizeof(Header) == 16 + maxLevels * sizeof(Level), "header must match the std430 layout");
+		SetSize(presentation->swapChainDetails.width, presentation->swapChainDetails.height);
+
+		ResourceBinding pyramidBinding;
+		pyramidBinding.binding = 4;
+		pyramidBinding.shaderStageType = ResourceBinding::ShaderStageType::COMPUTE;
+		pyramidBuffer = MakeShared<DeviceStorageBuffer>(GetBufferSize(), pyramidBinding);
+
+		// texels are fetched, the sampler never filters
+		Sampler depthSampler(Sampler::FilterType::POINT, Sampler::FilterType::POINT, Sampler::AddressModeType::CLAMP_TO_EDGE, Sampler::AddressModeType::CLAMP_TO_EDGE);
+		Texture depthTexture;
+		depthTexture.textureID = presentation->depthTextureID;
+		depthTexture.textureID.samplerID = depthSampler.id;
+		depthTexture.binding.binding = 0;
+		depthTexture.binding.shaderStageType = ResourceBinding::ShaderStageType::COMPUTE;
+
+		Vector<SharedPtr<Buffer>> buildBuffers{ pyramidBuffer };
+		Vector<Texture> buildTextures{ depthTexture };
+		PushConstant buildConstant("BuildParams", PushConstant::Stage::COMPUTE, sizeof(BuildConstant));
+		buildPipeline = MakeShared<ComputePipeline>(buildShader, vec3(header.levels[0].width, header.levels[0].height, 1), vec3(groupSize, groupSize, 1),
+			buildBuffers, buildTextures, Vector<PushConstant>{ buildConstant });
+		UploadHeader();
+	}
+
+	void DepthPyramid::SetSize(u32 width, u32 height)
+	{
+		header = Header{};
+		header.width = Max(width, 1u);
+		header.height = Max(height, 1u);
+		u32 levelWidth = header.width;
+		u32 levelHeight = header.height;
+		texelCount = 0;
+		// down to a single texel, rounding up so the odd row or column of a level is not dropped
+		do
+		{
+			levelWidth = (levelWidth + 1) / 2;
+			levelHeight = (levelHeight + 1) / 2;
+			header.levels[header.levelCount] = Level{ levelWidth, levelHeight, texelCount, 0 };
+			texelCount += levelWidth * levelHeight;
+			header.levelCount++;
+		} while ((levelWidth > 1 || levelHeight > 1) && header.levelCount < maxLevels);
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <util/Type.h>
+#include <graphics/Geometry.h>
+#include <graphics/Pipeline.h>
+
+namespace Graphics
+{
+	struct RenderContext;
+
+	// farthest depth pyramid of the depth attachment for occlusion culling, every level in one storage buffer since the
+	// backend has no storage images. level 0 is half the attachment rounded up, each of its texels the farthest depth of the
+	// 2x2 attachment texels and their samples under it, and every next level halves again the same way. so attachment
+	// texel p is under texel p >> (level + 1) of every level, and nothing drawn there is farther than that texel.
+	// built by one compute dispatch per level after the depth pre-pass
+	struct DepthPyramid
+	{
+		static const u32 maxLevels = 16;
+		static const u32 groupSize = 8;
+
+		// std430 layout of depthpyramidcommon.glsl
+		struct Level
+		{
+			u32 width;
+			u32 height;
+			// first texel in the buffer
+			u32 offset;
+			u32 padding;
+		};
+
+		struct Header
+		{
+			u32 levelCount;
+			// of the depth attachment
+			u32 width;
+			u32 height;
+			u32 padding;
+			Level levels[maxLevels];
+		};
+
+		struct BuildConstant
+		{
+			u32 level;
+			u32 sampleCount;
+			u32 padding[2];
+		};
+
+		Header header{};
+		u32 texelCount = 0;
+		// the header then the texels of every level, binding 4 of the build and the passes that test against it
+		SharedPtr<DeviceStorageBuffer> pyramidBuffer;
+		SharedPtr<ComputePipeline> buildPipeline;
+		// built at the current size. false after a resize until the next Build
+		bool isValid = false;
+
+		// sized to the presentation's swapchain. the multisampled shader reads every sample when the attachment has several
+		DepthPyramid(SharedPtr<Presentation> presentation, u32 sampleCount, SharedPtr<Shader> buildShader);
+
+		// levels for an attachment of this size
+		void SetSize(u32 width, u32 height);
+
+		// sizes the pyramid to the depth attachment after the swapchain changed. call before the frame records anything
+		// that binds the buffer, true when the buffer was replaced and other sets holding it must be written again
+		bool Resize(RenderContext& context);
+
+		// outside a render pass, after the depth of the frame is drawn. leaves the attachment ready for the next pass
+		void Build(RenderContext& context);
+
+		u32 GetBufferSize() const { return static_cast<u32>(sizeof(Header) + texelCount * sizeof(f32)); }
+
+	private:
+		u32 sampleCount;
+		// the view written in the build sets, replaced when the swapchain is recreated
+		u64 depthView = 0;
+
+		void UploadHeader();
+	};
+}
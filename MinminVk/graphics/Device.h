@@ -17,6 +17,9 @@ namespace Graphics
 		SharedPtr<Presentation> presentation;
 		SharedPtr<Device> device;
 		bool shouldRenderUI = false;
+		// secondary command list of the frame the draws are recorded into, PRIMARY for the frame's primary one
+		static const u32 PRIMARY = ~0u;
+		u32 secondaryList = PRIMARY;
 	};
 
 	struct ComputeContext
@@ -37,9 +40,39 @@ namespace Graphics
 	{
 		Vector<CommandList> commandLists;
 		Vector<CommandList> computeCommandLists;
+		// per frame in flight, more are created when a frame reserves more than it had
+		Vector<Vector<CommandList>> secondaryCommandLists;
+		// of the frame being recorded. the ones of the pass begun for secondary lists are executed when it ends
+		u32 reservedSecondaryLists = 0;
+		u32 passFirstSecondaryList = 0;
+		bool passInSecondaryLists = false;
+
+		// queue submissions, reset by the caller
+		u32 graphicsSubmitCount = 0;
+		u32 computeSubmitCount = 0;
+		// pipeline, buffer, descriptor set and cull mode changes and draws recorded in graphics submits, reset by the caller
+		u32 bindCount = 0;
+		u32 drawCount = 0;
+		// gpu culling can draw with vkCmdDrawIndexedIndirectCount
+		bool supportsIndirectDraw = false;
+		// samples per pixel of the depth attachment
+		u32 depthSamples = 1;
+
+		// device memory blocks and the resources placed in them
+		struct MemoryStats
+		{
+			u32 blockCount = 0;
+			u32 allocationCount = 0;
+			u64 reservedBytes = 0;
+			u64 usedBytes = 0;
+			// free bytes outside the largest free range of their block, over all free bytes
+			f32 fragmentation = 0.f;
+		};
 
 		CommandList& GetCommandList(u32 index) { return commandLists[index]; }
 		CommandList& GetComputeCommandList(u32 index) { return computeCommandLists[index]; }
+		// the frame's primary list or the secondary the context records into
+		CommandList& GetCommandList(const RenderContext& context);
 		
 		void Init();
 		bool BeginRecording(RenderContext&);
@@ -48,10 +81,22 @@ namespace Graphics
 		bool BeginRecording(ComputeContext&);
 		void EndRecording(ComputeContext&);
 
-		void BeginRenderPass(Graphics::RenderContext& context);
+		// with secondaryContents the pass is drawn from secondary lists, possibly recorded on several threads. the primary
+		// can only execute them, so the calling thread's draws go to one too. all are executed in reservation order when
+		// the pass ends. no subpasses then
+		void BeginRenderPass(Graphics::RenderContext& context, bool secondaryContents = false);
 		void EndRenderPass(Graphics::RenderContext& context);
 		void BeginSubPass(Graphics::RenderContext& context);
 
+		// count consecutive secondary lists for the pass begun for them, returns the first. reserve on the thread
+		// recording the primary before handing the lists out
+		u32 ReserveSecondaryLists(Graphics::RenderContext& context, u32 count);
+		// the context's draws go to the reserved list until EndSecondaryRecording. any thread, one thread per list
+		void BeginSecondaryRecording(Graphics::RenderContext& context, u32 list);
+		void EndSecondaryRecording(Graphics::RenderContext& context);
+
+		MemoryStats GetMemoryStats();
+
 		void CleanUp();
 	};
 
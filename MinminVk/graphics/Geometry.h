@@ -37,6 +37,8 @@ namespace Graphics
 	struct VertexDesc
 	{
 		virtual VertexBinding GetVertexBinding() = 0;
+		// all vertex streams, override for more than one
+		virtual Vector<VertexBinding> GetVertexBindings() { return Vector<VertexBinding>{ GetVertexBinding() }; }
 		virtual Vector<VertexAttribute> GetVertexAttributes() = 0;
 		virtual u8* GetVertices() = 0;
 		virtual u32 GetVerticesCount() = 0;
@@ -61,9 +63,8 @@ namespace Graphics
 			u32 blendShapeCount;
 			u32 normalizedBlendShapes;
 			u32 blend_weight_stride;
-			u32 padding;
+			u32 paletteOffset;
 		};
-		ComputeVertexConstant vertexConstant;
 
 		// if have skeleton
 		virtual u8* GetSkeletonVertices() = 0;
@@ -157,6 +158,14 @@ namespace Graphics
 
 		Vector<Vertex> vertices;
 
+		// attributes rewritten by skinning and blend shapes, the rest is read from the source vertices
+		struct DynamicVertex
+		{
+			vec3 pos;
+			vec3 normal;
+			vec4 tangent;
+		};
+
 		struct JointWeightVertex
 		{
 			vec4u joints;
@@ -165,18 +174,31 @@ namespace Graphics
 
 		Vector<JointWeightVertex> jointVertices;
 
+		// morph target delta of one vertex
 		struct BlendVertexData
 		{
-			vec4 position = vec4(0);
-			vec4 normal = vec4(0);
-			vec4 tangent = vec4(0);
+			u32 target;
+			vec3 position;
+			vec3 normal;
+			vec3 tangent;
 		};
-		Vector<BlendVertexData> blendVertices;
+		// sparse morph targets grouped by vertex. the first vertex count + 1 entries are offsets,
+		// the deltas of vertex i are BlendVertexData [offset[i], offset[i + 1]) after them. zero deltas are not stored
+		Vector<u32> blendData;
+		u32 blendTargetCount = 0;
 
 		BasicVertex() {};
 
 		BasicVertex(Vector<Vertex> &&vertices) : vertices{ vertices } {}
 
+		Math::AABB GetBounds() const
+		{
+			Math::AABB bounds;
+			for (const auto& vertex : vertices)
+				bounds.Extend(vertex.pos);
+			return bounds;
+		}
+
 		VertexBinding GetVertexBinding() override
 		{
 			VertexBinding binding;
@@ -245,12 +267,109 @@ namespace Graphics
 
 		u8* GetMorphVertices() override
 		{
-			return ((u8*)blendVertices.data());
+			return ((u8*)blendData.data());
 		}
 
 		u32 GetMorphVerticesCount() override
 		{
-			return blendVertices.size() * sizeof(BlendVertexData) / sizeof(u8);
+			return blendData.size() * sizeof(u32) / sizeof(u8);
+		}
+	};
+
+	// basic vertex plus a second stream of joints and weights, for skinning in the vertex shader
+	struct SkinnedVertex : public BasicVertex
+	{
+		Vector<VertexBinding> GetVertexBindings() override
+		{
+			VertexBinding skinBinding;
+			skinBinding.stride = sizeof(JointWeightVertex);
+			skinBinding.binding = 1;
+			return Vector<VertexBinding>{ GetVertexBinding(), skinBinding };
+		}
+
+		Vector<VertexAttribute> GetVertexAttributes() override
+		{
+			auto attributes = BasicVertex::GetVertexAttributes();
+
+			VertexAttribute jointsAttribute;
+			jointsAttribute.binding = 1;
+			jointsAttribute.location = 5;
+			jointsAttribute.offset = offsetof(JointWeightVertex, joints);
+			jointsAttribute.vertexFormatType = VertexAttribute::VertexFormatType::UVEC4;
+			attributes.push_back(jointsAttribute);
+
+			VertexAttribute weightsAttribute;
+			weightsAttribute.binding = 1;
+			weightsAttribute.location = 6;
+			weightsAttribute.offset = offsetof(JointWeightVertex, weights);
+			weightsAttribute.vertexFormatType = VertexAttribute::VertexFormatType::VEC4;
+			attributes.push_back(weightsAttribute);
+
+			return attributes;
+		}
+	};
+
+	// basic vertex plus a per instance model matrix relative to the node, locations 5 to 8
+	struct InstancedVertex : public BasicVertex
+	{
+		Vector<VertexBinding> GetVertexBindings() override
+		{
+			VertexBinding instanceBinding;
+			instanceBinding.stride = sizeof(mat4);
+			instanceBinding.binding = 1;
+			instanceBinding.inputRateType = VertexBinding::InputRateType::INSTANCE;
+			return Vector<VertexBinding>{ GetVertexBinding(), instanceBinding };
+		}
+
+		Vector<VertexAttribute> GetVertexAttributes() override
+		{
+			auto attributes = BasicVertex::GetVertexAttributes();
+			for (u32 column = 0; column < 4; ++column)
+			{
+				VertexAttribute columnAttribute;
+				columnAttribute.binding = 1;
+				columnAttribute.location = 5 + column;
+				columnAttribute.offset = column * sizeof(vec4);
+				columnAttribute.vertexFormatType = VertexAttribute::VertexFormatType::VEC4;
+				attributes.push_back(columnAttribute);
+			}
+			return attributes;
+		}
+	};
+
+	// color and uv from the source vertices, position normal and tangent from the transformed stream
+	struct SplitStreamVertex : public BasicVertex
+	{
+		Vector<VertexBinding> GetVertexBindings() override
+		{
+			VertexBinding dynamicBinding;
+			dynamicBinding.stride = sizeof(DynamicVertex);
+			dynamicBinding.binding = 1;
+			return Vector<VertexBinding>{ GetVertexBinding(), dynamicBinding };
+		}
+
+		Vector<VertexAttribute> GetVertexAttributes() override
+		{
+			auto attributes = BasicVertex::GetVertexAttributes();
+			for (auto& attribute : attributes)
+			{
+				if (attribute.location == 0)
+				{
+					attribute.binding = 1;
+					attribute.offset = offsetof(DynamicVertex, pos);
+				}
+				else if (attribute.location == 3)
+				{
+					attribute.binding = 1;
+					attribute.offset = offsetof(DynamicVertex, normal);
+				}
+				else if (attribute.location == 4)
+				{
+					attribute.binding = 1;
+					attribute.offset = offsetof(DynamicVertex, tangent);
+				}
+			}
+			return attributes;
 		}
 	};
 
@@ -326,7 +445,9 @@ namespace Graphics
 	};
 
 	struct GeometryID { 
-		u32 vertexBufferID = 0; u32 indexBufferID = 0; u32 setID; 
+		u32 vertexBufferID = 0; u32 indexBufferID = 0;
+		// start of the mesh in its buffers, in vertices and indices. non zero in the shared arenas
+		u32 vertexOffset = 0; u32 firstIndex = 0;
 		// compute skinning buffers 
 		u32 transformedVertexBufferID = 0;
 	};
@@ -338,9 +459,12 @@ namespace Graphics
 		SharedPtr<PBRMaterial> material;
 		GeometryID geometryID;
 		Texture mainTexture;
-		PBRUniformBuffer materialUniformBuffer;
 		SharedPtr<VertexBuffer> vertexBuffer;
 		SharedPtr<VertexBuffer> transformedVertexBuffer;
+		// in node space, empty for geometry that is never culled
+		Math::AABB bounds;
+		// from the last culling, draws and per draw uploads are skipped when false
+		bool isVisible = true;
 
 	protected:
 		SharedPtr<VertexDesc> vertexDesc;
@@ -413,33 +537,75 @@ namespace Graphics
 	struct GLTFMesh : public Geometry
 	{
 	protected:
-		Vector<SharedPtr<Node>> joints;
-		Vector<mat4> inverseBindMatrices;
+		SharedPtr<Skin> skin;
 
 	public:
 		SharedPtr<StructuredBuffer> jointWeightData;
-		SharedPtr<SkeletonUniformBuffer> skeletonMatrixData;
-		SharedPtr<BlendWeightsUniformBuffer> morphWeightData;
+		SharedPtr<BlendWeightsBuffer> morphWeightData;
 		SharedPtr<StructuredBuffer> morphTargetsData;
+		// persistent resource sets in the vertex compute pipeline, -1 if not animated
+		i32 computeSetID = -1;
+		// push constants of the mesh's dispatch. per mesh, instances of an asset share the vertex data
+		VertexDesc::ComputeVertexConstant vertexConstant;
+		// transformedVertexBuffer is out of date with the skin palette or morph weights
+		bool poseDirty = true;
+		// skin palette version the pose was last checked against
+		u32 lastPaletteVersion = ~0u;
+		Vector<f32> lastMorphWeights;
+
+		// compute writes transformedVertexBuffer, vertex shader skins every draw from the joint weight stream,
+		// cpu writes hostVertices before recording the frame
+		enum class SkinningMode { COMPUTE, VERTEX_SHADER, CPU };
+		SkinningMode skinningMode = SkinningMode::COMPUTE;
+		// only for meshes small enough for the cpu path
+		SharedPtr<HostVertexBuffer> hostVertices;
+
+		// EXT_mesh_gpu_instancing transforms relative to the node, empty if not instanced.
+		// instanceData holds the same matrices as a vertex stream, shared by the primitives of the node
+		Vector<mat4> instanceMatrices;
+		SharedPtr<StructuredBuffer> instanceData;
+		// bounds of every instance, in node space
+		Math::AABB instanceBounds;
+		// row in the IndirectDraw object table, ~0u if drawn one by one
+		u32 indirectObject = ~0u;
 
-		GLTFMesh(SharedPtr<GraphicsPipeline>, String filename, tinygltf::Primitive& mesh, tinygltf::Model& model, SharedPtr<PBRMaterial>, Vector<mat4> inverseBindMatrices = Vector<mat4>{});
+		// bounds of animated meshes follow the pose, see Culling::UpdateAnimatedBounds.
+		// rest pose bounds, bind space box of the vertices each joint moves and longest delta of each morph target
+		Math::AABB restBounds;
+		Vector<Math::AABB> jointBounds;
+		Vector<f32> morphDisplacements;
 
-		void SetInverseBindMatrices(Vector<mat4>& inverseBindMatrices)
+		GLTFMesh(SharedPtr<GraphicsPipeline>, String filename, tinygltf::Primitive& mesh, tinygltf::Model& model, SharedPtr<PBRMaterial>);
+
+		// another instance of prototype's primitive. vertex, index, joint weight and morph target buffers,
+		// material and its resource set are shared, the pose buffers are its own
+		GLTFMesh(const GLTFMesh& prototype, SharedPtr<Node> node);
+
+		// new vertex and index data drawn with materialSource's material and its resource set
+		GLTFMesh(const GLTFMesh& materialSource, SharedPtr<BasicVertex> vertexData, Vector<u16>&& indices, SharedPtr<Node> node);
+
+		void SetSkin(SharedPtr<Skin> skin)
 		{
-			this->inverseBindMatrices = inverseBindMatrices;
+			this->skin = skin;
 		}
 
-		void SetJoints(Vector<SharedPtr<Node>> joints)
+		SharedPtr<Skin> GetSkin()
 		{
-			this->joints = joints;
+			return skin;
 		}
 
-		Vector<SharedPtr<Node>>& GetJoints()
+		// vertex shader path does not do blend shapes
+		bool SupportsVertexSkinning()
 		{
-			return joints;
+			return vertexDesc->hasSkeleton && !vertexDesc->hasBlends;
 		}
 
 		void Update(f32 deltaTime) override;
+
+		void Draw(RenderContext& context) override;
+
+		// copy transformedVertexBuffer back, waits for the device to be idle. for debugging only
+		void ReadTransformedVertices(Vector<BasicVertex::DynamicVertex>& out);
 	};
 
 	// deprecated
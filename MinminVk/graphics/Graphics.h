@@ -5,8 +5,18 @@
 #include <graphics/Import.h>
 #include <graphics/UIRender.h>
 #include <graphics/Camera.h>
+#include <graphics/CpuSkinning.h>
+#include <graphics/Crowd.h>
+#include <graphics/MeshMerge.h>
+#include <graphics/RenderQueue.h>
+#include <graphics/Culling.h>
+#include <graphics/SceneBVH.h>
+#include <graphics/IndirectDraw.h>
 #include <Input.h>
 #include <UI.h>
+#include <util/Jobs.h>
+#include <chrono>
+#include <random>
 
 #define TRIANGLE_VERTEX_SHADER "trianglevert.spv"
 #define TRIANGLE_FRAG_SHADER "trianglefrag.spv"
@@ -20,6 +30,16 @@
 #define PARTICLE_VERT_SHADER "particlesvert.spv"
 #define PARTICLE_FRAG_SHADER "particlesfrag.spv"
 #define VERTEX_COMP_SHADER "computevertex.spv"
+#define SKINNED_VERTEX_SHADER "skinnedmeshvert.spv"
+#define CROWD_VERTEX_SHADER "crowdvert.spv"
+#define INSTANCED_VERTEX_SHADER "instancedvert.spv"
+#define INDIRECT_VERTEX_SHADER "indirectvert.spv"
+#define TRIANGLE_INDIRECT_FRAG_SHADER "triangleindirectfrag.spv"
+#define CULL_INDIRECT_COMP_SHADER "cullindirect.spv"
+#define DEPTH_PREPASS_VERTEX_SHADER "depthprepassvert.spv"
+#define DEPTH_PREPASS_FRAG_SHADER "depthprepassfrag.spv"
+#define DEPTH_PYRAMID_COMP_SHADER "depthpyramid.spv"
+#define DEPTH_PYRAMID_MS_COMP_SHADER "depthpyramidms.spv"
 #define STATUE_IMAGE "statue.jpg"
 #define WALL_IMAGE "blue_floor_tiles_01_diff_1k.jpg"
 #define BLUE_IMAGE "blue.jpeg"
@@ -56,6 +76,8 @@
 #define GLTF_FILE "lain2/lain_anim.gltf"
 #define GLTF_FILE3 "testBlend/testBlend.gltf"
 #define GLTF_ELLEN_JOE "ellen_joe_by_ghost73/scene.gltf"
+// EXT_mesh_gpu_instancing scenery, drawn with one instanced draw per primitive
+//#define GLTF_INSTANCED_FILE "../../../../glTF-Sample-Models/2.0/SimpleInstancing/glTF/SimpleInstancing.gltf"
 
 namespace Graphics
 {
@@ -63,6 +85,9 @@ namespace Graphics
 
 	SharedPtr<Device> device;
 	SharedPtr<NodeManager> nodeManager;
+	// copies of the 435 joint ellen_joe rig, loaded by the first animation benchmark. never drawn, its own nodes keep it out of the scene
+	SharedPtr<NodeManager> ellenNodeManager;
+	Vector<SharedPtr<GLTFMesh>> ellenMeshes;
 	RenderContext renderContext;
 	ComputeContext computeContext;
 	SharedPtr<Presentation> presentation;
@@ -75,6 +100,8 @@ namespace Graphics
 	SharedPtr<RenderPass> forwardTransparentPass;
 	SharedPtr<GraphicsPipeline> skyboxPipeline;
 	SharedPtr<RenderPass> skyboxPass;
+	// depth only, the indirect draws that are not alpha masked
+	SharedPtr<RenderPass> depthPrepass;
 	SharedPtr<RenderPass> forwardParticlePass;
 	SharedPtr<UIRender> uiRender;
 	SharedPtr<Quad> quad;
@@ -82,6 +109,26 @@ namespace Graphics
 	SharedPtr<OBJMesh> vikingRoom;
 	SharedPtr<OBJMesh> headMesh;
 	Vector<SharedPtr<GLTFMesh>> gltfMeshes;
+	// instance of the first asset sharing its GPU resources, hidden unless UI::showSecondLain
+	Vector<GLTFMesh*> secondLainMeshes;
+	// gltfMeshes keyed and sorted every frame, drawn by the opaque and transparent passes
+	RenderQueue renderQueue;
+	// world bounds of gltfMeshes then the obj meshes, built again when meshes are added
+	SceneBVH sceneBVH;
+	Vector<Geometry*> sceneObjects;
+	// objects refit every step: animated bounds and obj meshes moved outside the node update
+	Vector<u32> dynamicSceneObjects;
+	// objects of each node, refit when the node moves
+	Map<i32, Vector<u32>> nodeSceneObjects;
+	// isVisible is set only for these, so culling does not touch every object
+	Vector<u32> visibleSceneObjects;
+	// static opaque gltf meshes culled and drawn on the gpu, null if the device cannot draw indirect with a count
+	SharedPtr<IndirectDraw> indirectDraw;
+	// static opaque gltf primitives are baked into batches after loading
+	bool mergeStaticMeshes = true;
+	MeshMerge::Settings staticMergeSettings;
+	// meshes with a skeleton or blend shapes, transformed by vertexComputePipeline
+	Vector<SharedPtr<GLTFMesh>> animatedMeshes;
 	SharedPtr<StructuredBuffer> particleBuffer;
 	SharedPtr<StructuredBuffer> particleBufferPrev;
 	SharedPtr<ParticlesUniformBuffer> particleUniformBuffer;
@@ -90,6 +137,15 @@ namespace Graphics
 	SharedPtr<ComputePipeline> particleELCWindComputePipeline;
 	SharedPtr<GraphicsPipeline> particleRenderPipeline;
 	SharedPtr<ComputePipeline> vertexComputePipeline;
+	SharedPtr<SkinPaletteBuffer> skinPaletteBuffer;
+	// written by the render frame, only read by vertex shader skinning
+	SharedPtr<SkinPaletteBuffer> vertexSkinPaletteBuffer;
+	// baked copies of the skinned meshes, all sharing one instance layout
+	Vector<SharedPtr<Crowd>> crowds;
+	bool crowdsCreated = false;
+	f32 crowdTime = 0.f;
+	const u32 maxCrowdInstances = 4096;
+	const f32 crowdBakeFrameRate = 30.f;
 	Vector<SharedPtr<Buffer>> computeBuffers;
 	Vector<Texture> computeTextures{};
 	u32 numVertexPerStrand = 16;
@@ -99,6 +155,8 @@ namespace Graphics
 	const f32 fixedDeltaTime = 0.016f;
 	f32 updateTimeAccumulator = 0.f;
 	const u32 maxUpdateStepsPerFrame = 5;
+	// meshes up to this size get a host vertex buffer and can be skinned on the cpu
+	const u32 maxCpuSkinningVertices = 4096;
 	u32 physicsFrameID = 0;
 
 	//  4f position 4f color. can optimize later
@@ -115,6 +173,19 @@ namespace Graphics
 		uiRender = MakeShared<UIRender>(presentation);
 	}
 
+	// variants of a pass pipeline with other vertex inputs, bound per draw for animated meshes
+	SharedPtr<GraphicsPipeline> CreateVariant(SharedPtr<RenderPass> pass, SharedPtr<Shader> vertexShader, SharedPtr<VertexDesc> vertexDesc, Vector<SharedPtr<Buffer>> buffers, SharedPtr<Shader> fragmentShader = nullptr)
+	{
+		auto pso = pass->subpasses[0].pso;
+		auto variant = MakeShared<GraphicsPipeline>(vertexShader, fragmentShader ? fragmentShader : pso->fragmentShader, vertexDesc, pso->uniformDesc, Vector<Texture>{}, buffers);
+		variant->blendEnabled = pso->blendEnabled;
+		variant->depthTestEnable = pso->depthTestEnable;
+		variant->depthWriteEnable = pso->depthWriteEnable;
+		variant->depthCompareOp = pso->depthCompareOp;
+		variant->Init(pass->renderPassID, pass->subpasses[0].attachments);
+		return variant;
+	}
+
 	void InitGraphics(void * window)
 	{
 		nodeManager = MakeShared<NodeManager>(10000);
@@ -159,8 +230,9 @@ namespace Graphics
 				Vector<SharedPtr<Buffer>>{}
 			);
 			Attachment framebuffer(Texture::FormatType::BGRA_SRGB);
-			framebuffer.loadOp = Graphics::AttachmentOpType::DONTCARE;
-			framebuffer.depthLoadOp = Graphics::AttachmentOpType::DONTCARE;
+			// on top of the skybox pass, which clears color and depth
+			framebuffer.loadOp = Graphics::AttachmentOpType::LOAD;
+			framebuffer.depthLoadOp = Graphics::AttachmentOpType::LOAD;
 			Attachment albedo(Texture::FormatType::RGBA8_UNORM);
 			Attachment positionDepth(Texture::FormatType::RGB16_SFLOAT);
 			Attachment normal(Texture::FormatType::RGB16_SFLOAT);
@@ -208,7 +280,10 @@ namespace Graphics
 				Vector<Texture>{},
 				Vector<SharedPtr<Buffer>>{}
 			);
-			forwardPass = MakeShared<RenderPass>(forwardPipeline, Graphics::AttachmentOpType::DONTCARE);
+			// the depth pre-pass writes the same depth the indirect variant draws at
+			forwardPipeline->depthCompareOp = GraphicsPipeline::DepthCompareOpType::LEQUAL;
+			// keeps the skybox and the depth pre-pass, the skybox pass is the only one that clears
+			forwardPass = MakeShared<RenderPass>(forwardPipeline, Graphics::AttachmentOpType::LOAD);
 	#endif
 			forwardTransparentPipeline = MakeShared<GraphicsPipeline>(
 				MakeShared<Shader>(concat_str(SHADERS_DIR, TRIANGLE_VERTEX_SHADER), Shader::ShaderType::SHADER_VERTEX, "main"),
@@ -221,7 +296,7 @@ namespace Graphics
 			forwardTransparentPipeline->blendEnabled = true;
 			forwardTransparentPipeline->depthTestEnable = true;
 			forwardTransparentPipeline->depthWriteEnable = false;
-			forwardTransparentPass = MakeShared<RenderPass>(forwardTransparentPipeline, Graphics::AttachmentOpType::DONTCARE);
+			forwardTransparentPass = MakeShared<RenderPass>(forwardTransparentPipeline, Graphics::AttachmentOpType::LOAD);
 
 			skyboxPipeline = MakeShared<GraphicsPipeline>(
 				MakeShared<Shader>(concat_str(SHADERS_DIR, SKYBOX_VERTEX_SHADER), Shader::ShaderType::SHADER_VERTEX, "main"),
@@ -252,7 +327,11 @@ namespace Graphics
 			//headMesh->node = nodeManager->AddNode(Math::Translate(Math::Rotate(mat4(1), Math::PI, vec3(0, 0, 1)), vec3(0,1,-2)), camera->node->nodeID, Node::NodeType::MESH_NODE);
 			//headNode = headMesh->node;
 			// GLTF
-			SharedPtr<Node> gltf1 = Import::LoadGLTF(concat_str(GLTF_DIR, GLTF_FILE), *nodeManager, forwardPipeline, forwardTransparentPipeline, gltfMeshes);
+			auto loadStart = std::chrono::high_resolution_clock::now();
+			auto lainAsset = Import::LoadGLTFAsset(concat_str(GLTF_DIR, GLTF_FILE), *nodeManager, forwardPipeline, forwardTransparentPipeline);
+			SharedPtr<Node> gltf1 = lainAsset->Instantiate(NodeID{ .id = 0 }, gltfMeshes);
+			DebugPrint("%s: load %.2f ms\n", GLTF_FILE,
+				std::chrono::duration<f32, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - loadStart).count());
 
 			for (auto node : nodeManager->nodes)
 			{
@@ -271,9 +350,29 @@ namespace Graphics
 			auto gltf3 = Import::LoadGLTF(concat_str(GLTF_DIR, GLTF_FILE3), *nodeManager, forwardPipeline, forwardTransparentPipeline, gltfMeshes);
 			gltf3->modelMatrix = Math::Scale(mat4(1), vec3(0.2f));
 
-			// slow due to skeletal matrix update on cpu
-			//auto ellengltf = Import::LoadGLTF(concat_str(GLTF_DIR, GLTF_ELLEN_JOE), *nodeManager, forwardPipeline, forwardTransparentPipeline, gltfMeshes);
-			//ellengltf->modelMatrix = Math::Translate(Math::Rotate(mat4(1), -Math::PI / 2, vec3(0, 1, 0)), vec3(-1, 0.5f, -5));
+#ifdef GLTF_INSTANCED_FILE
+			auto instancedgltf = Import::LoadGLTF(concat_str(GLTF_DIR, GLTF_INSTANCED_FILE), *nodeManager, forwardPipeline, forwardTransparentPipeline, gltfMeshes);
+			instancedgltf->modelMatrix = Math::Translate(mat4(1), vec3(0, 0, -10));
+#endif
+
+			// after every root transform is set, merged primitives keep their transform from now on
+			if (mergeStaticMeshes)
+				MeshMerge::MergeStatic(gltfMeshes, *nodeManager, staticMergeSettings);
+
+			// second copy shares the vertex, index and texture memory, only the pose is its own.
+			// added after the merge so none of its primitives end up in a batch the toggle cannot hide
+			auto instantiateStart = std::chrono::high_resolution_clock::now();
+			const size_t copyMeshesBegin = gltfMeshes.size();
+			SharedPtr<Node> gltf1Copy = lainAsset->Instantiate(NodeID{ .id = 0 }, gltfMeshes);
+			gltf1Copy->modelMatrix = Math::Translate(mat4(1), vec3(-2.5f, 1.5f, 0));
+			for (size_t i = copyMeshesBegin; i < gltfMeshes.size(); ++i)
+				secondLainMeshes.push_back(gltfMeshes[i].get());
+			DebugPrint("%s: instantiate %.2f ms\n", GLTF_FILE,
+				std::chrono::duration<f32, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - instantiateStart).count());
+
+			auto memoryStats = device->GetMemoryStats();
+			DebugPrint("device memory: %u blocks, %u resources, %.1f of %.1f MB used\n", memoryStats.blockCount, memoryStats.allocationCount,
+				memoryStats.usedBytes / (1024.f * 1024.f), memoryStats.reservedBytes / (1024.f * 1024.f));
 		}
 
 		// Compute Passes
@@ -326,46 +425,124 @@ namespace Graphics
 			particleRenderPipeline->depthTestEnable = true;
 			particleRenderPipeline->depthWriteEnable = false;
 			particleRenderPipeline->lineWidth = 10;
-			forwardParticlePass = MakeShared<RenderPass>(particleRenderPipeline, Graphics::AttachmentOpType::DONTCARE);
+			forwardParticlePass = MakeShared<RenderPass>(particleRenderPipeline, Graphics::AttachmentOpType::LOAD);
 
 			for (auto mesh : gltfMeshes)
-			{
-				// use the first mesh with skeleton or blend shape to init the pipeline
 				if (mesh->GetVertexData()->hasSkeleton || mesh->GetVertexData()->hasBlends)
+					animatedMeshes.push_back(mesh);
+			for (auto& mesh : animatedMeshes)
+				if (mesh->GetVertexData()->GetVerticesCount() <= maxCpuSkinningVertices)
+					mesh->hostVertices = MakeShared<HostVertexBuffer>(mesh->GetVertexData()->GetVerticesCount() * sizeof(BasicVertex::DynamicVertex));
+
+			// palettes of all skins back to back, only the joints each skin uses
+			u32 numPaletteJoints = 0;
+			for (auto& skin : nodeManager->skins)
+			{
+				skin->paletteOffset = numPaletteJoints;
+				numPaletteJoints += static_cast<u32>(skin->palette.size());
+			}
+			ResourceBinding paletteBinding;
+			paletteBinding.binding = 3;
+			paletteBinding.shaderStageType = ResourceBinding::ShaderStageType::COMPUTE;
+			skinPaletteBuffer = MakeShared<SkinPaletteBuffer>(numPaletteJoints, paletteBinding);
+
+			// compute output only has the dynamic attributes, uv and color come from the source vertices
+			for (auto& pass : { forwardPass, forwardTransparentPass })
+				pass->subpasses[0].pso->animatedVariant = CreateVariant(pass, pass->subpasses[0].pso->vertexShader, MakeShared<SplitStreamVertex>(), Vector<SharedPtr<Buffer>>{});
+
+	#ifndef USE_DEFERRED
+			// for meshes that skin in the vertex shader
+			ResourceBinding vertexPaletteBinding;
+			vertexPaletteBinding.binding = 1;
+			vertexPaletteBinding.shaderStageType = ResourceBinding::ShaderStageType::VERTEX;
+			vertexSkinPaletteBuffer = MakeShared<SkinPaletteBuffer>(numPaletteJoints, vertexPaletteBinding);
+			auto skinnedVertexShader = MakeShared<Shader>(concat_str(SHADERS_DIR, SKINNED_VERTEX_SHADER), Shader::ShaderType::SHADER_VERTEX, "main");
+			for (auto& pass : { forwardPass, forwardTransparentPass })
+				pass->subpasses[0].pso->skinnedVariant = CreateVariant(pass, skinnedVertexShader, MakeShared<SkinnedVertex>(), Vector<SharedPtr<Buffer>>{ vertexSkinPaletteBuffer });
+
+			// EXT_mesh_gpu_instancing meshes, one draw for all instances. only when the scene has one
+			if (std::any_of(gltfMeshes.begin(), gltfMeshes.end(), [](const SharedPtr<GLTFMesh>& mesh) { return !mesh->instanceMatrices.empty(); }))
+			{
+				auto instancedVertexShader = MakeShared<Shader>(concat_str(SHADERS_DIR, INSTANCED_VERTEX_SHADER), Shader::ShaderType::SHADER_VERTEX, "main");
+				for (auto& pass : { forwardPass, forwardTransparentPass })
+					pass->subpasses[0].pso->instancedVariant = CreateVariant(pass, instancedVertexShader, MakeShared<InstancedVertex>(), Vector<SharedPtr<Buffer>>{});
+			}
+
+			// world matrices for the object table below
+			nodeManager->Update(0.f);
+
+			// static opaque meshes with the object table instead of push constants
+			if (device->supportsIndirectDraw)
+			{
+				auto indirectVertexShader = MakeShared<Shader>(concat_str(SHADERS_DIR, INDIRECT_VERTEX_SHADER), Shader::ShaderType::SHADER_VERTEX, "main");
+				auto indirectFragmentShader = MakeShared<Shader>(concat_str(SHADERS_DIR, TRIANGLE_INDIRECT_FRAG_SHADER), Shader::ShaderType::SHADER_FRAGMENT, "main");
+				forwardPass->subpasses[0].pso->indirectVariant = CreateVariant(forwardPass, indirectVertexShader, MakeShared<BasicVertex>(), Vector<SharedPtr<Buffer>>{}, indirectFragmentShader);
+				// the hair and second lain toggles hide these per frame
+				Vector<SharedPtr<GLTFMesh>> indirectMeshes;
+				for (auto& mesh : gltfMeshes)
+					if (mesh->node->name != "hair_0" && std::find(secondLainMeshes.begin(), secondLainMeshes.end(), mesh.get()) == secondLainMeshes.end())
+						indirectMeshes.push_back(mesh);
+				auto cullShader = MakeShared<Shader>(concat_str(SHADERS_DIR, CULL_INDIRECT_COMP_SHADER), Shader::ShaderType::SHADER_COMPUTE, "main");
+				// every sample of a texel is read when the depth is multisampled
+				auto pyramidShader = MakeShared<Shader>(device->depthSamples > 1 ? concat_str(SHADERS_DIR, DEPTH_PYRAMID_MS_COMP_SHADER) : concat_str(SHADERS_DIR, DEPTH_PYRAMID_COMP_SHADER),
+					Shader::ShaderType::SHADER_COMPUTE, "main");
+				auto depthPyramid = MakeShared<DepthPyramid>(presentation, device->depthSamples, pyramidShader);
+				indirectDraw = MakeShared<IndirectDraw>(indirectMeshes, cullShader, depthPyramid);
+
+				// position only streams with the object table, same view as the forward pass
+				auto depthPipeline = MakeShared<GraphicsPipeline>(
+					MakeShared<Shader>(concat_str(SHADERS_DIR, DEPTH_PREPASS_VERTEX_SHADER), Shader::ShaderType::SHADER_VERTEX, "main"),
+					MakeShared<Shader>(concat_str(SHADERS_DIR, DEPTH_PREPASS_FRAG_SHADER), Shader::ShaderType::SHADER_FRAGMENT, "main"),
+					MakeShared<PosOnlyVertex>(),
+					forwardPipeline->uniformDesc,
+					Vector<Texture>{},
+					Vector<SharedPtr<Buffer>>{}
+				);
+				depthPipeline->colorWriteEnable = false;
+				// tests against the skybox pass's cleared depth, the pyramid and the forward pass read what it stores
+				depthPrepass = MakeShared<RenderPass>(depthPipeline, Graphics::AttachmentOpType::LOAD);
+				UI::indirectObjects = static_cast<u32>(indirectDraw->objects.size());
+				UI::indirectGroups = static_cast<u32>(indirectDraw->groups.size());
+			}
+	#endif
+
+			if (animatedMeshes.size() > 0)
+			{
+				// placeholders for bindings a mesh does not use
+				ResourceBinding jointWeightBufferBinding;
+				jointWeightBufferBinding.binding = 2;
+				jointWeightBufferBinding.shaderStageType = ResourceBinding::ShaderStageType::COMPUTE;
+				Vector<Buffer::BufferUsageType> jointWeightsBufferUsage;
+				jointWeightsBufferUsage.push_back(Buffer::BufferUsageType::BUFFER_STORAGE);
+				jointWeightsBufferUsage.push_back(Buffer::BufferUsageType::BUFFER_TRANSFER_DST);
+				Vector<f32> tmpVec{1};
+				SharedPtr<StructuredBuffer> jointWeightData = MakeShared<StructuredBuffer>(tmpVec, jointWeightBufferBinding, jointWeightsBufferUsage);
+				SharedPtr<BlendWeightsBuffer> blendWeightsBuffer = MakeShared<BlendWeightsBuffer>(1);
+				ResourceBinding blendDataBufferBinding;
+				blendDataBufferBinding.binding = 5;
+				blendDataBufferBinding.shaderStageType = ResourceBinding::ShaderStageType::COMPUTE;
+				Vector<Buffer::BufferUsageType> blendDataBufferUsage;
+				blendDataBufferUsage.push_back(Buffer::BufferUsageType::BUFFER_STORAGE);
+				blendDataBufferUsage.push_back(Buffer::BufferUsageType::BUFFER_TRANSFER_DST);
+				SharedPtr<StructuredBuffer> blendDataBuffer = MakeShared<StructuredBuffer>(tmpVec, blendDataBufferBinding, blendDataBufferUsage);
+
+				Vector<SharedPtr<Buffer>> computeVertexBuffers{ animatedMeshes[0]->vertexBuffer, animatedMeshes[0]->transformedVertexBuffer,
+					jointWeightData, skinPaletteBuffer, blendWeightsBuffer, blendDataBuffer };
+				Vector<Texture> tex{};
+				PushConstant vertexConstant("VertexParams", PushConstant::Stage::COMPUTE, sizeof(BasicVertex::ComputeVertexConstant));
+				vertexComputePipeline = MakeShared<ComputePipeline>(MakeShared<Shader>(concat_str(SHADERS_DIR, VERTEX_COMP_SHADER), Shader::ShaderType::SHADER_COMPUTE, "main"),
+					vec3{ 1,1,1 }, vec3{ 64,1,1 }, computeVertexBuffers, tex, Vector<PushConstant>{vertexConstant}, static_cast<u32>(animatedMeshes.size())
+				);
+
+				// one set per mesh written once, so a step only records dispatches
+				for (auto& mesh : animatedMeshes)
 				{
-					Vector<SharedPtr<Buffer>> computeVertexBuffers;
-					if (gltfMeshes.size() > 0)
-					{
-						computeVertexBuffers.push_back(gltfMeshes[0]->vertexBuffer);
-						computeVertexBuffers.push_back(gltfMeshes[0]->transformedVertexBuffer);
-					}
-					ResourceBinding jointWeightBufferBinding;
-					jointWeightBufferBinding.binding = 2;
-					jointWeightBufferBinding.shaderStageType = ResourceBinding::ShaderStageType::COMPUTE;
-					Vector<Buffer::BufferUsageType> jointWeightsBufferUsage;
-					jointWeightsBufferUsage.push_back(Buffer::BufferUsageType::BUFFER_STORAGE);
-					jointWeightsBufferUsage.push_back(Buffer::BufferUsageType::BUFFER_TRANSFER_DST);
-					Vector<f32> tmpVec{1};
-					SharedPtr<StructuredBuffer> jointWeightData = MakeShared<StructuredBuffer>(tmpVec, jointWeightBufferBinding, jointWeightsBufferUsage);
-					computeVertexBuffers.push_back(jointWeightData);
-					SharedPtr<SkeletonUniformBuffer> skeletonBufferData = MakeShared<SkeletonUniformBuffer>();
-					computeVertexBuffers.push_back(skeletonBufferData);
-					SharedPtr<BlendWeightsUniformBuffer> blendWeightsUniform = MakeShared<BlendWeightsUniformBuffer>();
-					computeVertexBuffers.push_back(blendWeightsUniform);
-					ResourceBinding blendDataBufferBinding;
-					blendDataBufferBinding.binding = 5;
-					blendDataBufferBinding.shaderStageType = ResourceBinding::ShaderStageType::COMPUTE;
-					Vector<Buffer::BufferUsageType> blendDataBufferUsage;
-					blendDataBufferUsage.push_back(Buffer::BufferUsageType::BUFFER_STORAGE);
-					blendDataBufferUsage.push_back(Buffer::BufferUsageType::BUFFER_TRANSFER_DST);
-					SharedPtr<StructuredBuffer> blendDataBuffer = MakeShared<StructuredBuffer>(tmpVec, blendDataBufferBinding, blendDataBufferUsage);
-					computeVertexBuffers.push_back(blendDataBuffer);
-					Vector<Texture> tex{};
-					PushConstant vertexConstant("VertexParams", PushConstant::Stage::COMPUTE, sizeof(BasicVertex::ComputeVertexConstant));
-					vertexComputePipeline = MakeShared<ComputePipeline>(MakeShared<Shader>(concat_str(SHADERS_DIR, VERTEX_COMP_SHADER), Shader::ShaderType::SHADER_COMPUTE, "main"),
-						vec3{ 1,1,1 }, vec3{ 64,1,1 }, computeVertexBuffers, tex, Vector<PushConstant>{vertexConstant}
-					);
-					break;
+					Vector<SharedPtr<Buffer>> meshBuffers{ mesh->vertexBuffer, mesh->transformedVertexBuffer,
+						mesh->jointWeightData ? mesh->jointWeightData : jointWeightData,
+						skinPaletteBuffer,
+						mesh->morphWeightData ? mesh->morphWeightData : blendWeightsBuffer,
+						mesh->morphTargetsData ? mesh->morphTargetsData : blendDataBuffer };
+					mesh->computeSetID = vertexComputePipeline->CreateResourceSets(meshBuffers, tex);
 				}
 			}
 			
@@ -375,7 +552,234 @@ namespace Graphics
 		}
 	}
 
-	void Update(const f32 fixedDeltaTime)
+	// same inputs as the mesh's last dispatch
+	void SkinOnCpu(GLTFMesh& mesh, BasicVertex::DynamicVertex* out)
+	{
+		static const Vector<mat4> noPalette;
+		auto vertexData = std::static_pointer_cast<BasicVertex>(mesh.GetVertexData());
+		CpuSkinning::Skin(*vertexData, mesh.vertexConstant, mesh.GetSkin() ? mesh.GetSkin()->palette : noPalette, mesh.node->morphWeights, out);
+	}
+
+	// compare the compute output with the cpu kernel for every mesh skinned by compute
+	void ValidateVertexCompute()
+	{
+		f32 maxDifference = 0.f;
+		Vector<BasicVertex::DynamicVertex> gpuVertices;
+		Vector<BasicVertex::DynamicVertex> cpuVertices;
+		for (auto& mesh : animatedMeshes)
+		{
+			if (mesh->skinningMode != GLTFMesh::SkinningMode::COMPUTE)
+				continue;
+			mesh->ReadTransformedVertices(gpuVertices);
+			cpuVertices.resize(mesh->GetVertexData()->GetVerticesCount());
+			SkinOnCpu(*mesh, cpuVertices.data());
+			f32 difference = CpuSkinning::MaxDifference(gpuVertices.data(), cpuVertices.data(), static_cast<u32>(cpuVertices.size()));
+			DebugPrint("vertex compute %s: %zu vertices, max difference %g\n", mesh->node->name.c_str(), cpuVertices.size(), difference);
+			maxDifference = Max(maxDifference, difference);
+		}
+		UI::vertexComputeMaxDifference = maxDifference;
+	}
+
+	Math::AABB SceneObjectBounds(u32 object)
+	{
+		if (object < gltfMeshes.size())
+			return Culling::WorldBounds(*gltfMeshes[object]);
+		return Culling::WorldBounds(*sceneObjects[object]);
+	}
+
+	void BuildSceneBVH()
+	{
+		sceneObjects.clear();
+		dynamicSceneObjects.clear();
+		nodeSceneObjects.clear();
+		for (auto& mesh : gltfMeshes)
+		{
+			u32 object = static_cast<u32>(sceneObjects.size());
+			sceneObjects.push_back(mesh.get());
+			if (mesh->GetVertexData()->hasSkeleton || mesh->GetVertexData()->hasBlends)
+			{
+				Culling::UpdateAnimatedBounds(*mesh);
+				dynamicSceneObjects.push_back(object);
+			}
+			else
+				nodeSceneObjects[mesh->node->nodeID.id].push_back(object);
+		}
+		for (auto& mesh : { vikingRoom, headMesh })
+		{
+			dynamicSceneObjects.push_back(static_cast<u32>(sceneObjects.size()));
+			sceneObjects.push_back(mesh.get());
+		}
+
+		Vector<Math::AABB> bounds(sceneObjects.size());
+		for (u32 i = 0; i < bounds.size(); ++i)
+			bounds[i] = SceneObjectBounds(i);
+		sceneBVH.Build(bounds);
+		// every object starts visible
+		visibleSceneObjects.resize(sceneObjects.size());
+		for (u32 i = 0; i < visibleSceneObjects.size(); ++i)
+		{
+			sceneObjects[i]->isVisible = true;
+			visibleSceneObjects[i] = i;
+		}
+	}
+
+	// refits what moved since the last call, only animated meshes and the nodes of the last update are visited
+	void RefitSceneBVH()
+	{
+		if (sceneObjects.size() != gltfMeshes.size() + 2)
+		{
+			BuildSceneBVH();
+			return;
+		}
+		for (u32 object : dynamicSceneObjects)
+		{
+			if (object < gltfMeshes.size())
+				Culling::UpdateAnimatedBounds(*gltfMeshes[object]);
+			sceneBVH.Update(object, SceneObjectBounds(object));
+		}
+		for (NodeID nodeID : nodeManager->movedNodes)
+		{
+			auto it = nodeSceneObjects.find(nodeID.id);
+			if (it == nodeSceneObjects.end())
+				continue;
+			for (u32 object : it->second)
+				sceneBVH.Update(object, SceneObjectBounds(object));
+		}
+		sceneBVH.Refit();
+	}
+
+	// visibility from the camera, before the dispatches and draws that skip culled meshes. expects the bvh refit for this step
+	void CullMeshes()
+	{
+		for (u32 object : visibleSceneObjects)
+			sceneObjects[object]->isVisible = false;
+		visibleSceneObjects.clear();
+		if (UI::frustumCulling)
+		{
+			Math::Frustum frustum(camera->GetProjectionMatrix() * camera->GetCameraMatrix());
+			sceneBVH.QueryFrustum(frustum, [](u32 object) { visibleSceneObjects.push_back(object); });
+		}
+		else
+		{
+			for (u32 i = 0; i < sceneObjects.size(); ++i)
+				visibleSceneObjects.push_back(i);
+		}
+		for (u32 object : visibleSceneObjects)
+			sceneObjects[object]->isVisible = true;
+		// hidden like a culled mesh, so it is neither drawn nor skinned
+		if (!UI::showSecondLain)
+			for (auto* mesh : secondLainMeshes)
+				mesh->isVisible = false;
+		UI::cullableMeshes = static_cast<u32>(sceneObjects.size());
+		UI::culledMeshes = UI::cullableMeshes - static_cast<u32>(visibleSceneObjects.size());
+	}
+
+	// right click names the nearest mesh box under the cursor
+	void PickMesh()
+	{
+		static bool wasPressed = false;
+		bool pressed = Input::mouseState.rightPressed;
+		if (!pressed || wasPressed)
+		{
+			wasPressed = pressed;
+			return;
+		}
+		wasPressed = pressed;
+		vec3 origin, direction;
+		camera->GetRay(vec2(Input::mouseState.xpos, Input::mouseState.ypos), origin, direction);
+		u32 object;
+		f32 distance;
+		if (sceneBVH.Raycast(origin, direction, camera->GetFarPlane(), object, distance))
+		{
+			UI::pickedMesh = sceneObjects[object]->node->name;
+			UI::pickedDistance = distance;
+		}
+		else
+		{
+			UI::pickedMesh = "none";
+			UI::pickedDistance = 0;
+		}
+	}
+
+	// crowds of every opaque skinned mesh, placed on a grid behind the scene. baked the first time the crowd is shown,
+	// after the frame's update so world matrices and palettes are current
+	void CreateCrowds()
+	{
+		Vector<Crowd::Instance> instances(maxCrowdInstances);
+		const u32 columns = 64;
+		const f32 spacing = 1.5f;
+		std::mt19937 random(0);
+		std::uniform_real_distribution<f32> uniform(0.f, 1.f);
+		for (u32 i = 0; i < maxCrowdInstances; ++i)
+		{
+			vec3 offset((static_cast<f32>(i % columns) - columns * 0.5f) * spacing, 0.f, -(static_cast<f32>(i / columns) + 3.f) * spacing);
+			instances[i].positionYaw = vec4(offset, (uniform(random) - 0.5f) * Math::PI);
+			instances[i].timeOffsetRate = vec4(uniform(random) * 10.f, 0.8f + uniform(random) * 0.4f, 0, 0);
+		}
+		auto instanceBuffer = Crowd::CreateInstanceBuffer(instances);
+
+		auto crowdVertexShader = MakeShared<Shader>(concat_str(SHADERS_DIR, CROWD_VERTEX_SHADER), Shader::ShaderType::SHADER_VERTEX, "main");
+		// instances of an asset play the same clip, baked once
+		Set<VertexDesc*> bakedVertexData;
+		for (auto& mesh : animatedMeshes)
+		{
+			if (!mesh->GetSkin() || !mesh->GetSkin()->skeleton || mesh->material->material->alphaMode == PBRMaterial::ALPHA_MODE::ALPHA_TRANSPARENT)
+				continue;
+			if (!bakedVertexData.insert(mesh->GetVertexData().get()).second)
+				continue;
+			auto crowd = MakeShared<Crowd>(mesh, VertexAnimation::Bake(*mesh, crowdBakeFrameRate), instanceBuffer);
+			crowd->pipeline = CreateVariant(forwardPass, crowdVertexShader, MakeShared<BasicVertex>(), Vector<SharedPtr<Buffer>>{ crowd->animationBuffer, crowd->instanceBuffer });
+			crowds.push_back(crowd);
+		}
+	}
+
+	// build, refit and query times on random scenes, see the log
+	void BenchmarkSceneBVH()
+	{
+		for (u32 objectCount : { 10000u, 30000u, 100000u })
+		{
+			auto result = SceneBVH::Benchmark(objectCount);
+			UI::bvhRefitMs = result.refitMs;
+			UI::bvhFrustumMs = result.frustumMs;
+			UI::bvhLinearFrustumMs = result.linearFrustumMs;
+		}
+	}
+
+	// skeleton and skin updates of 1 and 16 ellen_joe copies on the calling thread then on the job threads,
+	// and the palette math alone with glm against MulAffine. see the log
+	void BenchmarkAnimation()
+	{
+		const u32 maxCopies = 16;
+		if (!ellenNodeManager)
+		{
+			ellenNodeManager = MakeShared<NodeManager>(10000);
+			auto ellenAsset = Import::LoadGLTFAsset(concat_str(GLTF_DIR, GLTF_ELLEN_JOE), *ellenNodeManager, forwardPipeline, forwardTransparentPipeline);
+			for (u32 i = 0; i < maxCopies; ++i)
+				ellenAsset->Instantiate(NodeID{ .id = 0 }, ellenMeshes);
+		}
+
+		const u32 steps = 60;
+		assert(!ellenNodeManager->skeletons.empty());
+		const u32 jointCount = ellenNodeManager->skeletons[0]->GetJointCount();
+		for (bool multithreaded : { false, true })
+		{
+			Util::Jobs::SetEnabled(multithreaded);
+			auto start = std::chrono::high_resolution_clock::now();
+			for (u32 step = 0; step < steps; ++step)
+				ellenNodeManager->Update(fixedDeltaTime);
+			f32 updateMs = std::chrono::duration<f32, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count() / steps;
+			(multithreaded ? UI::ellenJobThreadsMs : UI::ellenSingleThreadMs) = updateMs;
+			DebugPrint("ellen_joe %u copies of %u joints: %.3f ms per update %s\n", maxCopies, jointCount, updateMs, multithreaded ? "on the job threads" : "on one thread");
+		}
+
+		Util::Jobs::SetEnabled(true);
+		for (u32 characterCount : { 1u, maxCopies })
+			Skeleton::Benchmark(characterCount, jointCount);
+		Util::Jobs::SetEnabled(UI::multithreadedAnimation);
+	}
+
+	// returns the number of fixed steps taken
+	u32 Update(const f32 fixedDeltaTime)
 	{
 		u32 curSteps = 0;
 		while (updateTimeAccumulator > fixedDeltaTime)
@@ -390,7 +794,17 @@ namespace Graphics
 
 			auto prevHeadMat = headNode->worldMatrix;
 			camera->Update(fixedDeltaTime);
+
+			Util::Jobs::SetEnabled(UI::multithreadedAnimation);
+			auto animationStart = std::chrono::high_resolution_clock::now();
 			nodeManager->Update(fixedDeltaTime);
+			f32 animationMs = std::chrono::duration<f32, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - animationStart).count();
+			UI::animationUpdateMs = glm::mix(UI::animationUpdateMs, animationMs, 0.05f);
+			// moved nodes only hold this step's moves, so the refit and the draw data upload happen once per step
+			RefitSceneBVH();
+			if (indirectDraw)
+				indirectDraw->MarkMoved(nodeManager->movedNodes);
+			CullMeshes();
 			// all the fixed updates
 			{
 				// particle compute passes
@@ -425,56 +839,69 @@ namespace Graphics
 					particleLSCComputePipeline->Dispatch(computeContext);
 					computeContext.computePipeline = particleELCWindComputePipeline;
 					particleELCWindComputePipeline->Dispatch(computeContext);
-					device->EndRecording(computeContext);
 
-					for (auto& mesh : gltfMeshes)
+					// skinning and blend shapes for all meshes go into the same submission
+					if (vertexComputePipeline)
+						computeContext.computePipeline = vertexComputePipeline;
+					// shared by all primitives of a skin, so written once per skin. the buffer tracks the version in
+					// each copy, a dispatch for changed morph weights then reads this frame's up to date palette
+					for (auto& skin : nodeManager->skins)
+						skinPaletteBuffer->Write(computeContext.frameID, skin->paletteOffset, skin->palette, skin->paletteVersion);
+					for (auto& mesh : animatedMeshes)
 					{
-						auto vertexData = mesh->GetVertexData();
-						if (vertexData->hasSkeleton)
+						mesh->Update(fixedDeltaTime);
+
+						auto skinningMode = GLTFMesh::SkinningMode::COMPUTE;
+						if (UI::vertexShaderSkinning && mesh->SupportsVertexSkinning() && forwardPipeline->skinnedVariant)
+							skinningMode = GLTFMesh::SkinningMode::VERTEX_SHADER;
+						else if (mesh->hostVertices && mesh->GetVertexData()->GetVerticesCount() <= UI::cpuSkinningMaxVertices)
+							skinningMode = GLTFMesh::SkinningMode::CPU;
+						if (skinningMode != mesh->skinningMode)
 						{
-							computeContext.computePipeline = vertexComputePipeline;
-							mesh->Update(fixedDeltaTime);
-							mesh->skeletonMatrixData->UpdateUniformBuffer(computeContext.frameID);
-							// set the buffers
-							Vector<SharedPtr<Buffer>> newBuffers{mesh->vertexBuffer, mesh->transformedVertexBuffer, mesh->jointWeightData, mesh->skeletonMatrixData };
-							Vector<Texture> newTextures;
-							// TODO one descriptor set per skinned or morph mesh for compute vertex
-							device->BeginRecording(computeContext);
-							vertexComputePipeline->UpdateResources(computeContext, newBuffers, newTextures);
-							device->EndRecording(computeContext);
-
-							device->BeginRecording(computeContext);
-							vertexComputePipeline->pushConstants[0].SetData(&mesh->GetVertexData()->vertexConstant, sizeof(BasicVertex::ComputeVertexConstant));
-							vertexComputePipeline->threadSz = vec3(mesh->vertexBuffer->GetBufferSize() / sizeof(BasicVertex::Vertex), 1, 1);
-							vertexComputePipeline->Dispatch(computeContext);
-							device->EndRecording(computeContext);
+							mesh->skinningMode = skinningMode;
+							mesh->poseDirty = true;
+						}
+						// skinned when drawn or before the frame is recorded
+						if (mesh->skinningMode != GLTFMesh::SkinningMode::COMPUTE)
+							continue;
+
+						// stays dirty until the mesh is in view
+						if (!mesh->isVisible)
+							continue;
+						// transformed vertices from the last dispatch are still valid
+						if (!mesh->poseDirty)
+						{
+							UI::skippedVertexDispatches++;
+							continue;
 						}
+						mesh->poseDirty = false;
+						if (mesh->morphWeightData)
+							mesh->morphWeightData->Write(computeContext.frameID, mesh->node->morphWeights);
 
-						if (vertexData->hasBlends)
+						if (!UI::batchVertexCompute)
 						{
-							computeContext.computePipeline = vertexComputePipeline;
-							mesh->Update(fixedDeltaTime);
-							mesh->morphWeightData->UpdateUniformBuffer(computeContext.frameID);
-							Vector<SharedPtr<Buffer>> newBuffers{ mesh->vertexBuffer, mesh->transformedVertexBuffer, mesh->morphWeightData, mesh->morphTargetsData };
-							Vector<Texture> newTextures;
-							device->BeginRecording(computeContext);
-							vertexComputePipeline->UpdateResources(computeContext, newBuffers, newTextures);
-							vertexComputePipeline->pushConstants[0].SetData(&mesh->GetVertexData()->vertexConstant, sizeof(BasicVertex::ComputeVertexConstant));
 							device->EndRecording(computeContext);
-							vertexComputePipeline->threadSz = vec3(mesh->vertexBuffer->GetBufferSize() / sizeof(BasicVertex::Vertex), 1, 1);
 							device->BeginRecording(computeContext);
-							vertexComputePipeline->Dispatch(computeContext);
-							device->EndRecording(computeContext);
 						}
+
+						vertexComputePipeline->pushConstants[0].SetData(&mesh->vertexConstant, sizeof(BasicVertex::ComputeVertexConstant));
+						vertexComputePipeline->threadSz = vec3(mesh->vertexBuffer->GetBufferSize() / sizeof(BasicVertex::Vertex), 1, 1);
+						vertexComputePipeline->Dispatch(computeContext, mesh->computeSetID);
 					}
+					device->EndRecording(computeContext);
 
-					
+					if (UI::validateVertexCompute)
+					{
+						UI::validateVertexCompute = false;
+						ValidateVertexCompute();
+					}
 				}
 
 				vikingRoom->Update(fixedDeltaTime);
 
 			}
 		}
+		return std::min(curSteps, maxUpdateStepsPerFrame);
 	}
 
 	void MainRender(const u32 frameID, const f32 deltaTime)
@@ -482,11 +909,84 @@ namespace Graphics
 		renderContext.frameID = frameID;
 		renderContext.updateFrameID = computeContext.frameID;
 
+		// submissions of the previous frame
+		UI::graphicsSubmits = device->graphicsSubmitCount;
+		UI::computeSubmits = device->computeSubmitCount;
+		UI::skippedVertexDispatchesPerFrame = UI::skippedVertexDispatches;
+		UI::skippedVertexDispatches = 0;
+		device->graphicsSubmitCount = 0;
+		device->computeSubmitCount = 0;
+		UI::bindsPerFrame = device->bindCount;
+		UI::drawsPerFrame = device->drawCount;
+		device->bindCount = 0;
+		device->drawCount = 0;
+		auto memoryStats = device->GetMemoryStats();
+		UI::memoryBlocks = memoryStats.blockCount;
+		UI::memoryAllocations = memoryStats.allocationCount;
+		UI::memoryUsedMB = memoryStats.usedBytes / (1024.f * 1024.f);
+		UI::memoryReservedMB = memoryStats.reservedBytes / (1024.f * 1024.f);
+		UI::memoryFragmentation = memoryStats.fragmentation;
+
 		updateTimeAccumulator += deltaTime;
-		Update(fixedDeltaTime);
+		u32 steps = Update(fixedDeltaTime);
+		crowdTime += deltaTime;
+		// the camera only moves in a fixed step, which already culled. otherwise nothing moved, only the culling toggles may have changed
+		if (steps == 0)
+			CullMeshes();
+		PickMesh();
+#ifndef USE_DEFERRED
+		if (UI::showCrowd && !crowdsCreated)
+		{
+			crowdsCreated = true;
+			CreateCrowds();
+		}
+#endif
+		if (UI::benchmarkAnimation)
+		{
+			UI::benchmarkAnimation = false;
+			BenchmarkAnimation();
+		}
+		if (UI::benchmarkSceneBVH)
+		{
+			UI::benchmarkSceneBVH = false;
+			BenchmarkSceneBVH();
+		}
 
 		bool success = device->BeginRecording(renderContext);
 		assert(success);
+		// the frame's copy is free once recording begins
+		if (UI::vertexShaderSkinning && vertexSkinPaletteBuffer)
+			for (auto& skin : nodeManager->skins)
+				vertexSkinPaletteBuffer->Write(renderContext.frameID, skin->paletteOffset, skin->palette, skin->paletteVersion);
+		// small meshes skinned on the cpu straight into this frame's copy
+		{
+			Vector<GLTFMesh*> cpuSkinnedMeshes;
+			for (auto& mesh : animatedMeshes)
+				if (mesh->skinningMode == GLTFMesh::SkinningMode::CPU && mesh->isVisible)
+					cpuSkinnedMeshes.push_back(mesh.get());
+			auto cpuSkinningStart = std::chrono::high_resolution_clock::now();
+			Util::Jobs::ParallelFor(static_cast<u32>(cpuSkinnedMeshes.size()), [&](u32 i)
+			{
+				SkinOnCpu(*cpuSkinnedMeshes[i], (BasicVertex::DynamicVertex*)cpuSkinnedMeshes[i]->hostVertices->Map(renderContext.frameID));
+			});
+			f32 cpuSkinningMs = std::chrono::duration<f32, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - cpuSkinningStart).count();
+			UI::cpuSkinningMs = glm::mix(UI::cpuSkinningMs, cpuSkinningMs, 0.05f);
+			UI::cpuSkinnedMeshes = static_cast<u32>(cpuSkinnedMeshes.size());
+		}
+		// commands for the static opaque meshes, written before any pass begins
+		const bool drawIndirect = indirectDraw && UI::gpuCulling;
+		// the depth pyramid is built from the pre-pass
+		const bool drawDepthPrepass = drawIndirect && UI::depthPrepass;
+		const bool occlusionCulling = drawDepthPrepass && UI::occlusionCulling;
+		if (drawIndirect)
+		{
+			indirectDraw->Cull(renderContext, camera->GetProjectionMatrix() * camera->GetCameraMatrix(), occlusionCulling);
+			const auto& stats = indirectDraw->stats;
+			const f32 objects = static_cast<f32>(Max(stats.objects, 1u));
+			UI::frustumCulledFraction = stats.frustumCulled / objects;
+			UI::occludedFraction = stats.occluded / objects;
+			UI::occlusionRescued = stats.rescued;
+		}
 		// pass 0 skybox
 		renderContext.renderPass = skyboxPass;
 		device->BeginRenderPass(renderContext);
@@ -511,20 +1011,55 @@ namespace Graphics
  				particleRenderPipeline->uniformDesc->transformUniform.proj = forwardPipeline->uniformDesc->transformUniform.proj;
  				particleRenderPipeline->uniformDesc->transformUniform.view = forwardPipeline->uniformDesc->transformUniform.view;
  			}
- 			device->BeginRenderPass(renderContext);
+			// depth of the static occluders, then the second culling phase against the pyramid built from it
+			if (drawDepthPrepass)
+			{
+				renderContext.renderPass = depthPrepass;
+				device->BeginRenderPass(renderContext);
+				indirectDraw->DrawDepth(renderContext);
+				device->EndRenderPass(renderContext);
+				if (occlusionCulling)
+					indirectDraw->CullOccluded(renderContext);
+				renderContext.renderPass = forwardPass;
+			}
+			// the queue is recorded in chunks on the job threads, into secondary lists of the pass
+			u32 recordingChunks = UI::parallelRecording ? Util::Jobs::GetWorkerCount() + 1 : 1;
+#ifdef USE_DEFERRED
+			// the subpass barrier can not be recorded in a pass drawn from secondary lists
+			recordingChunks = 1;
+#endif
+			const bool secondaryContents = recordingChunks > 1;
+			f32 recordingMs = 0;
+			u32 usedChunks = 1;
+ 			device->BeginRenderPass(renderContext, secondaryContents);
  			{
-				
- 				vikingRoom->Draw(renderContext);
- 				for (auto& mesh : gltfMeshes)
- 				{
-					if (UI::hideStaticHair && mesh->node->name == "hair_0")
+				// opaque and mask alpha meshes of this pass, transparent ones for pass 3
+				renderQueue.Clear();
+				for (auto& mesh : gltfMeshes)
+				{
+					if (!mesh->isVisible || (UI::hideStaticHair && mesh->node->name == "hair_0"))
 						continue;
- 					// opaque or mask alpha
- 					if (mesh->material->material->alphaMode != PBRMaterial::ALPHA_MODE::ALPHA_TRANSPARENT)
- 						mesh->Draw(renderContext);
- 				}
+					if (drawIndirect && mesh->indirectObject != IndirectDraw::INVALID)
+						continue;
+					renderQueue.Push(*mesh, camera->GetPosition());
+				}
+				if (UI::sortDraws)
+					renderQueue.Sort();
+
+				if (vikingRoom->isVisible)
+					vikingRoom->Draw(renderContext);
+				auto recordingStart = std::chrono::high_resolution_clock::now();
+				usedChunks = renderQueue.Draw(renderContext, RenderQueue::Bucket::SOLID, recordingChunks);
+				recordingMs += std::chrono::duration<f32, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - recordingStart).count();
+				if (drawIndirect)
+					indirectDraw->Draw(renderContext);
+
+				if (headMesh->isVisible)
+					headMesh->Draw(renderContext);
 
- 				headMesh->Draw(renderContext);
+				if (UI::showCrowd)
+					for (auto& crowd : crowds)
+						crowd->Draw(renderContext, Min(UI::crowdInstances, maxCrowdInstances), crowdTime);
 
  			}
  			{
@@ -551,20 +1086,26 @@ namespace Graphics
 
 			 // pass 3 transparent meshes
 			 renderContext.renderPass = forwardTransparentPass;
-			 device->BeginRenderPass(renderContext);
-			 {
-			 	for (auto& mesh : gltfMeshes)
-			 	{
-			 		if (mesh->material->material->alphaMode == PBRMaterial::ALPHA_MODE::ALPHA_TRANSPARENT)
-			 			mesh->Draw(renderContext);
-			 	}
-			 }
+			 device->BeginRenderPass(renderContext, secondaryContents);
+			 auto recordingStart = std::chrono::high_resolution_clock::now();
+			 usedChunks = Max(usedChunks, renderQueue.Draw(renderContext, RenderQueue::Bucket::BLENDED, recordingChunks));
+			 recordingMs += std::chrono::duration<f32, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - recordingStart).count();
 			 device->EndRenderPass(renderContext);
+			 UI::drawRecordingMs = glm::mix(UI::drawRecordingMs, recordingMs, 0.05f);
+			 // the queues may be too short to split into recordingChunks
+			 UI::drawRecordingThreads = usedChunks;
 
 			// UI pass
 			renderContext.shouldRenderUI = true;
 
 			device->EndRecording(renderContext);
+
+			if (UI::validateGpuCulling)
+			{
+				UI::validateGpuCulling = false;
+				if (drawIndirect)
+					UI::gpuCullingMismatches = indirectDraw->Validate();
+			}
 		}
 	}
 
@@ -203,7 +203,7 @@ namespace Graphics
 
 
 
-	void Import::LoadGLTFMesh(const String filename, tinygltf::Primitive& mesh, tinygltf::Model& model, Graphics::BasicVertex& vertices, Vector<u16>& indices, Texture& mainTexture, Texture& metallic, Texture& normal, Texture& occlusion, Texture& emissive)
+	void Import::LoadGLTFMesh(const String filename, tinygltf::Primitive& mesh, tinygltf::Model& model, Graphics::BasicVertex& vertices, Vector<u16>& indices, Texture& mainTexture, Texture& metallic, Texture& normal, Texture& occlusion, Texture& emissive, Math::AABB& bounds)
 	{
 		tinygltf::Accessor positionAccessor;
 		tinygltf::Accessor normalAccessor;
@@ -263,56 +263,64 @@ namespace Graphics
 		if (mesh.targets.size() > 0)
 		{
 			vertices.hasBlends = true;
-			vertices.blendVertices.resize(positionAccessor.count * mesh.targets.size());
-		}
+			vertices.blendTargetCount = mesh.targets.size();
 
-		int targetIndex = 0;
-		for (auto& target : mesh.targets)
-		{
-			if (target.find("POSITION") != target.end())
+			struct TargetAttribute
 			{
-				auto positionTargetAccessor = model.accessors[target["POSITION"]];
-				auto positionTargetBufferView = model.bufferViews[positionTargetAccessor.bufferView];
-
-				assert(positionTargetAccessor.type == 3);
-				u32 startOfPositionBuffer = positionTargetAccessor.byteOffset + positionTargetBufferView.byteOffset;
-				u32 stridePositionBuffer = positionTargetBufferView.byteStride == 0 ? sizeof(f32) * 3 : positionTargetBufferView.byteStride;
-				for (int i = 0; i < positionTargetAccessor.count; ++i)
-				{
-					u32 index = (startOfPositionBuffer + stridePositionBuffer * i);
-					vertices.blendVertices[targetIndex * positionTargetAccessor.count + i].position = vec4(ReadGLTFFloat3(index, model.buffers[positionTargetBufferView.buffer].data), 0);
-				}
-			}
-			if (target.find("NORMAL") != target.end())
+				Vector<unsigned char>* data = nullptr;
+				u32 start = 0;
+				u32 stride = 0;
+			};
+			auto getTargetAttribute = [&](std::map<std::string, int>& target, const char* name)
+			{
+				TargetAttribute attribute;
+				if (target.find(name) == target.end())
+					return attribute;
+				auto& accessor = model.accessors[target[name]];
+				auto& bufferView = model.bufferViews[accessor.bufferView];
+				assert(accessor.type == 3);
+				attribute.data = &model.buffers[bufferView.buffer].data;
+				attribute.start = accessor.byteOffset + bufferView.byteOffset;
+				attribute.stride = bufferView.byteStride == 0 ? sizeof(f32) * 3 : bufferView.byteStride;
+				return attribute;
+			};
+			auto readTargetAttribute = [](TargetAttribute& attribute, u32 i)
 			{
-				auto normalTargetAccessor = model.accessors[target["NORMAL"]];
-				auto normalTargetBufferView = model.bufferViews[normalTargetAccessor.bufferView];
+				return attribute.data ? ReadGLTFFloat3(attribute.start + attribute.stride * i, *attribute.data) : vec3(0);
+			};
 
-				assert(normalTargetAccessor.type == 3);
-				u32 startOfNormalBuffer = normalTargetAccessor.byteOffset + normalTargetBufferView.byteOffset;
-				u32 strideNormalBuffer = normalTargetBufferView.byteStride == 0 ? sizeof(f32) * 3 : normalTargetBufferView.byteStride;
-				for (int i = 0; i < normalTargetAccessor.count; ++i)
-				{
-					u32 index = (startOfNormalBuffer + strideNormalBuffer * i);
-					vertices.blendVertices[targetIndex * normalTargetAccessor.count + i].normal = vec4(ReadGLTFFloat3(index, model.buffers[normalTargetBufferView.buffer].data), 0);
-				}
-			}
-			if (target.find("TANGENT") != target.end())
+			Vector<TargetAttribute> positionTargets, normalTargets, tangentTargets;
+			for (auto& target : mesh.targets)
 			{
-				auto tangentTargetAccessor = model.accessors[target["TANGENT"]];
-				auto tangentTargetBufferView = model.bufferViews[tangentTargetAccessor.bufferView];
+				positionTargets.push_back(getTargetAttribute(target, "POSITION"));
+				normalTargets.push_back(getTargetAttribute(target, "NORMAL"));
+				tangentTargets.push_back(getTargetAttribute(target, "TANGENT"));
+			}
 
-				assert(tangentTargetAccessor.type == 3);
-				u32 startOfTangentBuffer = tangentTargetAccessor.byteOffset + tangentTargetBufferView.byteOffset;
-				u32 strideTangentBuffer = tangentTargetBufferView.byteStride == 0 ? sizeof(f32) * 3 : tangentTargetBufferView.byteStride;
-				for (int i = 0; i < tangentTargetAccessor.count; ++i)
+			// group by vertex so each compute thread reads only its own deltas
+			Vector<u32> offsets;
+			Vector<BasicVertex::BlendVertexData> deltas;
+			offsets.reserve(positionAccessor.count + 1);
+			for (u32 i = 0; i < positionAccessor.count; ++i)
+			{
+				offsets.push_back(deltas.size());
+				for (u32 targetIndex = 0; targetIndex < mesh.targets.size(); ++targetIndex)
 				{
-					u32 index = (startOfTangentBuffer + strideTangentBuffer * i);
-					vertices.blendVertices[targetIndex * tangentTargetAccessor.count + i].tangent = vec4(ReadGLTFFloat3(index, model.buffers[tangentTargetBufferView.buffer].data), 0);
+					BasicVertex::BlendVertexData delta{ targetIndex,
+						readTargetAttribute(positionTargets[targetIndex], i),
+						readTargetAttribute(normalTargets[targetIndex], i),
+						readTargetAttribute(tangentTargets[targetIndex], i) };
+					if (delta.position != vec3(0) || delta.normal != vec3(0) || delta.tangent != vec3(0))
+						deltas.push_back(delta);
 				}
 			}
+			offsets.push_back(deltas.size());
 
-			targetIndex++;
+			static_assert(sizeof(BasicVertex::BlendVertexData) % sizeof(u32) == 0);
+			vertices.blendData.resize(offsets.size() + deltas.size() * sizeof(BasicVertex::BlendVertexData) / sizeof(u32));
+			memcpy(vertices.blendData.data(), offsets.data(), offsets.size() * sizeof(u32));
+			memcpy(vertices.blendData.data() + offsets.size(), deltas.data(), deltas.size() * sizeof(BasicVertex::BlendVertexData));
+			DebugPrint("blend shapes: %d targets, %d of %d deltas stored\n", (int)mesh.targets.size(), (int)deltas.size(), (int)(positionAccessor.count * mesh.targets.size()));
 		}
 
 		assert(indicesAccessor.componentType == 5125 || indicesAccessor.componentType == 5123 || indicesAccessor.componentType == 5121);
@@ -330,6 +338,14 @@ namespace Graphics
 			u32 index = (startOfPositionBuffer + stridePositionBuffer * i);
 			vertices.vertices[i].pos = ReadGLTFFloat3(index, model.buffers[positionBufferView.buffer].data);
 		}
+		// required for POSITION by the spec, computed if an exporter left them out
+		if (positionAccessor.minValues.size() == 3 && positionAccessor.maxValues.size() == 3)
+		{
+			bounds.min = vec3(positionAccessor.minValues[0], positionAccessor.minValues[1], positionAccessor.minValues[2]);
+			bounds.max = vec3(positionAccessor.maxValues[0], positionAccessor.maxValues[1], positionAccessor.maxValues[2]);
+		}
+		else
+			bounds = vertices.GetBounds();
 
 		if (normalAccessor.bufferView != -1)
 		{
@@ -455,216 +471,428 @@ namespace Graphics
 		}
 	}
 
-	SharedPtr<Node> Import::LoadGLTF(const String& filename, NodeManager& nodeManager, SharedPtr<GraphicsPipeline> forwardPipeline, SharedPtr<GraphicsPipeline> forwardTransparentPipeline, Vector<SharedPtr<GLTFMesh>>& newMeshes)
+	void Import::LoadGLTFInstances(tinygltf::Node& node, tinygltf::Model& model, Vector<mat4>& instances)
 	{
-		SharedPtr<Node> gltfRoot = nodeManager.AddNode(mat4(1), NodeID{.id=0}, Node::NodeType::EMPTY_NODE);
-		u32 curNumNodes = nodeManager.cyclicIndex;
-		tinygltf::Model model;
-		Util::IO::ReadGLTF(model, filename);
-		Vector<std::pair<SharedPtr<GLTFMesh>, Vector<int>>> nodeToJoints;
-		Vector<SharedPtr<PBRMaterial>> pbrMaterials;
+		auto extension = node.extensions.find("EXT_mesh_gpu_instancing");
+		if (extension == node.extensions.end() || !extension->second.Has("attributes"))
+			return;
+		auto& attributes = extension->second.Get("attributes");
 
-		for (auto& scene : model.scenes)
+		// float vec3 or vec4 attribute, count is the same for all of them
+		auto readAttribute = [&](const char* name, u32 numComponents, Vector<vec4>& values)
 		{
-			for (auto& sampler : model.samplers)
-			{
-				int magfilter = sampler.magFilter; // 9728 NEAREST 9729 LINEAR
-				int minfilter = sampler.minFilter; // 9728 NEAREST 9729 LINEAR 9984 NEAREST_MIPMAP_NEAREST 9985 LINEAR_MIPMAP_NEAREST 9986 NEAREST_MIPMAP_LINEAR 9987 LINEAR_MIPMAP_LINEAR
-				int wrapS = sampler.wrapS; // 33071 CLAMP_TO_EDGE 33648 MIRRORED_REPEAT 10497 REPEAT
-				int wrapT = sampler.wrapT; // 33071 CLAMP_TO_EDGE 33648 MIRRORED_REPEAT 10497 REPEAT
-
-				Sampler::FilterType tmag;
-				Sampler::FilterType tmin;
-				Sampler::AddressModeType taddrU;
-				Sampler::AddressModeType taddrV;
-				if (magfilter == 9728)
-					tmag = Sampler::FilterType::POINT;
-				else if (magfilter == 9729)
-					tmag = Sampler::FilterType::LINEAR;
-				if (minfilter == 9728)
-					tmin = Sampler::FilterType::POINT;
-				else
-					tmin = Sampler::FilterType::LINEAR;
-
-
-				if (wrapS == 33071)
-					taddrU = Sampler::AddressModeType::CLAMP_TO_EDGE;
-				else if (wrapS == 33648)
-					taddrU = Sampler::AddressModeType::MIRRORED_REPEAT;
-				else if (wrapS == 10497)
-					taddrU = Sampler::AddressModeType::REPEAT;
-				if (wrapT == 33071)
-					taddrV = Sampler::AddressModeType::CLAMP_TO_EDGE;
-				else if (wrapT == 33648)
-					taddrV = Sampler::AddressModeType::MIRRORED_REPEAT;
-				else if (wrapT == 10497)
-					taddrV = Sampler::AddressModeType::REPEAT;
-
-				auto newSampler = MakeShared<Sampler>(tmag, tmin, taddrU, taddrV);
-				textureSamplers.push_back(newSampler);
-			}
-
-			if (textureSamplers.empty())
+			if (!attributes.Has(name))
+				return;
+			auto& accessor = model.accessors[attributes.Get(name).GetNumberAsInt()];
+			if (accessor.componentType != 5126)
+				throw std::runtime_error("only float EXT_mesh_gpu_instancing attributes are supported");
+			auto& bufferView = model.bufferViews[accessor.bufferView];
+			u32 startOfBuffer = accessor.byteOffset + bufferView.byteOffset;
+			u32 strideOfBuffer = bufferView.byteStride == 0 ? sizeof(f32) * numComponents : bufferView.byteStride;
+			const f32* data = (const f32*)model.buffers[bufferView.buffer].data.data();
+			values.resize(accessor.count);
+			for (int j = 0; j < accessor.count; ++j)
 			{
-				// default sampler
-				textureSamplers.push_back(MakeShared<Sampler>());
+				u32 index = (startOfBuffer + strideOfBuffer * j) / sizeof(f32);
+				for (u32 c = 0; c < numComponents; ++c)
+					values[j][c] = data[index + c];
 			}
+		};
+		Vector<vec4> translations;
+		Vector<vec4> rotations;
+		Vector<vec4> scales;
+		readAttribute("TRANSLATION", 3, translations);
+		readAttribute("ROTATION", 4, rotations);
+		readAttribute("SCALE", 3, scales);
+
+		u32 count = static_cast<u32>(Max(translations.size(), Max(rotations.size(), scales.size())));
+		instances.resize(count);
+		for (u32 i = 0; i < count; ++i)
+		{
+			mat4 newtrans = i < translations.size() ? Math::Translate(mat4(1), vec3(translations[i])) : mat4(1);
+			mat4 newrot = i < rotations.size() ? Math::RotateQuat(quat(rotations[i].w, rotations[i].x, rotations[i].y, rotations[i].z)) : mat4(1);
+			mat4 newscale = i < scales.size() ? Math::Scale(mat4(1), vec3(scales[i])) : mat4(1);
+			instances[i] = newtrans * newrot * newscale;
+		}
+	}
 
-			Vector<Vector<SharedPtr<Animation>>> animationToNodes;
-			animationToNodes.resize(model.nodes.size());
+	SharedPtr<GLTFAsset> Import::LoadGLTFAsset(const String& filename, NodeManager& nodeManager, SharedPtr<GraphicsPipeline> forwardPipeline, SharedPtr<GraphicsPipeline> forwardTransparentPipeline)
+	{
+		auto asset = MakeShared<GLTFAsset>(filename, nodeManager);
+		asset->model = MakeShared<tinygltf::Model>();
+		tinygltf::Model& model = *asset->model;
+		Util::IO::ReadGLTF(model, filename);
+		Vector<SharedPtr<PBRMaterial>> pbrMaterials;
 
-			std::deque<std::pair<u32, u32>> nodesStack; // node id (gltf ID) and parent id (engine ID). kinda confusing but need to track both
-			for (auto& node : scene.nodes)
+		// joints go into a Skeleton instead of the node pool
+		for (auto& skin : model.skins)
+		{
+			for (int jointID : skin.joints)
+				asset->jointSet.insert(jointID);
+		}
+		// non joint nodes between two joints become joints too, so the lower joint joins the skeleton of the upper one
+		// instead of starting its own under the intermediate node
+		{
+			Vector<i32> parents(model.nodes.size(), -1);
+			for (i32 i = 0; i < static_cast<i32>(model.nodes.size()); ++i)
+				for (int child : model.nodes[i].children)
+					parents[child] = i;
+			Vector<i32> path;
+			for (auto& skin : model.skins)
 			{
-				nodesStack.push_back(std::make_pair<u32, u32>(node, gltfRoot->nodeID.id));
+				for (int jointID : skin.joints)
+				{
+					path.clear();
+					i32 ancestor = parents[jointID];
+					while (ancestor >= 0 && asset->jointSet.count(ancestor) == 0)
+					{
+						path.push_back(ancestor);
+						ancestor = parents[ancestor];
+					}
+					// the path ends at the scene root when this is a root joint
+					if (ancestor >= 0)
+						asset->jointSet.insert(path.begin(), path.end());
+				}
 			}
+		}
+
+		for (auto& sampler : model.samplers)
+		{
+			int magfilter = sampler.magFilter; // 9728 NEAREST 9729 LINEAR
+			int minfilter = sampler.minFilter; // 9728 NEAREST 9729 LINEAR 9984 NEAREST_MIPMAP_NEAREST 9985 LINEAR_MIPMAP_NEAREST 9986 NEAREST_MIPMAP_LINEAR 9987 LINEAR_MIPMAP_LINEAR
+			int wrapS = sampler.wrapS; // 33071 CLAMP_TO_EDGE 33648 MIRRORED_REPEAT 10497 REPEAT
+			int wrapT = sampler.wrapT; // 33071 CLAMP_TO_EDGE 33648 MIRRORED_REPEAT 10497 REPEAT
+
+			Sampler::FilterType tmag;
+			Sampler::FilterType tmin;
+			Sampler::AddressModeType taddrU;
+			Sampler::AddressModeType taddrV;
+			if (magfilter == 9728)
+				tmag = Sampler::FilterType::POINT;
+			else if (magfilter == 9729)
+				tmag = Sampler::FilterType::LINEAR;
+			if (minfilter == 9728)
+				tmin = Sampler::FilterType::POINT;
+			else
+				tmin = Sampler::FilterType::LINEAR;
+
+
+			if (wrapS == 33071)
+				taddrU = Sampler::AddressModeType::CLAMP_TO_EDGE;
+			else if (wrapS == 33648)
+				taddrU = Sampler::AddressModeType::MIRRORED_REPEAT;
+			else if (wrapS == 10497)
+				taddrU = Sampler::AddressModeType::REPEAT;
+			if (wrapT == 33071)
+				taddrV = Sampler::AddressModeType::CLAMP_TO_EDGE;
+			else if (wrapT == 33648)
+				taddrV = Sampler::AddressModeType::MIRRORED_REPEAT;
+			else if (wrapT == 10497)
+				taddrV = Sampler::AddressModeType::REPEAT;
+
+			auto newSampler = MakeShared<Sampler>(tmag, tmin, taddrU, taddrV);
+			textureSamplers.push_back(newSampler);
+		}
+
+		if (textureSamplers.empty())
+		{
+			// default sampler
+			textureSamplers.push_back(MakeShared<Sampler>());
+		}
+
+		for (auto& material : model.materials)
+		{
+			f32 metallic = material.pbrMetallicRoughness.metallicFactor;
+			f32 roughness = material.pbrMetallicRoughness.roughnessFactor;
+			auto colorVec = material.pbrMetallicRoughness.baseColorFactor;
+			auto emissiveVec = material.emissiveFactor;
+
+			vec4 baseColor = vec4(colorVec[0], colorVec[1], colorVec[2], colorVec[3]);
+			auto pbr = MakeShared<PBRMaterial>();
+			pbr->material->baseColor = baseColor;
+			pbr->material->metallic = metallic;
+			pbr->material->roughness = roughness;
+			pbr->material->emissiveColor = vec4(emissiveVec[0], emissiveVec[1], emissiveVec[2], 0);
+			pbr->material->hasAlbedoTex = material.pbrMetallicRoughness.baseColorTexture.index >= 0;
+			pbr->material->hasNormalTex = material.normalTexture.index >= 0;
+			pbr->material->hasOcclusionTex = material.occlusionTexture.index >= 0;
+			pbr->material->hasMetallicRoughnessTex = material.pbrMetallicRoughness.metallicRoughnessTexture.index >= 0;
+			pbr->material->hasEmissiveTex = material.emissiveTexture.index >= 0;
+			pbr->material->isDoubleSided = material.doubleSided ? 1 : 0;
+			pbr->material->alphaMode = material.alphaMode == "OPAQUE" ? PBRMaterial::ALPHA_MODE::ALPHA_OPAQUE : material.alphaMode == "MASK" ? PBRMaterial::ALPHA_MODE::ALPHA_MASK : PBRMaterial::ALPHA_MODE::ALPHA_TRANSPARENT;
+			pbr->material->alphaCutoff = material.alphaCutoff;
+			pbr->material->occlusionStrength = material.occlusionTexture.strength;
+
+			pbrMaterials.push_back(pbr);
+		}
 
-			for (auto& material : model.materials)
+		asset->nodeAnimations.resize(model.nodes.size());
+		// create animations and add them to nodes
+		for (auto& animation : model.animations)
+		{
+			for (u32 i = 0; i < animation.channels.size(); ++i)
 			{
-				f32 metallic = material.pbrMetallicRoughness.metallicFactor;
-				f32 roughness = material.pbrMetallicRoughness.roughnessFactor;
-				auto colorVec = material.pbrMetallicRoughness.baseColorFactor;
-				auto emissiveVec = material.emissiveFactor;
-	
-				vec4 baseColor = vec4(colorVec[0], colorVec[1], colorVec[2], colorVec[3]);
-				auto pbr = MakeShared<PBRMaterial>();
-				pbr->material->baseColor = baseColor;
-				pbr->material->metallic = metallic;
-				pbr->material->roughness = roughness;
-				pbr->material->emissiveColor = vec4(emissiveVec[0], emissiveVec[1], emissiveVec[2], 0);
-				pbr->material->hasAlbedoTex = material.pbrMetallicRoughness.baseColorTexture.index >= 0;
-				pbr->material->hasNormalTex = material.normalTexture.index >= 0;
-				pbr->material->hasOcclusionTex = material.occlusionTexture.index >= 0;
-				pbr->material->hasMetallicRoughnessTex = material.pbrMetallicRoughness.metallicRoughnessTexture.index >= 0;
-				pbr->material->hasEmissiveTex = material.emissiveTexture.index >= 0;
-				pbr->material->isDoubleSided = material.doubleSided ? 1 : 0;
-				pbr->material->alphaMode = material.alphaMode == "OPAQUE" ? PBRMaterial::ALPHA_MODE::ALPHA_OPAQUE : material.alphaMode == "MASK" ? PBRMaterial::ALPHA_MODE::ALPHA_MASK : PBRMaterial::ALPHA_MODE::ALPHA_TRANSPARENT;
-				pbr->material->alphaCutoff = material.alphaCutoff;
-				pbr->material->occlusionStrength = material.occlusionTexture.strength;
-
-				pbrMaterials.push_back(pbr);
-			}
-
-			// create animations and add them to nodes
-			for (auto& animation : model.animations)
-			{
-				for (u32 i = 0; i < animation.channels.size(); ++i)
+				auto& channel = animation.channels[i];
+				auto& sampler = animation.samplers[i];
+				Animation::AnimationType animationType = channel.target_path == "rotation" ? Animation::AnimationType::ROTATION : channel.target_path == "translation" ? Animation::AnimationType::TRANSLATION : Animation::AnimationType::SCALE;
+				if (channel.target_path == "weights")
+					animationType = Animation::AnimationType::WEIGHTS;
+				Animation::SamplerType samplerType = sampler.interpolation == "LINEAR" ? Animation::SamplerType::LINEAR : sampler.interpolation == "STEP" ? Animation::SamplerType::STEP : Animation::SamplerType::CUBIC;
+				auto& inputAccessor = model.accessors[sampler.input];
+				assert(inputAccessor.type == 65);
+				assert(inputAccessor.componentType == 5126);
+				auto& inputBufferView = model.bufferViews[inputAccessor.bufferView];
+				Vector<f32> inputVector;
+				u32 startOfInputBuffer = inputAccessor.byteOffset + inputBufferView.byteOffset;
+				u32 strideOfInputBuffer = inputBufferView.byteStride == 0 ? sizeof(f32) : inputBufferView.byteStride;
+				f32 minInput = inputAccessor.minValues.size() > 0 ? inputAccessor.minValues[0] : 1000.f;
+				f32 maxInput = inputAccessor.maxValues.size() > 0 ? inputAccessor.maxValues[0] : 0.f;
+				
+				for (int j = 0; j < inputAccessor.count; ++j)
 				{
-					auto& channel = animation.channels[i];
-					auto& sampler = animation.samplers[i];
-					Animation::AnimationType animationType = channel.target_path == "rotation" ? Animation::AnimationType::ROTATION : channel.target_path == "translation" ? Animation::AnimationType::TRANSLATION : Animation::AnimationType::SCALE;
-					if (channel.target_path == "weights")
-						animationType = Animation::AnimationType::WEIGHTS;
-					Animation::SamplerType samplerType = sampler.interpolation == "LINEAR" ? Animation::SamplerType::LINEAR : sampler.interpolation == "STEP" ? Animation::SamplerType::STEP : Animation::SamplerType::CUBIC;
-					auto& inputAccessor = model.accessors[sampler.input];
-					assert(inputAccessor.type == 65);
-					assert(inputAccessor.componentType == 5126);
-					auto& inputBufferView = model.bufferViews[inputAccessor.bufferView];
-					Vector<f32> inputVector;
-					u32 startOfInputBuffer = inputAccessor.byteOffset + inputBufferView.byteOffset;
-					u32 strideOfInputBuffer = inputBufferView.byteStride == 0 ? sizeof(f32) : inputBufferView.byteStride;
-					f32 minInput = inputAccessor.minValues.size() > 0 ? inputAccessor.minValues[0] : 1000.f;
-					f32 maxInput = inputAccessor.maxValues.size() > 0 ? inputAccessor.maxValues[0] : 0.f;
-					
-					for (int j = 0; j < inputAccessor.count; ++j)
-					{
-						u32 index = (startOfInputBuffer + strideOfInputBuffer * j);
-						f32 val = static_cast<f32>(((f32*)model.buffers[inputBufferView.buffer].data.data())[index / sizeof(f32)]);
-						if (val < minInput)
-							minInput = val;
-						if (val > maxInput)
-							maxInput = val;
-						inputVector.push_back(val);
-					}
+					u32 index = (startOfInputBuffer + strideOfInputBuffer * j);
+					f32 val = static_cast<f32>(((f32*)model.buffers[inputBufferView.buffer].data.data())[index / sizeof(f32)]);
+					if (val < minInput)
+						minInput = val;
+					if (val > maxInput)
+						maxInput = val;
+					inputVector.push_back(val);
+				}
 
-					Vector<f32> scalarOutput;
-					Vector<vec3> vec3Output;
-					Vector<vec4> vec4Output;
+				Vector<f32> scalarOutput;
+				Vector<vec3> vec3Output;
+				Vector<vec4> vec4Output;
 
-					auto& outputAccessor = model.accessors[sampler.output];
-					auto& outputBufferView = model.bufferViews[outputAccessor.bufferView];
-					assert(outputAccessor.componentType == 5126);
-					if (outputAccessor.type == 65)
+				auto& outputAccessor = model.accessors[sampler.output];
+				auto& outputBufferView = model.bufferViews[outputAccessor.bufferView];
+				assert(outputAccessor.componentType == 5126);
+				if (outputAccessor.type == 65)
+				{
+					// scalar
+					u32 startOfOutputBuffer = outputAccessor.byteOffset + outputBufferView.byteOffset;
+					u32 strideOfOutputBuffer = outputBufferView.byteStride == 0 ? sizeof(f32) : outputBufferView.byteStride;
+					for (int j = 0; j < outputAccessor.count; ++j)
 					{
-						// scalar
-						u32 startOfOutputBuffer = outputAccessor.byteOffset + outputBufferView.byteOffset;
-						u32 strideOfOutputBuffer = outputBufferView.byteStride == 0 ? sizeof(f32) : outputBufferView.byteStride;
-						for (int j = 0; j < outputAccessor.count; ++j)
-						{
-							u32 index = (startOfOutputBuffer + strideOfOutputBuffer * j);
-							f32 val;
-							val = static_cast<f32>(((f32*)model.buffers[outputBufferView.buffer].data.data())[index / sizeof(f32)]);
-							scalarOutput.push_back(val);
-						}
+						u32 index = (startOfOutputBuffer + strideOfOutputBuffer * j);
+						f32 val;
+						val = static_cast<f32>(((f32*)model.buffers[outputBufferView.buffer].data.data())[index / sizeof(f32)]);
+						scalarOutput.push_back(val);
 					}
-					if (outputAccessor.type == 3)
+				}
+				if (outputAccessor.type == 3)
+				{
+					// vec3 output
+					u32 startOfOutputBuffer = outputAccessor.byteOffset + outputBufferView.byteOffset;
+					u32 strideOfOutputBuffer = outputBufferView.byteStride == 0 ? sizeof(f32) * 3 : outputBufferView.byteStride;
+					for (int j = 0; j < outputAccessor.count; ++j)
 					{
-						// vec3 output
-						u32 startOfOutputBuffer = outputAccessor.byteOffset + outputBufferView.byteOffset;
-						u32 strideOfOutputBuffer = outputBufferView.byteStride == 0 ? sizeof(f32) * 3 : outputBufferView.byteStride;
-						for (int j = 0; j < outputAccessor.count; ++j)
-						{
-							u32 index = (startOfOutputBuffer + strideOfOutputBuffer * j);
-							vec3 val;
-							val.x = static_cast<f32>(((f32*)model.buffers[outputBufferView.buffer].data.data())[index / sizeof(f32)]);
-							val.y = static_cast<f32>(((f32*)model.buffers[outputBufferView.buffer].data.data())[(index + sizeof(f32)) / sizeof(f32)]);
-							val.z = static_cast<f32>(((f32*)model.buffers[outputBufferView.buffer].data.data())[(index + sizeof(f32) * 2) / sizeof(f32)]);
-							vec3Output.push_back(val);
-						}
+						u32 index = (startOfOutputBuffer + strideOfOutputBuffer * j);
+						vec3 val;
+						val.x = static_cast<f32>(((f32*)model.buffers[outputBufferView.buffer].data.data())[index / sizeof(f32)]);
+						val.y = static_cast<f32>(((f32*)model.buffers[outputBufferView.buffer].data.data())[(index + sizeof(f32)) / sizeof(f32)]);
+						val.z = static_cast<f32>(((f32*)model.buffers[outputBufferView.buffer].data.data())[(index + sizeof(f32) * 2) / sizeof(f32)]);
+						vec3Output.push_back(val);
 					}
-					if (outputAccessor.type == 4)
+				}
+				if (outputAccessor.type == 4)
+				{
+					// vec4 output
+					u32 startOfOutputBuffer = outputAccessor.byteOffset + outputBufferView.byteOffset;
+					u32 strideOfOutputBuffer = outputBufferView.byteStride == 0 ? sizeof(f32) * 4 : outputBufferView.byteStride;
+					for (int j = 0; j < outputAccessor.count; ++j)
 					{
-						// vec4 output
-						u32 startOfOutputBuffer = outputAccessor.byteOffset + outputBufferView.byteOffset;
-						u32 strideOfOutputBuffer = outputBufferView.byteStride == 0 ? sizeof(f32) * 4 : outputBufferView.byteStride;
-						for (int j = 0; j < outputAccessor.count; ++j)
-						{
-							u32 index = (startOfOutputBuffer + strideOfOutputBuffer * j);
-							vec4 val;
-
-							val.x = static_cast<f32>(((f32*)model.buffers[outputBufferView.buffer].data.data())[index / sizeof(f32)]);
-							val.y = static_cast<f32>(((f32*)model.buffers[outputBufferView.buffer].data.data())[(index + sizeof(f32)) / sizeof(f32)]);
-							val.z = static_cast<f32>(((f32*)model.buffers[outputBufferView.buffer].data.data())[(index + sizeof(f32) * 2) / sizeof(f32)]);
-							val.w = static_cast<f32>(((f32*)model.buffers[outputBufferView.buffer].data.data())[(index + sizeof(f32) * 3) / sizeof(f32)]);
-							vec4Output.push_back(val);
-						}
+						u32 index = (startOfOutputBuffer + strideOfOutputBuffer * j);
+						vec4 val;
+
+						val.x = static_cast<f32>(((f32*)model.buffers[outputBufferView.buffer].data.data())[index / sizeof(f32)]);
+						val.y = static_cast<f32>(((f32*)model.buffers[outputBufferView.buffer].data.data())[(index + sizeof(f32)) / sizeof(f32)]);
+						val.z = static_cast<f32>(((f32*)model.buffers[outputBufferView.buffer].data.data())[(index + sizeof(f32) * 2) / sizeof(f32)]);
+						val.w = static_cast<f32>(((f32*)model.buffers[outputBufferView.buffer].data.data())[(index + sizeof(f32) * 3) / sizeof(f32)]);
+						vec4Output.push_back(val);
 					}
-					auto newAnimation = MakeShared<Animation>(animationType, samplerType, minInput, maxInput, inputVector, vec3Output, vec4Output, scalarOutput);
-					animationToNodes[channel.target_node].push_back(newAnimation);
 				}
+				auto newAnimation = MakeShared<Animation>(animationType, samplerType, minInput, maxInput, inputVector, vec3Output, vec4Output, scalarOutput);
+				asset->nodeAnimations[channel.target_node].push_back(newAnimation);
 			}
+		}
 
-			while (nodesStack.size() > 0)
+		for (auto& node : model.nodes)
+		{
+			auto matrix = node.matrix;
+			mat4 modelMatrix = mat4(1);
+			if (matrix.size() > 0)
 			{
-				auto nodeFront = nodesStack.front();
-				auto& node = model.nodes[nodeFront.first];
-				auto& parent = nodeFront.second;
-				nodesStack.pop_front();
-				auto matrix = node.matrix;
-				mat4 modelMatrix = mat4(1);
-				if (matrix.size() > 0)
-				{
-					modelMatrix = mat4(matrix[0], matrix[1], matrix[2], matrix[3], matrix[4], matrix[5], matrix[6], matrix[7], matrix[8], matrix[9], matrix[10], matrix[11], matrix[12], matrix[13], matrix[14], matrix[15]);
-				}
+				modelMatrix = mat4(matrix[0], matrix[1], matrix[2], matrix[3], matrix[4], matrix[5], matrix[6], matrix[7], matrix[8], matrix[9], matrix[10], matrix[11], matrix[12], matrix[13], matrix[14], matrix[15]);
+			}
 
-				mat4 newrot(1);
-				mat4 newscale(1);
-				mat4 newtrans(1);
+			mat4 newrot(1);
+			mat4 newscale(1);
+			mat4 newtrans(1);
 
-				if (node.translation.size() == 3)
-				{
-					newtrans = Math::Translate(mat4(1), vec3(node.translation[0], node.translation[1], node.translation[2]));
-				}
-				if (node.rotation.size() == 4)
+			if (node.translation.size() == 3)
+			{
+				newtrans = Math::Translate(mat4(1), vec3(node.translation[0], node.translation[1], node.translation[2]));
+			}
+			if (node.rotation.size() == 4)
+			{
+				quat quatRot(node.rotation[3], node.rotation[0], node.rotation[1], node.rotation[2]);
+				newrot = Math::RotateQuat(quatRot);
+			}
+			if (node.scale.size() == 3)
+			{
+				newscale = Math::Scale(mat4(1), vec3(node.scale[0], node.scale[1], node.scale[2]));
+			}
+			modelMatrix = newtrans * newrot * newscale * modelMatrix;
+			asset->localMatrices.push_back(modelMatrix);
+
+			auto& instances = asset->nodeInstances.emplace_back();
+			LoadGLTFInstances(node, model, instances);
+			SharedPtr<StructuredBuffer> instanceData;
+			if (instances.size() > 0)
+			{
+				ResourceBinding instanceBinding;
+				instanceBinding.binding = 1;
+				instanceBinding.shaderStageType = ResourceBinding::ShaderStageType::VERTEX;
+				Vector<Buffer::BufferUsageType> usage{ Buffer::BufferUsageType::BUFFER_VERTEX, Buffer::BufferUsageType::BUFFER_TRANSFER_DST };
+				instanceData = MakeShared<StructuredBuffer>((u8*)instances.data(), static_cast<u32>(instances.size() * sizeof(mat4)), instanceBinding, usage, true);
+			}
+			asset->nodeInstanceData.push_back(instanceData);
+		}
+
+		for (auto& skin : model.skins)
+		{
+			if (skin.inverseBindMatrices < 0)
+			{
+				// optional, identity when missing
+				asset->inverseBindMatrices.push_back(Vector<mat4>(skin.joints.size(), mat4(1)));
+				continue;
+			}
+			auto inverseBindMatAccessor = model.accessors[skin.inverseBindMatrices];
+			auto inverseBindBufferView = model.bufferViews[inverseBindMatAccessor.bufferView];
+			Vector<mat4> invBindMatrices;
+			u32 startOfInvBindBuffer = inverseBindMatAccessor.byteOffset + inverseBindBufferView.byteOffset;
+			u32 strideOfinvBindBuffer = inverseBindBufferView.byteStride == 0 ? sizeof(f32) * 16 : inverseBindBufferView.byteStride;
+			for (int j = 0; j < inverseBindMatAccessor.count; ++j)
+			{
+				u32 index = (startOfInvBindBuffer + strideOfinvBindBuffer * j);
+				mat4 matrix(
+					static_cast<f32>(((f32*)model.buffers[inverseBindBufferView.buffer].data.data())[index / sizeof(f32)]),
+					static_cast<f32>(((f32*)model.buffers[inverseBindBufferView.buffer].data.data())[(index + sizeof(f32)) / sizeof(f32)]),
+					static_cast<f32>(((f32*)model.buffers[inverseBindBufferView.buffer].data.data())[(index + sizeof(f32) * 2) / sizeof(f32)]),
+					static_cast<f32>(((f32*)model.buffers[inverseBindBufferView.buffer].data.data())[(index + sizeof(f32) * 3) / sizeof(f32)]),
+					static_cast<f32>(((f32*)model.buffers[inverseBindBufferView.buffer].data.data())[(index + sizeof(f32) * 4) / sizeof(f32)]),
+					static_cast<f32>(((f32*)model.buffers[inverseBindBufferView.buffer].data.data())[(index + sizeof(f32) * 5) / sizeof(f32)]),
+					static_cast<f32>(((f32*)model.buffers[inverseBindBufferView.buffer].data.data())[(index + sizeof(f32) * 6) / sizeof(f32)]),
+					static_cast<f32>(((f32*)model.buffers[inverseBindBufferView.buffer].data.data())[(index + sizeof(f32) * 7) / sizeof(f32)]),
+					static_cast<f32>(((f32*)model.buffers[inverseBindBufferView.buffer].data.data())[(index + sizeof(f32) * 8) / sizeof(f32)]),
+					static_cast<f32>(((f32*)model.buffers[inverseBindBufferView.buffer].data.data())[(index + sizeof(f32) * 9) / sizeof(f32)]),
+					static_cast<f32>(((f32*)model.buffers[inverseBindBufferView.buffer].data.data())[(index + sizeof(f32) * 10) / sizeof(f32)]),
+					static_cast<f32>(((f32*)model.buffers[inverseBindBufferView.buffer].data.data())[(index + sizeof(f32) * 11) / sizeof(f32)]),
+					static_cast<f32>(((f32*)model.buffers[inverseBindBufferView.buffer].data.data())[(index + sizeof(f32) * 12) / sizeof(f32)]),
+					static_cast<f32>(((f32*)model.buffers[inverseBindBufferView.buffer].data.data())[(index + sizeof(f32) * 13) / sizeof(f32)]),
+					static_cast<f32>(((f32*)model.buffers[inverseBindBufferView.buffer].data.data())[(index + sizeof(f32) * 14) / sizeof(f32)]),
+					static_cast<f32>(((f32*)model.buffers[inverseBindBufferView.buffer].data.data())[(index + sizeof(f32) * 15) / sizeof(f32)])
+				);
+				invBindMatrices.push_back(matrix);
+			}
+			asset->inverseBindMatrices.push_back(invBindMatrices);
+		}
+
+		// vertex, index and texture memory of every primitive, created once for all instances
+		for (auto& gltfMesh : model.meshes)
+		{
+			auto& primitives = asset->meshPrimitives.emplace_back();
+			for (auto& primitive : gltfMesh.primitives)
+			{
+				auto pipeline = forwardPipeline;
+				if (primitive.material >= 0 && pbrMaterials[primitive.material]->material->alphaMode == Graphics::PBRMaterial::ALPHA_MODE::ALPHA_TRANSPARENT)
 				{
-					quat quatRot(node.rotation[3], node.rotation[0], node.rotation[1], node.rotation[2]);
-					newrot = Math::RotateQuat(quatRot);
+					pipeline = forwardTransparentPipeline;
 				}
-				if (node.scale.size() == 3)
+				auto geometry = MakeShared<GLTFMesh>(pipeline, filename, primitive, model, primitive.material >= 0 ? pbrMaterials[primitive.material] : nullptr);
+				// set by the first node that uses it
+				geometry->node = nullptr;
+				primitives.push_back(geometry);
+			}
+		}
+
+		// everything an instance needs is decoded
+		model.buffers.clear();
+		model.images.clear();
+		return asset;
+	}
+
+	SharedPtr<Node> GLTFAsset::Instantiate(NodeID parent, Vector<SharedPtr<GLTFMesh>>& newMeshes)
+	{
+		tinygltf::Model& model = *this->model;
+		SharedPtr<Node> gltfRoot = nodeManager.AddNode(mat4(1), parent, Node::NodeType::EMPTY_NODE);
+		Vector<std::pair<SharedPtr<Skin>, i32>> meshToSkin;
+
+		Map<i32, std::pair<SharedPtr<Skeleton>, u32>> gltfToJoint; // gltf ID to skeleton and joint index
+		Map<u32, SharedPtr<Skeleton>> rootToSkeleton; // engine ID of the node the root joints hang from
+		Map<i32, SharedPtr<Node>> attachmentNodes; // gltf ID of joints exposed as scene nodes
+
+		auto getAttachment = [&](i32 gltfID) -> SharedPtr<Node>
+		{
+			auto found = attachmentNodes.find(gltfID);
+			if (found != attachmentNodes.end())
+				return found->second;
+			auto& [skeleton, joint] = gltfToJoint[gltfID];
+			auto attachment = nodeManager.AddNode(mat4(1), skeleton->rootNode->nodeID, Node::NodeType::BONE_NODE, model.nodes[gltfID].name);
+			attachment->gltfID = gltfID;
+			skeleton->AddAttachment(joint, attachment);
+			attachmentNodes[gltfID] = attachment;
+			return attachment;
+		};
+
+		// the first node using a mesh takes the loaded primitives, later ones share their vertex data
+		auto addMeshes = [&](i32 gltfID, SharedPtr<Node> node, SharedPtr<Skin> skin)
+		{
+			for (auto& primitive : meshPrimitives[model.nodes[gltfID].mesh])
+			{
+				auto geometry = primitive->node == nullptr ? primitive : MakeShared<GLTFMesh>(*primitive, node);
+				geometry->node = node;
+				if (skin)
+					geometry->SetSkin(skin);
+				if (nodeInstanceData[gltfID])
 				{
-					newscale = Math::Scale(mat4(1), vec3(node.scale[0], node.scale[1], node.scale[2]));
+					// animated meshes have their own pose buffers per copy, not supported
+					if (geometry->GetVertexData()->hasSkeleton || geometry->GetVertexData()->hasBlends)
+						DebugPrint("EXT_mesh_gpu_instancing ignored on animated mesh %s\n", node->name.c_str());
+					else
+					{
+						geometry->instanceMatrices = nodeInstances[gltfID];
+						geometry->instanceData = nodeInstanceData[gltfID];
+						geometry->instanceBounds = Math::AABB{};
+						for (auto& instanceMatrix : geometry->instanceMatrices)
+							geometry->instanceBounds.Extend(Math::Transform(geometry->bounds, instanceMatrix));
+					}
 				}
-				modelMatrix = newtrans * newrot * newscale * modelMatrix;
+				newMeshes.push_back(geometry);
+			}
+		};
+
+		for (auto& scene : model.scenes)
+		{
+			struct NodeEntry
+			{
+				u32 gltfID;
+				u32 parentID; // engine ID
+				i32 parentGltfID = -1;
+			};
+			std::deque<NodeEntry> nodesStack;
+			for (auto& node : scene.nodes)
+			{
+				nodesStack.push_back(NodeEntry{ static_cast<u32>(node), static_cast<u32>(gltfRoot->nodeID.id) });
+			}
+
+			while (nodesStack.size() > 0)
+			{
+				auto nodeFront = nodesStack.front();
+				auto& node = model.nodes[nodeFront.gltfID];
+				auto& parent = nodeFront.parentID;
+				nodesStack.pop_front();
+				mat4 modelMatrix = localMatrices[nodeFront.gltfID];
 
 				NodeID parentID;
 				parentID.id = parent;
@@ -676,73 +904,57 @@ namespace Graphics
 					nodeType = Node::NodeType::SKINNED_MESH_NODE;
 				else if (node.mesh >= 0)
 					nodeType = Node::NodeType::MESH_NODE;
-			
-				auto newNode = nodeManager.AddNode(modelMatrix, parentID, nodeType, node.name);
-			
-				if (nodeType == Node::MESH_NODE )
+
+				bool isJoint = jointSet.count(nodeFront.gltfID) > 0;
+				bool parentIsJoint = gltfToJoint.count(nodeFront.parentGltfID) > 0;
+				SharedPtr<Node> newNode;
+				if (isJoint)
 				{
-					auto& gltfMesh = model.meshes[node.mesh];
-					for (auto primitive : gltfMesh.primitives)
+					SharedPtr<Skeleton> skeleton;
+					i32 parentIndex = -1;
+					if (parentIsJoint)
 					{
-						auto pipeline = forwardPipeline;
-						if (primitive.material >= 0 && pbrMaterials[primitive.material]->material->alphaMode == Graphics::PBRMaterial::ALPHA_MODE::ALPHA_TRANSPARENT)
-						{
-							pipeline = forwardTransparentPipeline;
-						}
-						auto geometry = MakeShared<GLTFMesh>(pipeline, filename, primitive, model, primitive.material >= 0 ? pbrMaterials[primitive.material] : nullptr);
-						geometry->node = newNode;
-						
-						newMeshes.push_back(geometry);
-
+						skeleton = gltfToJoint[nodeFront.parentGltfID].first;
+						parentIndex = gltfToJoint[nodeFront.parentGltfID].second;
 					}
-				}
-				else if (nodeType == Node::SKINNED_MESH_NODE)
-				{
-					// get inverse bind matrices
-					auto inverseBindMatAccessor = model.accessors[model.skins[node.skin].inverseBindMatrices];
-					auto inverseBindBufferView = model.bufferViews[inverseBindMatAccessor.bufferView];
-					Vector<mat4> invBindMatrices;
-					u32 startOfInvBindBuffer = inverseBindMatAccessor.byteOffset + inverseBindBufferView.byteOffset;
-					u32 strideOfinvBindBuffer = inverseBindBufferView.byteStride == 0 ? sizeof(f32) * 16 : inverseBindBufferView.byteStride;
-					for (int j = 0; j < inverseBindMatAccessor.count; ++j)
+					else
 					{
-						u32 index = (startOfInvBindBuffer + strideOfinvBindBuffer * j);
-						mat4 matrix(
-							static_cast<f32>(((f32*)model.buffers[inverseBindBufferView.buffer].data.data())[index / sizeof(f32)]),
-							static_cast<f32>(((f32*)model.buffers[inverseBindBufferView.buffer].data.data())[(index + sizeof(f32)) / sizeof(f32)]),
-							static_cast<f32>(((f32*)model.buffers[inverseBindBufferView.buffer].data.data())[(index + sizeof(f32) * 2) / sizeof(f32)]),
-							static_cast<f32>(((f32*)model.buffers[inverseBindBufferView.buffer].data.data())[(index + sizeof(f32) * 3) / sizeof(f32)]),
-							static_cast<f32>(((f32*)model.buffers[inverseBindBufferView.buffer].data.data())[(index + sizeof(f32) * 4) / sizeof(f32)]),
-							static_cast<f32>(((f32*)model.buffers[inverseBindBufferView.buffer].data.data())[(index + sizeof(f32) * 5) / sizeof(f32)]),
-							static_cast<f32>(((f32*)model.buffers[inverseBindBufferView.buffer].data.data())[(index + sizeof(f32) * 6) / sizeof(f32)]),
-							static_cast<f32>(((f32*)model.buffers[inverseBindBufferView.buffer].data.data())[(index + sizeof(f32) * 7) / sizeof(f32)]),
-							static_cast<f32>(((f32*)model.buffers[inverseBindBufferView.buffer].data.data())[(index + sizeof(f32) * 8) / sizeof(f32)]),
-							static_cast<f32>(((f32*)model.buffers[inverseBindBufferView.buffer].data.data())[(index + sizeof(f32) * 9) / sizeof(f32)]),
-							static_cast<f32>(((f32*)model.buffers[inverseBindBufferView.buffer].data.data())[(index + sizeof(f32) * 10) / sizeof(f32)]),
-							static_cast<f32>(((f32*)model.buffers[inverseBindBufferView.buffer].data.data())[(index + sizeof(f32) * 11) / sizeof(f32)]),
-							static_cast<f32>(((f32*)model.buffers[inverseBindBufferView.buffer].data.data())[(index + sizeof(f32) * 12) / sizeof(f32)]),
-							static_cast<f32>(((f32*)model.buffers[inverseBindBufferView.buffer].data.data())[(index + sizeof(f32) * 13) / sizeof(f32)]),
-							static_cast<f32>(((f32*)model.buffers[inverseBindBufferView.buffer].data.data())[(index + sizeof(f32) * 14) / sizeof(f32)]),
-							static_cast<f32>(((f32*)model.buffers[inverseBindBufferView.buffer].data.data())[(index + sizeof(f32) * 15) / sizeof(f32)])
-						);
-						invBindMatrices.push_back(matrix);
+						if (rootToSkeleton.count(parent) == 0)
+							rootToSkeleton[parent] = nodeManager.AddSkeleton(nodeManager.GetNode(parentID));
+						skeleton = rootToSkeleton[parent];
 					}
-					auto& gltfMesh = model.meshes[node.mesh];
-					for (auto primitive : gltfMesh.primitives)
+					u32 joint = skeleton->AddJoint(parentIndex, modelMatrix, nodeAnimations[nodeFront.gltfID]);
+					gltfToJoint[nodeFront.gltfID] = std::make_pair(skeleton, joint);
+
+					// joint children stay relative to the skeleton root
+					for (auto& child : node.children)
 					{
-						auto pipeline = forwardPipeline;
-						if (primitive.material >= 0 && pbrMaterials[primitive.material]->material->alphaMode == Graphics::PBRMaterial::ALPHA_MODE::ALPHA_TRANSPARENT)
-						{
-							pipeline = forwardTransparentPipeline;
-						}
-						auto geometry = MakeShared<GLTFMesh>(pipeline, filename, primitive, model, primitive.material >= 0 ? pbrMaterials[primitive.material] : nullptr, invBindMatrices);
-						geometry->node = newNode;
-						// setup compute vertex
-
-						// TODO
-						nodeToJoints.push_back(std::make_pair(geometry, model.skins[node.skin].joints));
-						newMeshes.push_back(geometry);
+						nodesStack.push_back(NodeEntry{ static_cast<u32>(child), parent, static_cast<i32>(nodeFront.gltfID) });
 					}
+					if (node.mesh < 0 && node.camera < 0)
+						continue;
+
+					// a joint carrying a mesh or camera is exposed through its attachment node
+					newNode = getAttachment(nodeFront.gltfID);
+					newNode->nodeType = nodeType;
+				}
+				else
+				{
+					if (parentIsJoint)
+						parentID = getAttachment(nodeFront.parentGltfID)->nodeID;
+					newNode = nodeManager.AddNode(modelMatrix, parentID, nodeType, node.name);
+				}
+
+				if (nodeType == Node::MESH_NODE)
+				{
+					addMeshes(nodeFront.gltfID, newNode, nullptr);
+				}
+				else if (nodeType == Node::SKINNED_MESH_NODE)
+				{
+					// shared by every primitive of the node
+					auto skin = nodeManager.AddSkin(newNode, inverseBindMatrices[node.skin]);
+					meshToSkin.push_back(std::make_pair(skin, node.skin));
+					addMeshes(nodeFront.gltfID, newNode, skin);
 				}
 
 				if (node.mesh > -1)
@@ -751,14 +963,22 @@ namespace Graphics
 					{
 						newNode->morphWeights.push_back(weight);
 					}
+					// default weights are optional
+					for (auto& primitive : model.meshes[node.mesh].primitives)
+						if (newNode->morphWeights.size() < primitive.targets.size())
+							newNode->morphWeights.resize(primitive.targets.size(), 0.f);
 				}
 
+				// joints are animated by their skeleton
+				if (isJoint)
+					continue;
+
 				for (auto& child : node.children)
 				{
-					nodesStack.push_back(std::make_pair<u32, u32>(child, newNode->nodeID.id));
+					nodesStack.push_back(NodeEntry{ static_cast<u32>(child), static_cast<u32>(newNode->nodeID.id), static_cast<i32>(nodeFront.gltfID) });
 				}
 
-				newNode->animations = animationToNodes[nodeFront.first];
+				newNode->animations = nodeAnimations[nodeFront.gltfID];
 				for (auto& anim : newNode->animations)
 				{
 					if (anim->minInput > newNode->minAnimationTime)
@@ -766,37 +986,32 @@ namespace Graphics
 					if (anim->maxInput < newNode->maxAnimationTime)
 						newNode->maxAnimationTime = anim->maxInput;
 				}
-				newNode->gltfID = nodeFront.first;
+				newNode->gltfID = nodeFront.gltfID;
 			}
 		}
 
-		for (auto res : nodeToJoints)
+		for (auto& res : meshToSkin)
 		{
-			SharedPtr<GLTFMesh> node = res.first;
-			Vector<int> jointIDs = res.second;
-			Vector<SharedPtr<Node>> joints;
-
-			for (int jointID : jointIDs)
+			SharedPtr<Skeleton> skeleton;
+			Vector<u32> jointIndices;
+			for (int jointID : model.skins[res.second].joints)
 			{
-				for (auto n : nodeManager.nodes)
-				{
-					// if multiple skeletal mesh, start adding the joints relevant to the present one
-					if (n && n->nodeID.id > curNumNodes && n->gltfID == jointID)
-					{
-						joints.push_back(n);
-					}
-				}
+				auto found = gltfToJoint.find(jointID);
+				if (found == gltfToJoint.end())
+					throw std::runtime_error("skin joint is not part of the scene");
+				// all joints of a skin share one skeleton
+				assert(skeleton == nullptr || skeleton == found->second.first);
+				skeleton = found->second.first;
+				jointIndices.push_back(found->second.second);
 			}
-
-			node->SetJoints(joints);
+			res.first->SetSkeleton(skeleton, jointIndices);
 		}
 		return gltfRoot;
-		// reading first mesh only
-		//auto& mesh = model.meshes[0];
-
-		//LoadGLTFMesh(mesh, model, vertices, indices, mainTextureURI);
-		
+	}
 
+	SharedPtr<Node> Import::LoadGLTF(const String& filename, NodeManager& nodeManager, SharedPtr<GraphicsPipeline> forwardPipeline, SharedPtr<GraphicsPipeline> forwardTransparentPipeline, Vector<SharedPtr<GLTFMesh>>& newMeshes)
+	{
+		return LoadGLTFAsset(filename, nodeManager, forwardPipeline, forwardTransparentPipeline)->Instantiate(NodeID{ .id = 0 }, newMeshes);
 	}
 
 }
@@ -2,12 +2,14 @@
 
 #include <util/Type.h>
 #include <graphics/Node.h>
+#include <util/Math.h>
 
 namespace tinygltf
 {
 	struct Mesh;
 	struct Model;
 	struct Primitive;
+	struct Node;
 }
 
 namespace Graphics
@@ -21,6 +23,36 @@ namespace Graphics
 	struct GraphicsPipeline;
 	struct PBRMaterial;
 	struct Sampler;
+	struct Animation;
+	struct StructuredBuffer;
+
+	// a glTF decoded once. vertex, index and texture memory, materials and clips are shared by every instance,
+	// an instance only adds its nodes, skeletons, skins and the pose buffers of its animated meshes
+	struct GLTFAsset
+	{
+		String filename;
+		NodeManager& nodeManager;
+		// node hierarchy and skins, attribute and image data is dropped once decoded
+		SharedPtr<tinygltf::Model> model;
+
+		// skin joints and the non joint nodes between them, evaluated by skeletons
+		Set<i32> jointSet;
+		// per gltf node
+		Vector<mat4> localMatrices;
+		Vector<Vector<SharedPtr<Animation>>> nodeAnimations;
+		// EXT_mesh_gpu_instancing transforms and the same as an instance stream, empty and null if not instanced
+		Vector<Vector<mat4>> nodeInstances;
+		Vector<SharedPtr<StructuredBuffer>> nodeInstanceData;
+		// per gltf skin
+		Vector<Vector<mat4>> inverseBindMatrices;
+		// per gltf mesh, one GLTFMesh per primitive. the first node using one takes it as is
+		Vector<Vector<SharedPtr<GLTFMesh>>> meshPrimitives;
+
+		GLTFAsset(const String& filename, NodeManager& nodeManager) : filename{ filename }, nodeManager{ nodeManager } {}
+
+		// new nodes under parent, the root is returned
+		SharedPtr<Node> Instantiate(NodeID parent, Vector<SharedPtr<GLTFMesh>>& newMeshes);
+	};
 
 	struct Import
 	{
@@ -32,8 +64,14 @@ namespace Graphics
 
 		static void LoadTextures(const String filename, tinygltf::Primitive& mesh, tinygltf::Model& model, Texture& mainTexture, Texture& metallic, Texture& normal, Texture& occlusion, Texture& emissive);
 
-		static void LoadGLTFMesh(const String filename, tinygltf::Primitive& mesh, tinygltf::Model& model, Graphics::BasicVertex& vertices, Vector<u16>& indices, Texture& mainTexture, Texture& metallic, Texture& normal, Texture& occlusion, Texture& emissive);
+		static void LoadGLTFMesh(const String filename, tinygltf::Primitive& mesh, tinygltf::Model& model, Graphics::BasicVertex& vertices, Vector<u16>& indices, Texture& mainTexture, Texture& metallic, Texture& normal, Texture& occlusion, Texture& emissive, Math::AABB& bounds);
+
+		// EXT_mesh_gpu_instancing TRS of a node as matrices, nothing if the node does not use it
+		static void LoadGLTFInstances(tinygltf::Node& node, tinygltf::Model& model, Vector<mat4>& instances);
+
+		static SharedPtr<GLTFAsset> LoadGLTFAsset(const String& filename, NodeManager& nodeManager, SharedPtr<GraphicsPipeline> forwardPipeline, SharedPtr<GraphicsPipeline> forwardTransparentPipeline);
 
+		// asset with a single instance under the scene root
 		static SharedPtr<Node> LoadGLTF(const String& filename, NodeManager& nodeManager, SharedPtr<GraphicsPipeline> forwardPipeline, SharedPtr<GraphicsPipeline> forwardTransparentPipeline, Vector<SharedPtr<GLTFMesh>>& newMeshes);
 
 	};
@@ -0,0 +1,234 @@
+#include "IndirectDraw.h"
+#include <cmath>
+
+namespace Graphics
+{
+	namespace
+	{
+		// smallest over the planes of the signed distance of the box's far corner, negative when outside one plane.
+		// same math as Math::Frustum::Classify and cullindirect.comp
+		f32 FrustumDistance(const Math::Frustum& frustum, const Math::AABB& box, f32& scale)
+		{
+			const vec3 center = (box.min + box.max) * 0.5f;
+			const vec3 extent = (box.max - box.min) * 0.5f;
+			f32 closest = std::numeric_limits<f32>::max();
+			scale = 0.f;
+			for (int i = 0; i < 6; ++i)
+			{
+				f32 distance = frustum.nx[i] * center.x + frustum.ny[i] * center.y + frustum.nz[i] * center.z + frustum.d[i];
+				f32 radius = std::abs(frustum.nx[i]) * extent.x + std::abs(frustum.ny[i]) * extent.y + std::abs(frustum.nz[i]) * extent.z;
+				closest = Min(closest, distance + radius);
+				scale = Max(scale, std::abs(distance) + radius);
+			}
+			return closest;
+		}
+	}
+
+	IndirectDraw::IndirectDraw(const Vector<SharedPtr<GLTFMesh>>& sceneMeshes, SharedPtr<Shader> cullShader, SharedPtr<DepthPyramid> depthPyramid)
+		: depthPyramid{ depthPyramid }
+	{
+		static_assert(sizeof(Object) == 128, "object rows must match the std430 layout");
+		static_assert(sizeof(DrawCommand) == 20, "commands must match VkDrawIndexedIndirectCommand");
+		static_assert(sizeof(CullView) == 240, "views must match the std430 layout");
+		assert(depthPyramid);
+		// positions of each vertex buffer, grown to the last vertex of its objects
+		Vector<u32> positionBufferIDs;
+		Vector<Vector<vec3>> positions;
+		for (auto& mesh : sceneMeshes)
+		{
+			if (!Supports(*mesh))
+				continue;
+			const bool isDoubleSided = mesh->material->material->isDoubleSided;
+			const bool isMasked = mesh->material->material->alphaMode == PBRMaterial::ALPHA_MODE::ALPHA_MASK;
+			u32 group = 0;
+			while (group < groups.size() && (groups[group].vertexBufferID != mesh->geometryID.vertexBufferID ||
+				groups[group].indexBufferID != mesh->geometryID.indexBufferID || groups[group].isDoubleSided != isDoubleSided || groups[group].isMasked != isMasked))
+				group++;
+			// the rest keep their own draws
+			if (group == maxGroups)
+				continue;
+			if (group == groups.size())
+			{
+				u32 positionBuffer = 0;
+				while (positionBuffer < positionBufferIDs.size() && positionBufferIDs[positionBuffer] != mesh->geometryID.vertexBufferID)
+					positionBuffer++;
+				if (positionBuffer == positionBufferIDs.size())
+				{
+					positionBufferIDs.push_back(mesh->geometryID.vertexBufferID);
+					positions.emplace_back();
+				}
+				groups.push_back(Group{ mesh->geometryID.vertexBufferID, mesh->geometryID.indexBufferID, isDoubleSided, isMasked, positionBuffer });
+			}
+			groups[group].objectCount++;
+			auto& vertices = std::static_pointer_cast<BasicVertex>(mesh->GetVertexData())->vertices;
+			auto& bufferPositions = positions[groups[group].positionBuffer];
+			bufferPositions.resize(Max(bufferPositions.size(), static_cast<size_t>(mesh->geometryID.vertexOffset + vertices.size())), vec3(0));
+			for (size_t i = 0; i < vertices.size(); ++i)
+				bufferPositions[mesh->geometryID.vertexOffset + i] = vertices[i].pos;
+			maxDrawsPerGroup = Max(maxDrawsPerGroup, groups[group].objectCount);
+
+			mesh->indirectObject = static_cast<u32>(objects.size());
+			nodeObjects[mesh->node->nodeID.id].push_back(mesh->indirectObject);
+			meshes.push_back(mesh.get());
+			Object& object = objects.emplace_back();
+			object.worldMatrix = mesh->node->worldMatrix;
+			object.boundsMin = vec4(mesh->bounds.min, 1);
+			object.boundsMax = vec4(mesh->bounds.max, 1);
+			object.indexCount = static_cast<u32>(mesh->GetIndicesData().size());
+			object.firstIndex = mesh->geometryID.firstIndex;
+			object.vertexOffset = static_cast<i32>(mesh->geometryID.vertexOffset);
+			object.materialIndex = mesh->material->materialIndex;
+			object.hasTangent = mesh->GetVertexData()->hasTangent ? 1 : 0;
+			object.group = group;
+			object.padding[0] = object.padding[1] = 0;
+		}
+		isDirty.assign(objects.size(), false);
+		DebugPrint("indirect draw: %zu objects in %zu groups, %u commands per group\n", objects.size(), groups.size(), maxDrawsPerGroup);
+		if (objects.empty())
+			return;
+
+		// the gpu only reads the table, rows are copied in through the upload batch
+		ResourceBinding objectBinding;
+		objectBinding.binding = 3;
+		objectBinding.shaderStageType = ResourceBinding::ShaderStageType::COMPUTE;
+		Vector<Buffer::BufferUsageType> objectUsage{ Buffer::BufferUsageType::BUFFER_STORAGE, Buffer::BufferUsageType::BUFFER_TRANSFER_DST };
+		objectBuffer = MakeShared<StructuredBuffer>((u8*)objects.data(), static_cast<u32>(objects.size() * sizeof(Object)), objectBinding, objectUsage, true);
+
+		ResourceBinding commandBinding;
+		commandBinding.binding = 1;
+		commandBinding.shaderStageType = ResourceBinding::ShaderStageType::COMPUTE;
+		Vector<Buffer::BufferUsageType> commandUsage{ Buffer::BufferUsageType::BUFFER_STORAGE, Buffer::BufferUsageType::BUFFER_INDIRECT,
+			Buffer::BufferUsageType::BUFFER_TRANSFER_DST, Buffer::BufferUsageType::BUFFER_TRANSFER_SRC };
+		Vector<u8> emptyCommands(GetCommandBufferSize(), 0);
+		commandBuffer = MakeShared<StructuredBuffer>(emptyCommands.data(), GetCommandBufferSize(), commandBinding, commandUsage, true);
+
+		ResourceBinding viewBinding;
+		viewBinding.binding = 0;
+		viewBinding.shaderStageType = ResourceBinding::ShaderStageType::COMPUTE;
+		viewBuffer = MakeShared<HostStorageBuffer>(static_cast<u32>(sizeof(CullView)), viewBinding);
+
+		ResourceBinding occludedBinding;
+		occludedBinding.binding = 5;
+		occludedBinding.shaderStageType = ResourceBinding::ShaderStageType::COMPUTE;
+		occludedBuffer = MakeShared<DeviceStorageBuffer>(static_cast<u32>(objects.size() * sizeof(u32)), occludedBinding);
+
+		// drawn from by the depth pre-pass with the index buffers and commands of the full vertices
+		ResourceBinding positionBinding;
+		Vector<Buffer::BufferUsageType> positionUsage{ Buffer::BufferUsageType::BUFFER_VERTEX, Buffer::BufferUsageType::BUFFER_TRANSFER_DST };
+		for (auto& bufferPositions : positions)
+			positionBuffers.push_back(MakeShared<StructuredBuffer>((u8*)bufferPositions.data(), static_cast<u32>(bufferPositions.size() * sizeof(vec3)), positionBinding, positionUsage, true));
+
+		Vector<SharedPtr<Buffer>> cullBuffers{ viewBuffer, objectBuffer, commandBuffer, depthPyramid->pyramidBuffer, occludedBuffer };
+		Vector<Texture> cullTextures{};
+		PushConstant cullConstant("CullParams", PushConstant::Stage::COMPUTE, sizeof(CullConstant));
+		cullPipeline = MakeShared<ComputePipeline>(cullShader, vec3(objects.size(), 1, 1), vec3(groupSize, 1, 1), cullBuffers, cullTextures, Vector<PushConstant>{ cullConstant });
+		BindObjectTable();
+	}
+
+	bool IndirectDraw::Supports(GLTFMesh& mesh)
+	{
+		auto vertexData = mesh.GetVertexData();
+		return !vertexData->hasSkeleton && !vertexData->hasBlends && mesh.instanceMatrices.empty() && !mesh.GetIndicesData().empty() &&
+			mesh.material->material->alphaMode != PBRMaterial::ALPHA_MODE::ALPHA_TRANSPARENT && !mesh.bounds.IsEmpty() &&
+			std::dynamic_pointer_cast<BasicVertex>(vertexData);
+	}
+
+	void IndirectDraw::MarkMoved(const Vector<NodeID>& movedNodes)
+	{
+		for (NodeID nodeID : movedNodes)
+		{
+			auto it = nodeObjects.find(nodeID.id);
+			if (it == nodeObjects.end())
+				continue;
+			for (u32 object : it->second)
+			{
+				objects[object].worldMatrix = meshes[object]->node->worldMatrix;
+				if (isDirty[object])
+					continue;
+				isDirty[object] = true;
+				dirtyObjects.push_back(object);
+			}
+		}
+	}
+
+	void IndirectDraw::CpuCull(const mat4& viewProj, f32 margin, Vector<Vector<u32>>& visible, Vector<Vector<u32>>& culled) const
+	{
+		Math::Frustum frustum(viewProj);
+		visible.assign(groups.size(), Vector<u32>{});
+		culled.assign(groups.size(), Vector<u32>{});
+		for (u32 i = 0; i < objects.size(); ++i)
+		{
+			const Object& object = objects[i];
+			Math::AABB bounds;
+			bounds.min = vec3(object.boundsMin);
+			bounds.max = vec3(object.boundsMax);
+			f32 scale;
+			f32 distance = FrustumDistance(frustum, Math::Transform(bounds, object.worldMatrix), scale);
+			if (distance >= margin * scale)
+				visible[object.group].push_back(i);
+			else if (distance < -margin * scale)
+				culled[object.group].push_back(i);
+		}
+	}
+
+	u32 IndirectDraw::Validate()
+	{
+		if (objects.empty())
+			return 0;
+		Vector<u32> counts;
+		Vector<DrawCommand> commands;
+		ReadCommands(counts, commands);
+
+		Vector<Vector<u32>> visible;
+		Vector<Vector<u32>> culled;
+		CpuCull(lastViewProj, 1e-4f, visible, culled);
+		u32 mismatches = 0;
+		u32 drawn = 0;
+		u32 hidden = 0;
+		Vector<u8> isDrawn(objects.size(), 0);
+		for (u32 group = 0; group < groups.size(); ++group)
+		{
+			if (counts[group] > groups[group].objectCount)
+			{
+				DebugPrint("indirect draw group %u: %u commands for %u objects\n", group, counts[group], groups[group].objectCount);
+				mismatches++;
+				continue;
+			}
+			for (u32 slot = 0; slot < counts[group]; ++slot)
+			{
+				const DrawCommand& command = commands[group * maxDrawsPerGroup + slot];
+				const u32 object = command.firstInstance;
+				// every field as the compute pass copies it from the row
+				if (object >= objects.size() || objects[object].group != group || command.instanceCount != 1 || isDrawn[object] ||
+					command.indexCount != objects[object].indexCount || command.firstIndex != objects[object].firstIndex || command.vertexOffset != objects[object].vertexOffset)
+				{
+					DebugPrint("indirect draw group %u slot %u: bad command for object %u\n", group, slot, object);
+					mismatches++;
+					continue;
+				}
+				isDrawn[object] = 1;
+				drawn++;
+			}
+			for (u32 object : visible[group])
+				if (!isDrawn[object])
+				{
+					// behind the depth pyramid
+					if (occlusionTested)
+					{
+						hidden++;
+						continue;
+					}
+					DebugPrint("indirect draw: object %u (%s) in view but not drawn\n", object, meshes[object]->node->name.c_str());
+					mismatches++;
+				}
+			for (u32 object : culled[group])
+				if (isDrawn[object])
+				{
+					DebugPrint("indirect draw: object %u (%s) out of view but drawn\n", object, meshes[object]->node->name.c_str());
+					mismatches++;
+				}
+		}
+		DebugPrint("indirect draw validation: %u of %zu objects drawn, %u in view occluded, %u mismatches\n", drawn, objects.size(), hidden, mismatches);
+		return mismatches;
+	}
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <util/Type.h>
+#include <util/Math.h>
+#include <graphics/Geometry.h>
+#include <graphics/Pipeline.h>
+#include <graphics/DepthPyramid.h>
+
+namespace Graphics
+{
+	// gpu driven drawing of the static opaque meshes. a compute pass tests each object's node space box moved by its world
+	// matrix against the frustum and appends an indexed indirect command to the object's group, the forward pass then draws
+	// each group with one vkCmdDrawIndexedIndirectCount. a group is the objects sharing vertex buffer, index buffer and
+	// cull mode, so the cpu cost of the pass does not grow with the object count.
+	// firstInstance of a command is the object, indirect.vert reads its world matrix and material from the object table.
+	// with occlusion the culling runs in two phases around the depth pre-pass. the first draws what the frustum and the
+	// previous frame's depth pyramid do not hide, the pre-pass draws those from position only streams and the pyramid is
+	// built from it, then the second tests what the first hid against the new pyramid and appends what shows
+	struct IndirectDraw
+	{
+		static const u32 INVALID = ~0u;
+		static const u32 maxGroups = 16;
+		static const u32 groupSize = 64;
+
+		// one row per object, std430 layout of drawobjectcommon.glsl
+		struct Object
+		{
+			mat4 worldMatrix;
+			// node space
+			vec4 boundsMin;
+			vec4 boundsMax;
+			u32 indexCount;
+			u32 firstIndex;
+			i32 vertexOffset;
+			u32 materialIndex;
+			u32 hasTangent;
+			u32 group;
+			u32 padding[2];
+		};
+
+		// VkDrawIndexedIndirectCommand
+		struct DrawCommand
+		{
+			u32 indexCount;
+			u32 instanceCount;
+			u32 firstIndex;
+			i32 vertexOffset;
+			u32 firstInstance;
+		};
+
+		struct CullConstant
+		{
+			u32 objectCount;
+			u32 maxDrawsPerGroup;
+			// 0 tests every object, 1 the ones the first phase hid
+			u32 phase;
+			// test against the depth pyramid
+			u32 occlusion;
+		};
+
+		// inputs and counters of a frame's culling passes, std430 layout of cullindirect.comp
+		struct CullView
+		{
+			// frustum planes as in Math::Frustum, normals pointing inside
+			vec4 planes[6];
+			mat4 viewProj;
+			// the view the depth pyramid the first phase tests against was drawn with
+			mat4 pyramidViewProj;
+			u32 frustumCulled;
+			u32 firstPhaseOccluded;
+			u32 occluded;
+			u32 padding;
+		};
+
+		// counters of the last finished frame
+		struct Stats
+		{
+			u32 objects = 0;
+			u32 frustumCulled = 0;
+			// hidden after both phases
+			u32 occluded = 0;
+			// hidden by the previous frame's pyramid, drawn after the second phase
+			u32 rescued = 0;
+		};
+
+		struct Group
+		{
+			u32 vertexBufferID;
+			u32 indexBufferID;
+			bool isDoubleSided;
+			// cut out by alpha, so not drawn in the depth pre-pass
+			bool isMasked;
+			// into positionBuffers
+			u32 positionBuffer;
+			u32 objectCount = 0;
+		};
+
+		Vector<GLTFMesh*> meshes;
+		Vector<Object> objects;
+		Vector<Group> groups;
+		// command slots reserved per group, the size of the largest group
+		u32 maxDrawsPerGroup = 0;
+		Stats stats;
+
+		// set 1 binding 3 of the graphics pipelines, binding 3 of the culling pass
+		SharedPtr<StructuredBuffer> objectBuffer;
+		// a count per group then maxDrawsPerGroup commands per group
+		SharedPtr<StructuredBuffer> commandBuffer;
+		// binding 0 of the culling pass
+		SharedPtr<HostStorageBuffer> viewBuffer;
+		// binding 5 of the culling pass, set by the first phase for the objects it hid
+		SharedPtr<DeviceStorageBuffer> occludedBuffer;
+		SharedPtr<ComputePipeline> cullPipeline;
+		// position only copy of each vertex buffer of the groups, at the same vertex offsets
+		Vector<SharedPtr<StructuredBuffer>> positionBuffers;
+		// binding 4 of the culling pass
+		SharedPtr<DepthPyramid> depthPyramid;
+
+		// objects for the meshes Supports accepts, up to maxGroups groups. sets their indirectObject
+		IndirectDraw(const Vector<SharedPtr<GLTFMesh>>& sceneMeshes, SharedPtr<Shader> cullShader, SharedPtr<DepthPyramid> depthPyramid);
+
+		// static, not instanced, indexed and not blended, with bounds and basic vertices
+		static bool Supports(GLTFMesh& mesh);
+
+		// rows of the meshes on these nodes are uploaded with the next Cull
+		void MarkMoved(const Vector<NodeID>& movedNodes);
+
+		// uploads the moved rows and records the first culling phase, testing the previous frame's depth pyramid when
+		// occlusion is on and it was built at the current size. outside a render pass, before the passes that draw
+		void Cull(RenderContext& context, const mat4& viewProj, bool occlusion);
+
+		// the depth of the first phase's objects with the pass's pipeline, skipping the alpha masked groups
+		void DrawDepth(RenderContext& context);
+
+		// builds the depth pyramid from the pre-pass and records the second phase when the first tested occlusion.
+		// outside a render pass, after DrawDepth and before Draw
+		void CullOccluded(RenderContext& context);
+
+		// the pass's indirect variant, one draw per group
+		void Draw(RenderContext& context);
+
+		// per group, the objects the compute pass must draw and the ones it must skip for viewProj.
+		// objects within margin of a plane are in neither, float results can differ there
+		void CpuCull(const mat4& viewProj, f32 margin, Vector<Vector<u32>>& visible, Vector<Vector<u32>>& culled) const;
+
+		// reads back the last Cull and compares it with CpuCull, the number of objects that differ. objects in view that were
+		// not drawn count only when the frame did not test occlusion. waits for the device
+		u32 Validate();
+
+		u32 GetCommandBufferSize() const { return static_cast<u32>(maxGroups * sizeof(u32) + maxGroups * maxDrawsPerGroup * sizeof(DrawCommand)); }
+
+	private:
+		Map<i32, Vector<u32>> nodeObjects;
+		Vector<u32> dirtyObjects;
+		Vector<bool> isDirty;
+		mat4 lastViewProj = mat4(1);
+		mat4 pyramidViewProj = mat4(1);
+		// the last Cull tested the pyramid, so the second phase has objects to test
+		bool occlusionTested = false;
+
+		// writes the object table into the bindless set and zeroes the counters of every frame's view
+		void BindObjectTable();
+		void Dispatch(RenderContext& context, const CullConstant& constant);
+		// counts and commands written by the last Cull
+		void ReadCommands(Vector<u32>& counts, Vector<DrawCommand>& commands);
+	};
+}
@@ -28,8 +28,18 @@ namespace Graphics
             ALPHA_MODE alphaMode = ALPHA_MODE::ALPHA_OPAQUE; // opaque, blend, mask
             float alphaCutoff = 1;
             float occlusionStrength = 1;
+            // slots of the textures in the bindless array, 0 (white) when the flag above is not set
+            u32 albedoTexIndex = 0;
+            u32 metallicTexIndex = 0;
+            u32 normalTexIndex = 0;
+            u32 occlusionTexIndex = 0;
+            u32 emissiveTexIndex = 0;
         };
         UniquePtr<MaterialData> material;
+        // row in the material table, assigned when the first mesh using it is created
+        u32 materialIndex = ~0u;
+        // row waits for the upload before the next frame
+        bool isDirty = false;
 
         Texture albedoTexture;
         Texture metallicTexture;
@@ -56,5 +66,8 @@ namespace Graphics
         {
             return (void *)material.get();
         }
+
+        // call after changing material data, only changed rows are uploaded
+        void MarkDirty();
     };
 }
\ No newline at end of file
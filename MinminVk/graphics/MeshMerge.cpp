@@ -0,0 +1,154 @@
+#include "MeshMerge.h"
+#include <util/Math.h>
+#include <tuple>
+#include <limits>
+
+namespace Graphics
+{
+	namespace
+	{
+		struct Candidate
+		{
+			SharedPtr<GLTFMesh> mesh;
+			// load time transform, the node is static
+			mat4 worldMatrix;
+		};
+
+		mat4 StaticWorldMatrix(Node& node, NodeManager& nodeManager)
+		{
+			mat4 worldMatrix = node.modelMatrix;
+			for (NodeID parentID = node.parentNodeID; parentID.id != 0; parentID = nodeManager.GetNode(parentID)->parentNodeID)
+				worldMatrix = nodeManager.GetNode(parentID)->modelMatrix * worldMatrix;
+			return worldMatrix;
+		}
+
+		SharedPtr<GLTFMesh> Bake(const Vector<Candidate>& batch, NodeManager& nodeManager)
+		{
+			auto first = std::static_pointer_cast<BasicVertex>(batch[0].mesh->GetVertexData());
+			auto vertexData = MakeShared<BasicVertex>();
+			vertexData->hasNormal = first->hasNormal;
+			vertexData->hasTangent = first->hasTangent;
+			Vector<u16> indices;
+			for (auto& candidate : batch)
+			{
+				auto source = std::static_pointer_cast<BasicVertex>(candidate.mesh->GetVertexData());
+				const mat4& worldMatrix = candidate.worldMatrix;
+				const mat4 normalMatrix = Math::InverseTranspose(worldMatrix);
+				// a mirroring transform flips the winding and the bitangent
+				const bool mirrored = glm::determinant(mat3(worldMatrix)) < 0.f;
+				const u32 baseVertex = static_cast<u32>(vertexData->vertices.size());
+				for (auto vertex : source->vertices)
+				{
+					vertex.pos = vec3(worldMatrix * vec4(vertex.pos, 1));
+					vertex.normal = Math::Normalize(vec3(normalMatrix * vec4(vertex.normal, 0)));
+					vertex.tangent = vec4(Math::Normalize(vec3(worldMatrix * vec4(vec3(vertex.tangent), 0))), mirrored ? -vertex.tangent.w : vertex.tangent.w);
+					vertexData->vertices.push_back(vertex);
+				}
+
+				auto& sourceIndices = candidate.mesh->GetIndicesData();
+				const u32 numIndices = sourceIndices.empty() ? source->GetVerticesCount() : static_cast<u32>(sourceIndices.size());
+				for (u32 i = 0; i < numIndices; i += 3)
+				{
+					u32 triangle[3];
+					for (u32 k = 0; k < 3; ++k)
+						triangle[k] = baseVertex + (sourceIndices.empty() ? i + k : sourceIndices[i + k]);
+					if (mirrored)
+						std::swap(triangle[1], triangle[2]);
+					for (u32 k = 0; k < 3; ++k)
+					{
+						assert(triangle[k] <= std::numeric_limits<u16>::max());
+						indices.push_back(static_cast<u16>(triangle[k]));
+					}
+				}
+			}
+			auto node = nodeManager.AddNode(mat4(1), NodeID{ .id = 0 }, Node::NodeType::MESH_NODE, "static batch");
+			return MakeShared<GLTFMesh>(*batch[0].mesh, vertexData, std::move(indices), node);
+		}
+	}
+
+	bool MeshMerge::IsStatic(GLTFMesh& mesh, NodeManager& nodeManager)
+	{
+		auto vertexData = mesh.GetVertexData();
+		if (vertexData->hasSkeleton || vertexData->hasBlends || !mesh.instanceMatrices.empty())
+			return false;
+		for (auto node = mesh.node; node->nodeID.id != 0; node = nodeManager.GetNode(node->parentNodeID))
+		{
+			if (!node->animations.empty() || node->nodeType == Node::NodeType::BONE_NODE)
+				return false;
+		}
+		return true;
+	}
+
+	u32 MeshMerge::MergeStatic(Vector<SharedPtr<GLTFMesh>>& meshes, NodeManager& nodeManager, const Settings& settings)
+	{
+		// same material and vertex attributes, then same cell
+		using GroupKey = std::tuple<PBRMaterial*, bool, bool>;
+		using CellKey = std::tuple<i32, i32, i32>;
+		Map<GroupKey, Map<CellKey, Vector<Candidate>>> groups;
+		Vector<SharedPtr<GLTFMesh>> result;
+		// a batch is split before its vertices outgrow the u16 indices, whatever the settings ask for
+		const u32 maxVertices = Min(settings.maxVertices, static_cast<u32>(std::numeric_limits<u16>::max()) + 1);
+		for (auto& mesh : meshes)
+		{
+			// transparent primitives stay separate to be sorted
+			if (!IsStatic(*mesh, nodeManager) || mesh->material->material->alphaMode == PBRMaterial::ALPHA_MODE::ALPHA_TRANSPARENT ||
+				mesh->GetVertexData()->GetVerticesCount() > maxVertices)
+			{
+				result.push_back(mesh);
+				continue;
+			}
+			auto vertexData = std::static_pointer_cast<BasicVertex>(mesh->GetVertexData());
+			mat4 worldMatrix = StaticWorldMatrix(*mesh->node, nodeManager);
+			vec3 minPos(std::numeric_limits<f32>::max());
+			vec3 maxPos(std::numeric_limits<f32>::lowest());
+			for (auto& vertex : vertexData->vertices)
+			{
+				minPos = glm::min(minPos, vertex.pos);
+				maxPos = glm::max(maxPos, vertex.pos);
+			}
+			vec3 center = vec3(worldMatrix * vec4((minPos + maxPos) * 0.5f, 1));
+			glm::ivec3 cell = glm::floor(center / settings.cellSize);
+			groups[GroupKey{ mesh->material.get(), vertexData->hasNormal, vertexData->hasTangent }][CellKey{ cell.x, cell.y, cell.z }]
+				.push_back(Candidate{ mesh, worldMatrix });
+		}
+
+		u32 numBatches = 0;
+		u32 numMerged = 0;
+		auto flush = [&](Vector<Candidate>& batch)
+		{
+			if (batch.size() == 1)
+				result.push_back(batch[0].mesh);
+			else if (batch.size() > 1)
+			{
+				result.push_back(Bake(batch, nodeManager));
+				numBatches++;
+				numMerged += static_cast<u32>(batch.size());
+			}
+			batch.clear();
+		};
+		for (auto& [groupKey, cells] : groups)
+		{
+			for (auto& [cellKey, candidates] : cells)
+			{
+				Vector<Candidate> batch;
+				u32 batchVertices = 0;
+				for (auto& candidate : candidates)
+				{
+					u32 numVertices = candidate.mesh->GetVertexData()->GetVerticesCount();
+					if (batchVertices + numVertices > maxVertices)
+					{
+						flush(batch);
+						batchVertices = 0;
+					}
+					batch.push_back(candidate);
+					batchVertices += numVertices;
+				}
+				flush(batch);
+			}
+		}
+
+		DebugPrint("static merge: %u primitives into %u batches, %zu draws before, %zu after\n", numMerged, numBatches, meshes.size(), result.size());
+		meshes = result;
+		return numBatches;
+	}
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <util/Type.h>
+#include <graphics/Geometry.h>
+#include <graphics/Node.h>
+
+namespace Graphics
+{
+	// load time batching of static scenery. opaque primitives that never move and share a material are baked
+	// into world space vertex and index buffers, one draw per batch instead of one per primitive
+	struct MeshMerge
+	{
+		struct Settings
+		{
+			// indices are u16, so batches never go above 65536 vertices
+			u32 maxVertices = 65535;
+			// a batch only takes primitives centered in one cell of this size, so batches stay small enough to cull
+			f32 cellSize = 16.f;
+		};
+
+		// merged primitives in meshes are replaced by their batches. returns the number of batches
+		static u32 MergeStatic(Vector<SharedPtr<GLTFMesh>>& meshes, NodeManager& nodeManager, const Settings& settings);
+
+		// not animated, not instanced, and neither the node nor a parent is animated or hangs from a skeleton
+		static bool IsStatic(GLTFMesh& mesh, NodeManager& nodeManager);
+	};
+}
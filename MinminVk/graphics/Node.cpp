@@ -35,12 +35,7 @@ namespace Graphics
 			}
 			else if (anim->animationType == Animation::AnimationType::WEIGHTS)
 			{
-				vec4 weights = anim->Sample(timer);
-				
-				for (int i = 0; i < Min((u32)4, anim->numWeightsMorphTarget); ++i)
-				{
-					morphWeights[i] = weights[i];
-				}
+				anim->SampleWeights(timer, morphWeights);
 			}
 		}
 		mat4 newModel = newtrans * newrot * newscale;
@@ -49,6 +44,7 @@ namespace Graphics
 		if (isDirty)
 		{
 			worldMatrix = parentModelMatrix * newModel;
+			nodeManager.movedNodes.push_back(nodeID);
 
 			for (NodeID childID : childrenIDs)
 			{
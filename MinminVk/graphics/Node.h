@@ -2,6 +2,8 @@
 
 #include <util/Type.h>
 #include <graphics/Animation.h>
+#include <graphics/Skeleton.h>
+#include <util/Jobs.h>
 
 namespace Graphics
 {
@@ -50,6 +52,10 @@ namespace Graphics
 		f32 timer = 0;
 
 		Vector<SharedPtr<Node>> nodes;
+		Vector<SharedPtr<Skeleton>> skeletons;
+		Vector<SharedPtr<Skin>> skins;
+		// nodes whose world matrix was written by the last update
+		Vector<NodeID> movedNodes;
 
 		NodeManager(u32 poolSize)
 		{
@@ -108,16 +114,35 @@ namespace Graphics
 			return nodes[nodeID.id];
 		}
 
+		SharedPtr<Skeleton> AddSkeleton(SharedPtr<Node> rootNode)
+		{
+			auto skeleton = MakeShared<Skeleton>(rootNode);
+			skeletons.push_back(skeleton);
+			return skeleton;
+		}
+
+		SharedPtr<Skin> AddSkin(SharedPtr<Node> node, Vector<mat4>& inverseBindMatrices)
+		{
+			auto skin = MakeShared<Skin>(node, inverseBindMatrices);
+			skins.push_back(skin);
+			return skin;
+		}
+
 		void Update(f32 deltaTime)
 		{
 			timer += deltaTime;
 			if (timer > Animation::maxAnimationTime)
 				timer = 0;
+			movedNodes.clear();
+			// skeletons first so attachment nodes pick up the new pose
+			Util::Jobs::ParallelFor(skeletons.size(), [&](u32 i) { skeletons[i]->Update(deltaTime); });
 			for (SharedPtr<Node> node : nodes)
 			{
 				if (node)
 					node->Update(deltaTime, *this);
 			}
+			// palettes need the final world matrices, one job per character
+			Util::Jobs::ParallelFor(skins.size(), [&](u32 i) { skins[i]->Update(); });
 		}
 
 
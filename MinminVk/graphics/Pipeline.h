@@ -117,6 +117,8 @@ namespace Graphics
 		BlendFactorType blendDestFactorType;
 		BlendOpType blendOpType;
 		bool blendEnabled = false;
+		// off for depth only passes
+		bool colorWriteEnable = true;
 
 		bool depthTestEnable = true;
 		bool depthWriteEnable = true;
@@ -136,17 +138,19 @@ namespace Graphics
 		// auto reduced if device doesn't support
 		u32 msaaSamples = 8;
 
-		// up to 5 textures for each mesh (base color, metallic, normal, occlusion, emissive)
-		u32 numTexPerMesh = 5;
-
-		// up to 100 meshes (to set descriptor sets limit)
-		u32 maxNumMeshes = 100;
-		u32 currentMeshCount = 0;
-		u32 perMeshLayoutID;
-
+		// set 0, per frame. set 1 is the bindless material set shared by every graphics pipeline
 		u32 layoutID;
 		u32 setID;
 
+		// same states with skinning in the vertex shader, used by meshes in that mode
+		SharedPtr<GraphicsPipeline> skinnedVariant;
+		// same states reading position, normal and tangent from the compute transformed stream
+		SharedPtr<GraphicsPipeline> animatedVariant;
+		// same states with a per instance model matrix stream, for EXT_mesh_gpu_instancing meshes
+		SharedPtr<GraphicsPipeline> instancedVariant;
+		// same states reading the world matrix and material from the IndirectDraw object table
+		SharedPtr<GraphicsPipeline> indirectVariant;
+
 		GraphicsPipeline(SharedPtr<Shader> vertexShader, SharedPtr<Shader> fragmentShader, SharedPtr<VertexDesc> vertexDesc, 
 			SharedPtr<BasicUniformBuffer> uniformDesc, Vector<Texture> textures, Vector<SharedPtr<Buffer>> buffers)
 			: vertexShader{ vertexShader }, fragmentShader{ fragmentShader }, vertexDesc{ vertexDesc }, uniformDesc{ uniformDesc }, textures { textures }, buffers{ buffers } 
@@ -158,7 +162,8 @@ namespace Graphics
 		void UpdateTextures(const Vector<Texture>& textures);
 	};
 
-	enum class AttachmentOpType { CLEAR, STORE, DONTCARE };
+	// LOAD keeps what an earlier pass of the frame rendered, CLEAR only in the first pass touching the attachment
+	enum class AttachmentOpType { CLEAR, STORE, DONTCARE, LOAD };
 
 	struct Attachment
 	{
@@ -251,8 +256,11 @@ namespace Graphics
 		Vector<SharedPtr<Buffer>> buffers;
 		Vector<Texture> textures;
 
-		ComputePipeline(SharedPtr<Shader> computeShader, vec3 threadSz, vec3 invocationSz, Vector<SharedPtr<Buffer>>& buffers, Vector<Texture>& textures, Vector<PushConstant> pushConstants = Vector<PushConstant>{})
-			: computeShader{computeShader}, threadSz{threadSz}, invocationSz{invocationSz}, buffers{buffers}, textures{textures}, pushConstants{pushConstants}
+		// number of persistent resource sets the descriptor pool has room for
+		u32 maxResourceSets = 0;
+
+		ComputePipeline(SharedPtr<Shader> computeShader, vec3 threadSz, vec3 invocationSz, Vector<SharedPtr<Buffer>>& buffers, Vector<Texture>& textures, Vector<PushConstant> pushConstants = Vector<PushConstant>{}, u32 maxResourceSets = 0)
+			: computeShader{computeShader}, threadSz{threadSz}, invocationSz{invocationSz}, buffers{buffers}, textures{textures}, pushConstants{pushConstants}, maxResourceSets{maxResourceSets}
 		{
 			Init();
 		}
@@ -261,6 +269,12 @@ namespace Graphics
 
 		void Dispatch(ComputeContext & context);
 
+		// dispatch with a set from CreateResourceSets instead of the pipeline's own
+		void Dispatch(ComputeContext& context, int resourceSetID);
+
+		// one descriptor set per frame in flight, written once. returns the resource set ID
+		int CreateResourceSets(Vector<SharedPtr<Buffer>>& buffers, Vector<Texture>& textures);
+
 		void UpdateResources(ComputeContext& context, Vector<SharedPtr<Buffer>> &buffers, Vector<Texture> &textures);
 	};
 
@@ -0,0 +1,123 @@
+#include "RenderQueue.h"
+#include <graphics/Device.h>
+#include <util/Jobs.h>
+#include <cstring>
+#include <utility>
+
+namespace Graphics
+{
+	namespace
+	{
+		const u32 variantBits = 4;
+		const u32 materialBits = 13;
+		const u32 vertexBufferBits = 12;
+		// variant, double sided, material and vertex buffer
+		const u32 stateBits = variantBits + 1 + materialBits + vertexBufferBits;
+
+		// same choice as GLTFMesh::Draw, without the pass pipeline
+		u64 DrawVariant(GLTFMesh& mesh)
+		{
+			auto vertexData = mesh.GetVertexData();
+			if (!vertexData->hasSkeleton && !vertexData->hasBlends)
+				return mesh.instanceMatrices.empty() ? 0 : 1;
+			if (mesh.skinningMode == GLTFMesh::SkinningMode::VERTEX_SHADER)
+				return 2;
+			return 3;
+		}
+
+		// squared distances are positive, their bits sort like the floats
+		u64 DistanceBits(GLTFMesh& mesh, const vec3& cameraPosition)
+		{
+			vec3 offset = vec3(mesh.node->worldMatrix[3]) - cameraPosition;
+			f32 distance = offset.x * offset.x + offset.y * offset.y + offset.z * offset.z;
+			u32 bits;
+			memcpy(&bits, &distance, sizeof(f32));
+			return bits;
+		}
+	}
+
+	u64 RenderQueue::MakeKey(GLTFMesh& mesh, const vec3& cameraPosition)
+	{
+		auto& material = *mesh.material;
+		u64 state = DrawVariant(mesh);
+		state = (state << 1) | (material.material->isDoubleSided ? 1 : 0);
+		state = (state << materialBits) | (material.materialIndex & ((1u << materialBits) - 1));
+		state = (state << vertexBufferBits) | (mesh.geometryID.vertexBufferID & ((1u << vertexBufferBits) - 1));
+
+		u64 distance = DistanceBits(mesh, cameraPosition);
+		if (material.material->alphaMode == PBRMaterial::ALPHA_MODE::ALPHA_TRANSPARENT)
+		{
+			// blended in order, farthest first
+			u64 bucket = static_cast<u64>(Bucket::BLENDED);
+			return (bucket << 62) | ((~distance & 0xffffffffull) << stateBits) | state;
+		}
+		u64 bucket = static_cast<u64>(Bucket::SOLID);
+		return (bucket << 62) | (state << 32) | distance;
+	}
+
+	void RenderQueue::Push(GLTFMesh& mesh, const vec3& cameraPosition)
+	{
+		items.push_back(Item{ MakeKey(mesh, cameraPosition), &mesh });
+	}
+
+	void RenderQueue::Sort()
+	{
+		Vector<Item> scratch(items.size());
+		Item* src = items.data();
+		Item* dst = scratch.data();
+		const u32 count = static_cast<u32>(items.size());
+		for (u32 shift = 0; shift < 64; shift += 8)
+		{
+			u32 offsets[256] = {};
+			for (u32 i = 0; i < count; ++i)
+				offsets[(src[i].key >> shift) & 0xff]++;
+			if (count == 0 || offsets[(src[0].key >> shift) & 0xff] == count)
+				continue;
+			u32 sum = 0;
+			for (u32 b = 0; b < 256; ++b)
+			{
+				u32 bucketCount = offsets[b];
+				offsets[b] = sum;
+				sum += bucketCount;
+			}
+			// stable, so lower bytes keep their order within a bucket
+			for (u32 i = 0; i < count; ++i)
+				dst[offsets[(src[i].key >> shift) & 0xff]++] = src[i];
+			std::swap(src, dst);
+		}
+		if (src != items.data())
+			items.swap(scratch);
+	}
+
+	u32 RenderQueue::Draw(RenderContext& context, Bucket bucket, u32 maxChunks)
+	{
+		bucketMeshes.clear();
+		for (auto& item : items)
+			if ((item.key >> 62) == static_cast<u64>(bucket))
+				bucketMeshes.push_back(item.mesh);
+		const u32 count = static_cast<u32>(bucketMeshes.size());
+		const u32 chunkCount = Min(maxChunks, (count + minDrawsPerChunk - 1) / minDrawsPerChunk);
+		if (chunkCount <= 1)
+		{
+			for (auto mesh : bucketMeshes)
+				mesh->Draw(context);
+			return 1;
+		}
+
+		// lists execute in reservation order. the caller's list is closed before the chunks and reopened after them
+		assert(context.secondaryList != RenderContext::PRIMARY);
+		context.device->EndSecondaryRecording(context);
+		const u32 firstList = context.device->ReserveSecondaryLists(context, chunkCount);
+		Util::Jobs::ParallelFor(chunkCount, [&](u32 chunk)
+		{
+			RenderContext chunkContext = context;
+			context.device->BeginSecondaryRecording(chunkContext, firstList + chunk);
+			const u32 end = count * (chunk + 1) / chunkCount;
+			for (u32 i = count * chunk / chunkCount; i < end; ++i)
+				bucketMeshes[i]->Draw(chunkContext);
+			context.device->EndSecondaryRecording(chunkContext);
+		});
+		context.device->BeginSecondaryRecording(context, context.device->ReserveSecondaryLists(context, 1));
+		return chunkCount;
+	}
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <util/Type.h>
+#include <graphics/Geometry.h>
+
+namespace Graphics
+{
+	// the meshes drawn in a frame, each with a 64 bit key. sorting the keys groups draws sharing a pipeline variant,
+	// cull mode, material and vertex buffer, so the backend can skip the binds that would not change anything.
+	// opaque:      bucket 2 | variant 4 | double sided 1 | material 13 | vertex buffer 12 | distance 32, front to back
+	// transparent: bucket 2 | distance 32, back to front | variant 4 | double sided 1 | material 13 | vertex buffer 12
+	struct RenderQueue
+	{
+		// one per pass drawing from the queue. opaque and mask alpha are solid, transparent alpha is blended
+		enum class Bucket : u64 { SOLID = 0, BLENDED = 1 };
+
+		struct Item
+		{
+			u64 key;
+			GLTFMesh* mesh;
+		};
+
+		// fewer per chunk cost more in secondary command lists than recording them on another thread saves
+		static const u32 minDrawsPerChunk = 64;
+
+		Vector<Item> items;
+
+		void Clear() { items.clear(); }
+
+		// bucket from the material's alpha mode, distance from the node's origin
+		void Push(GLTFMesh& mesh, const vec3& cameraPosition);
+
+		// lsd radix sort on the keys, a byte per pass. passes where every key has the same byte are skipped
+		void Sort();
+
+		// draws the items of the bucket in queue order with the context's pass. with more than one chunk the items are split
+		// into up to that many consecutive ranges, each recorded on its own thread into a secondary command list executed
+		// in queue order. the pass must then have been begun for secondary lists, the context continues in a new list
+		// so its later draws execute after the chunks. returns the number of chunks used
+		u32 Draw(RenderContext& context, Bucket bucket, u32 maxChunks = 1);
+
+		static u64 MakeKey(GLTFMesh& mesh, const vec3& cameraPosition);
+
+	private:
+		// the meshes of the bucket being drawn
+		Vector<GLTFMesh*> bucketMeshes;
+	};
+}
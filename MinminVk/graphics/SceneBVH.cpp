@@ -0,0 +1,299 @@
+#include "SceneBVH.h"
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+namespace Graphics
+{
+	namespace
+	{
+		const u32 binCount = 16;
+		// deeper ranges are split at the median, so a bad distribution cannot make the recursion linear
+		const u32 maxSahDepth = 48;
+
+		f32 Area(const Math::AABB& box)
+		{
+			if (box.IsEmpty())
+				return 0.f;
+			const vec3 size = box.max - box.min;
+			return 2.f * (size.x * size.y + size.y * size.z + size.z * size.x);
+		}
+
+		// distances along the ray where it enters and leaves the box
+		bool RayBox(const Math::AABB& box, const vec3& origin, const vec3& inverseDirection, f32& enter, f32& exit)
+		{
+			const vec3 t0 = (box.min - origin) * inverseDirection;
+			const vec3 t1 = (box.max - origin) * inverseDirection;
+			const vec3 closest = glm::min(t0, t1);
+			const vec3 farthest = glm::max(t0, t1);
+			enter = Max(Max(closest.x, closest.y), closest.z);
+			exit = Min(Min(farthest.x, farthest.y), farthest.z);
+			return enter <= exit;
+		}
+
+		f32 ElapsedMs(std::chrono::high_resolution_clock::time_point start)
+		{
+			return std::chrono::duration<f32, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+		}
+	}
+
+	void SceneBVH::Build(const Vector<Math::AABB>& objectBounds)
+	{
+		const u32 count = static_cast<u32>(objectBounds.size());
+		nodes.clear();
+		dirtyLeaves.clear();
+		leaves.assign(count, INVALID);
+		if (count == 0)
+			return;
+
+		Vector<vec3> centers(count);
+		Vector<u32> objects(count);
+		for (u32 i = 0; i < count; ++i)
+		{
+			centers[i] = (objectBounds[i].min + objectBounds[i].max) * 0.5f;
+			objects[i] = i;
+		}
+		// no reallocation while the recursion holds indices
+		nodes.reserve(count * 2 - 1);
+		BuildRange(objectBounds, centers, objects.data(), count, INVALID, 0);
+	}
+
+	u32 SceneBVH::BuildRange(const Vector<Math::AABB>& objectBounds, const Vector<vec3>& centers, u32* objects, u32 count, u32 parent, u32 depth)
+	{
+		const u32 index = static_cast<u32>(nodes.size());
+		nodes.push_back(Node{ Math::AABB{}, index + 1, parent, INVALID });
+		if (count == 1)
+		{
+			nodes[index].bounds = objectBounds[objects[0]];
+			nodes[index].object = objects[0];
+			leaves[objects[0]] = index;
+			return index;
+		}
+
+		Math::AABB centerBounds;
+		for (u32 i = 0; i < count; ++i)
+			centerBounds.Extend(centers[objects[i]]);
+		const vec3 centerExtent = centerBounds.max - centerBounds.min;
+
+		// cost of a split is the area of each side times its object count, evaluated at the bin borders
+		u32 bestAxis = 0;
+		u32 bestBin = 0;
+		f32 bestCost = std::numeric_limits<f32>::max();
+		for (u32 axis = 0; axis < 3 && depth < maxSahDepth; ++axis)
+		{
+			if (centerExtent[axis] <= 0.f)
+				continue;
+			const f32 scale = binCount / centerExtent[axis] * 0.9999f;
+			Math::AABB binBounds[binCount];
+			u32 binCounts[binCount] = {};
+			for (u32 i = 0; i < count; ++i)
+			{
+				u32 bin = Min(static_cast<u32>((centers[objects[i]][axis] - centerBounds.min[axis]) * scale), binCount - 1);
+				binCounts[bin]++;
+				binBounds[bin].Extend(objectBounds[objects[i]]);
+			}
+			f32 rightAreas[binCount];
+			u32 rightCounts[binCount];
+			Math::AABB side;
+			u32 sideCount = 0;
+			for (u32 bin = binCount - 1; bin > 0; --bin)
+			{
+				side.Extend(binBounds[bin]);
+				sideCount += binCounts[bin];
+				rightAreas[bin] = Area(side);
+				rightCounts[bin] = sideCount;
+			}
+			side = Math::AABB{};
+			sideCount = 0;
+			for (u32 bin = 0; bin < binCount - 1; ++bin)
+			{
+				side.Extend(binBounds[bin]);
+				sideCount += binCounts[bin];
+				if (sideCount == 0 || rightCounts[bin + 1] == 0)
+					continue;
+				f32 cost = Area(side) * sideCount + rightAreas[bin + 1] * rightCounts[bin + 1];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = bin;
+				}
+			}
+		}
+
+		u32 middle = count / 2;
+		if (bestCost < std::numeric_limits<f32>::max())
+		{
+			const f32 scale = binCount / centerExtent[bestAxis] * 0.9999f;
+			const f32 start = centerBounds.min[bestAxis];
+			u32* split = std::partition(objects, objects + count, [&](u32 object)
+			{
+				return Min(static_cast<u32>((centers[object][bestAxis] - start) * scale), binCount - 1) <= bestBin;
+			});
+			middle = static_cast<u32>(split - objects);
+		}
+		else
+		{
+			// too deep or no bin border with objects on both sides
+			u32 axis = centerExtent.x >= centerExtent.y && centerExtent.x >= centerExtent.z ? 0 : centerExtent.y >= centerExtent.z ? 1 : 2;
+			std::nth_element(objects, objects + middle, objects + count, [&](u32 a, u32 b) { return centers[a][axis] < centers[b][axis]; });
+		}
+
+		BuildRange(objectBounds, centers, objects, middle, index, depth + 1);
+		u32 right = BuildRange(objectBounds, centers, objects + middle, count - middle, index, depth + 1);
+		nodes[index].bounds = nodes[index + 1].bounds;
+		nodes[index].bounds.Extend(nodes[right].bounds);
+		nodes[index].skip = static_cast<u32>(nodes.size());
+		return index;
+	}
+
+	void SceneBVH::Update(u32 object, const Math::AABB& bounds)
+	{
+		Node& leaf = nodes[leaves[object]];
+		if (leaf.bounds.min == bounds.min && leaf.bounds.max == bounds.max)
+			return;
+		leaf.bounds = bounds;
+		dirtyLeaves.push_back(leaves[object]);
+	}
+
+	void SceneBVH::Refit()
+	{
+		for (u32 leaf : dirtyLeaves)
+		{
+			u32 index = nodes[leaf].parent;
+			while (index != INVALID)
+			{
+				Node& node = nodes[index];
+				Math::AABB bounds = nodes[index + 1].bounds;
+				bounds.Extend(nodes[nodes[index + 1].skip].bounds);
+				// the ancestors already contain this box
+				if (bounds.min == node.bounds.min && bounds.max == node.bounds.max)
+					break;
+				node.bounds = bounds;
+				index = node.parent;
+			}
+		}
+		dirtyLeaves.clear();
+	}
+
+	bool SceneBVH::Raycast(const vec3& origin, const vec3& direction, f32 maxDistance, u32& object, f32& distance) const
+	{
+		const vec3 inverseDirection = 1.f / direction;
+		f32 nearest = maxDistance;
+		bool hit = false;
+		const u32 count = static_cast<u32>(nodes.size());
+		u32 i = 0;
+		while (i < count)
+		{
+			const Node& node = nodes[i];
+			f32 enter, exit;
+			if (!RayBox(node.bounds, origin, inverseDirection, enter, exit) || exit < 0.f || enter >= nearest)
+			{
+				i = node.skip;
+				continue;
+			}
+			if (node.object != INVALID && enter > 0.f)
+			{
+				nearest = enter;
+				object = node.object;
+				hit = true;
+			}
+			++i;
+		}
+		if (hit)
+			distance = nearest;
+		return hit;
+	}
+
+	SceneBVH::BenchmarkResult SceneBVH::Benchmark(u32 objectCount)
+	{
+		BenchmarkResult result;
+		result.objectCount = objectCount;
+		std::mt19937 random(0);
+		std::uniform_real_distribution<f32> uniform(0.f, 1.f);
+
+		// about one object per 64 cubic units, boxes up to 2 units wide
+		const f32 side = std::cbrt(static_cast<f32>(objectCount)) * 4.f;
+		Vector<Math::AABB> bounds(objectCount);
+		for (auto& box : bounds)
+		{
+			vec3 center = vec3(uniform(random), uniform(random), uniform(random)) * side;
+			vec3 extent = vec3(0.1f) + vec3(uniform(random), uniform(random), uniform(random)) * 0.9f;
+			box.min = center - extent;
+			box.max = center + extent;
+		}
+
+		SceneBVH bvh;
+		auto start = std::chrono::high_resolution_clock::now();
+		bvh.Build(bounds);
+		result.buildMs = ElapsedMs(start);
+
+		const u32 movedCount = objectCount / 10;
+		Vector<u32> moved(movedCount);
+		for (u32 i = 0; i < movedCount; ++i)
+		{
+			moved[i] = static_cast<u32>(uniform(random) * (objectCount - 1));
+			vec3 offset = (vec3(uniform(random), uniform(random), uniform(random)) - 0.5f) * 2.f;
+			bounds[moved[i]].min += offset;
+			bounds[moved[i]].max += offset;
+		}
+		start = std::chrono::high_resolution_clock::now();
+		for (u32 object : moved)
+			bvh.Update(object, bounds[object]);
+		bvh.Refit();
+		result.refitMs = ElapsedMs(start);
+
+		// cameras in the middle of the volume looking around, seeing half of it
+		const u32 frustumCount = 16;
+		const vec3 eye = vec3(side * 0.5f);
+		const mat4 projection = Math::Perspective(Math::Radians(60.f), 1920, 1080, 0.1f, side * 0.5f);
+		Vector<Math::Frustum> frustums;
+		for (u32 i = 0; i < frustumCount; ++i)
+		{
+			vec3 direction = Math::Rotate(vec3(0, 0, -1), i * 2.f * Math::PI / frustumCount, vec3(0, 1, 0));
+			frustums.emplace_back(projection * Math::LookAt(eye, eye + direction, vec3(0, 1, 0)));
+		}
+		u32 visible = 0;
+		start = std::chrono::high_resolution_clock::now();
+		for (auto& frustum : frustums)
+			bvh.QueryFrustum(frustum, [&](u32) { visible++; });
+		result.frustumMs = ElapsedMs(start) / frustumCount;
+		u32 linearVisible = 0;
+		start = std::chrono::high_resolution_clock::now();
+		for (auto& frustum : frustums)
+			for (auto& box : bounds)
+				linearVisible += frustum.Intersects(box) ? 1 : 0;
+		result.linearFrustumMs = ElapsedMs(start) / frustumCount;
+		// both test the same boxes after the refit
+		assert(visible == linearVisible);
+		result.visibleObjects = visible / frustumCount;
+
+		const u32 queryCount = 1000;
+		Vector<vec3> points(queryCount);
+		Vector<vec3> directions(queryCount);
+		for (u32 i = 0; i < queryCount; ++i)
+		{
+			points[i] = vec3(uniform(random), uniform(random), uniform(random)) * side;
+			directions[i] = Math::Normalize(vec3(uniform(random), uniform(random), uniform(random)) - 0.5f);
+		}
+		u32 nearby = 0;
+		start = std::chrono::high_resolution_clock::now();
+		for (auto& point : points)
+			bvh.QuerySphere(point, 8.f, [&](u32, f32) { nearby++; });
+		result.sphereMs = ElapsedMs(start) / queryCount;
+		u32 hits = 0;
+		start = std::chrono::high_resolution_clock::now();
+		for (u32 i = 0; i < queryCount; ++i)
+		{
+			u32 object;
+			f32 distance;
+			hits += bvh.Raycast(points[i], directions[i], side, object, distance) ? 1 : 0;
+		}
+		result.raycastMs = ElapsedMs(start) / queryCount;
+
+		DebugPrint("scene bvh %u objects: build %.2f ms, refit %u moved %.3f ms, frustum %.3f ms (linear %.3f ms, %u visible), sphere %.4f ms (%u found), ray %.4f ms (%u hits)\n",
+			objectCount, result.buildMs, movedCount, result.refitMs, result.frustumMs, result.linearFrustumMs, result.visibleObjects,
+			result.sphereMs, nearby / queryCount, result.raycastMs, hits);
+		return result;
+	}
+}
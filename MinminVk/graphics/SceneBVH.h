@@ -0,0 +1,122 @@
+#pragma once
+
+#include <util/Type.h>
+#include <util/Math.h>
+
+namespace Graphics
+{
+	// binary bounding volume hierarchy over world space boxes, one object per leaf. objects are indices into the caller's list.
+	// nodes are stored depth first: the left child follows its parent and each node keeps the index past its subtree,
+	// so traversal needs no stack and a subtree fully inside a query is a contiguous range.
+	// built top down with a binned surface area heuristic, moved objects are refit bottom up along their ancestors only.
+	// boxes of objects that move a lot grow loose, so build again when objects are added or the culling gets worse
+	struct SceneBVH
+	{
+		static const u32 INVALID = ~0u;
+
+		struct Node
+		{
+			Math::AABB bounds;
+			// first node after this subtree. the right child is the left child's skip
+			u32 skip;
+			u32 parent;
+			// INVALID for inner nodes
+			u32 object;
+		};
+
+		Vector<Node> nodes;
+		// leaf node of each object
+		Vector<u32> leaves;
+
+		void Build(const Vector<Math::AABB>& objectBounds);
+
+		u32 GetObjectCount() const { return static_cast<u32>(leaves.size()); }
+
+		// new bounds for an object, the ancestors are fixed by the next Refit
+		void Update(u32 object, const Math::AABB& bounds);
+
+		// grows or shrinks the ancestors of the updated leaves, stopping at the first one that does not change
+		void Refit();
+
+		// objects with boxes intersecting the frustum. subtrees inside the frustum are taken without more tests
+		template<typename Visit>
+		void QueryFrustum(const Math::Frustum& frustum, Visit&& visit) const
+		{
+			const u32 count = static_cast<u32>(nodes.size());
+			u32 i = 0;
+			while (i < count)
+			{
+				const Node& node = nodes[i];
+				Math::Frustum::Overlap overlap = frustum.Classify(node.bounds);
+				if (overlap == Math::Frustum::Overlap::OUTSIDE)
+				{
+					i = node.skip;
+					continue;
+				}
+				if (overlap == Math::Frustum::Overlap::INSIDE)
+				{
+					for (u32 k = i; k < node.skip; ++k)
+						if (nodes[k].object != INVALID)
+							visit(nodes[k].object);
+					i = node.skip;
+					continue;
+				}
+				if (node.object != INVALID)
+					visit(node.object);
+				++i;
+			}
+		}
+
+		// objects with boxes closer than radius to the point, with the distance to the box. zero when the point is inside
+		template<typename Visit>
+		void QuerySphere(const vec3& center, f32 radius, Visit&& visit) const
+		{
+			const f32 radiusSquared = radius * radius;
+			const u32 count = static_cast<u32>(nodes.size());
+			u32 i = 0;
+			while (i < count)
+			{
+				const Node& node = nodes[i];
+				const f32 distanceSquared = DistanceSquared(node.bounds, center);
+				if (distanceSquared > radiusSquared)
+				{
+					i = node.skip;
+					continue;
+				}
+				if (node.object != INVALID)
+					visit(node.object, std::sqrt(distanceSquared));
+				++i;
+			}
+		}
+
+		// nearest object whose box the ray enters before maxDistance. boxes around the origin are skipped,
+		// so picking from inside a room finds what is in it rather than the room
+		bool Raycast(const vec3& origin, const vec3& direction, f32 maxDistance, u32& object, f32& distance) const;
+
+		static f32 DistanceSquared(const Math::AABB& box, const vec3& point)
+		{
+			const vec3 offset = glm::max(glm::max(box.min - point, point - box.max), vec3(0));
+			return glm::dot(offset, offset);
+		}
+
+		struct BenchmarkResult
+		{
+			u32 objectCount = 0;
+			f32 buildMs = 0;
+			f32 refitMs = 0;
+			f32 frustumMs = 0;
+			f32 linearFrustumMs = 0;
+			f32 sphereMs = 0;
+			f32 raycastMs = 0;
+			u32 visibleObjects = 0;
+		};
+
+		// random boxes at a constant density, a tenth of them moved before the refit. query times are per query
+		static BenchmarkResult Benchmark(u32 objectCount);
+
+	private:
+		Vector<u32> dirtyLeaves;
+
+		u32 BuildRange(const Vector<Math::AABB>& objectBounds, const Vector<vec3>& centers, u32* objects, u32 count, u32 parent, u32 depth);
+	};
+}
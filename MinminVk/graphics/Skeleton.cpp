@@ -0,0 +1,201 @@
+#include "Skeleton.h"
+#include <graphics/Node.h>
+#include <util/Math.h>
+#include <util/Jobs.h>
+#include <chrono>
+#include <random>
+
+namespace Graphics
+{
+	namespace
+	{
+		f32 ElapsedMs(std::chrono::high_resolution_clock::time_point start)
+		{
+			return std::chrono::duration<f32, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+		}
+
+		struct BenchmarkRig
+		{
+			Vector<i32> parents;
+			Vector<mat4> locals;
+			Vector<mat4> inverseBinds;
+			Vector<mat4> models;
+			Vector<mat4> palette;
+		};
+
+		template<bool affine>
+		void UpdateBenchmarkRig(BenchmarkRig& rig)
+		{
+			const u32 numJoints = static_cast<u32>(rig.parents.size());
+			for (u32 i = 0; i < numJoints; ++i)
+			{
+				if (rig.parents[i] < 0)
+					rig.models[i] = rig.locals[i];
+				else if (affine)
+					Math::MulAffine(rig.models[rig.parents[i]], rig.locals[i], rig.models[i]);
+				else
+					rig.models[i] = rig.models[rig.parents[i]] * rig.locals[i];
+			}
+			for (u32 i = 0; i < numJoints; ++i)
+			{
+				if (affine)
+					Math::MulAffine(rig.models[i], rig.inverseBinds[i], rig.palette[i]);
+				else
+					rig.palette[i] = rig.models[i] * rig.inverseBinds[i];
+			}
+		}
+	}
+
+	u32 Skeleton::AddJoint(i32 parentIndex, const mat4& localMatrix, const Vector<SharedPtr<Animation>>& animations)
+	{
+		assert(parentIndex < static_cast<i32>(GetJointCount()));
+		u32 joint = GetJointCount();
+
+		JointPose pose;
+		Math::Decompose(localMatrix, pose.translation, pose.rotation, pose.scale);
+		parentIndices.push_back(parentIndex);
+		localPose.push_back(pose);
+		modelPose.push_back(parentIndex < 0 ? localMatrix : modelPose[parentIndex] * localMatrix);
+
+		for (auto& anim : animations)
+		{
+			if (anim->animationType == Animation::AnimationType::WEIGHTS)
+				continue;
+			channels.push_back(Channel{ joint, anim });
+			if (anim->minInput > minAnimationTime)
+				minAnimationTime = anim->minInput;
+			if (anim->maxInput < maxAnimationTime)
+				maxAnimationTime = anim->maxInput;
+		}
+		return joint;
+	}
+
+	void Skeleton::AddAttachment(u32 joint, SharedPtr<Node> node)
+	{
+		node->modelMatrix = modelPose[joint];
+		node->isDirty = true;
+		attachments.push_back(Attachment{ joint, node });
+	}
+
+	void Skeleton::Update(f32 deltaTime)
+	{
+		timer += deltaTime;
+		if (timer > maxAnimationTime)
+			timer = minAnimationTime;
+
+		// channels only overwrite the components they animate, the rest keeps the bind pose
+		for (auto& channel : channels)
+		{
+			JointPose& pose = localPose[channel.joint];
+			vec4 sample = channel.animation->Sample(timer);
+			if (channel.animation->animationType == Animation::AnimationType::ROTATION)
+				pose.rotation = quat(sample.x, sample.y, sample.z, sample.w);
+			else if (channel.animation->animationType == Animation::AnimationType::TRANSLATION)
+				pose.translation = vec3(sample);
+			else
+				pose.scale = vec3(sample);
+		}
+
+		const u32 numJoints = GetJointCount();
+		const i32* parents = parentIndices.data();
+		const JointPose* locals = localPose.data();
+		mat4* models = modelPose.data();
+		for (u32 i = 0; i < numJoints; ++i)
+		{
+			mat3 rotation = glm::mat3_cast(locals[i].rotation);
+			mat4 local(
+				vec4(rotation[0] * locals[i].scale.x, 0),
+				vec4(rotation[1] * locals[i].scale.y, 0),
+				vec4(rotation[2] * locals[i].scale.z, 0),
+				vec4(locals[i].translation, 1));
+			if (parents[i] < 0)
+				models[i] = local;
+			else
+				Math::MulAffine(models[parents[i]], local, models[i]);
+		}
+
+		for (auto& attachment : attachments)
+		{
+			attachment.node->modelMatrix = modelPose[attachment.joint];
+			attachment.node->isDirty = true;
+		}
+	}
+
+	void Skin::Update()
+	{
+		if (skeleton == nullptr)
+			return;
+
+		mat4 skeletonToMesh;
+		Math::MulAffine(Math::InverseAffine(node->worldMatrix), skeleton->rootNode->worldMatrix, skeletonToMesh);
+
+		const u32 numJoints = static_cast<u32>(jointIndices.size());
+		const mat4* models = skeleton->modelPose.data();
+		bool paletteChanged = false;
+		for (u32 i = 0; i < numJoints; ++i)
+		{
+			mat4 jointToMesh;
+			mat4 skinMatrix;
+			Math::MulAffine(skeletonToMesh, models[jointIndices[i]], jointToMesh);
+			Math::MulAffine(jointToMesh, inverseBindMatrices[i], skinMatrix);
+			// exact compare, an idle or clamped pose produces the same bits every step
+			if (skinMatrix != palette[i])
+			{
+				palette[i] = skinMatrix;
+				paletteChanged = true;
+			}
+		}
+		if (paletteChanged)
+			paletteVersion++;
+	}
+
+	Skeleton::BenchmarkResult Skeleton::Benchmark(u32 characterCount, u32 jointCount)
+	{
+		BenchmarkResult result;
+		result.characterCount = characterCount;
+		result.jointCount = jointCount;
+		std::mt19937 random(0);
+		std::uniform_real_distribution<f32> uniform(-1.f, 1.f);
+
+		Vector<BenchmarkRig> rigs(characterCount);
+		for (auto& rig : rigs)
+		{
+			rig.parents.resize(jointCount);
+			rig.locals.resize(jointCount);
+			rig.inverseBinds.resize(jointCount);
+			rig.models.resize(jointCount);
+			rig.palette.resize(jointCount);
+			for (u32 i = 0; i < jointCount; ++i)
+			{
+				// parents come before their children, mostly the previous joint like a limb chain
+				rig.parents[i] = i == 0 ? -1 : static_cast<i32>(uniform(random) > 0.5f ? i - 1 : (i - 1) * (uniform(random) * 0.5f + 0.5f));
+				quat rotation = glm::normalize(quat(uniform(random), uniform(random), uniform(random), uniform(random)));
+				rig.locals[i] = Math::Translate(mat4(1), vec3(uniform(random), uniform(random), uniform(random))) * glm::mat4_cast(rotation);
+				rig.inverseBinds[i] = Math::InverseAffine(rig.locals[i]);
+			}
+		}
+
+		// a few repeats so one update is not dominated by the timer
+		const u32 repeats = 16;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (u32 r = 0; r < repeats; ++r)
+			for (auto& rig : rigs)
+				UpdateBenchmarkRig<false>(rig);
+		result.glmMs = ElapsedMs(start) / repeats;
+
+		start = std::chrono::high_resolution_clock::now();
+		for (u32 r = 0; r < repeats; ++r)
+			for (auto& rig : rigs)
+				UpdateBenchmarkRig<true>(rig);
+		result.affineMs = ElapsedMs(start) / repeats;
+
+		start = std::chrono::high_resolution_clock::now();
+		for (u32 r = 0; r < repeats; ++r)
+			Util::Jobs::ParallelFor(characterCount, [&](u32 i) { UpdateBenchmarkRig<true>(rigs[i]); });
+		result.parallelMs = ElapsedMs(start) / repeats;
+
+		DebugPrint("skin palettes %u characters of %u joints: glm %.3f ms, affine %.3f ms, affine on the job threads %.3f ms\n",
+			characterCount, jointCount, result.glmMs, result.affineMs, result.parallelMs);
+		return result;
+	}
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <util/Type.h>
+#include <graphics/Animation.h>
+
+namespace Graphics
+{
+	struct Node;
+
+	// compact joint hierarchy evaluated in one pass. joints are not scene nodes,
+	// only attachment points (joints with non joint children) get a Node
+	struct Skeleton
+	{
+		struct JointPose
+		{
+			vec3 translation = vec3(0);
+			quat rotation = quat(1, 0, 0, 0);
+			vec3 scale = vec3(1);
+		};
+
+		struct Channel
+		{
+			u32 joint;
+			SharedPtr<Animation> animation;
+		};
+
+		struct Attachment
+		{
+			u32 joint;
+			SharedPtr<Node> node;
+		};
+
+		// scene node the root joints are relative to. model pose is in this node's space
+		SharedPtr<Node> rootNode;
+
+		// parents always come before their children, -1 for root joints
+		Vector<i32> parentIndices;
+		Vector<JointPose> localPose;
+		Vector<mat4> modelPose;
+
+		Vector<Channel> channels;
+		Vector<Attachment> attachments;
+
+		f32 minAnimationTime = 0.f;
+		f32 maxAnimationTime = 5.f;
+		f32 timer = 0;
+
+		Skeleton(SharedPtr<Node> rootNode) : rootNode{ rootNode } {}
+
+		u32 GetJointCount() const
+		{
+			return static_cast<u32>(parentIndices.size());
+		}
+
+		u32 AddJoint(i32 parentIndex, const mat4& localMatrix, const Vector<SharedPtr<Animation>>& animations);
+
+		void AddAttachment(u32 joint, SharedPtr<Node> node);
+
+		void Update(f32 deltaTime);
+
+		struct BenchmarkResult
+		{
+			u32 characterCount = 0;
+			u32 jointCount = 0;
+			f32 glmMs = 0;
+			f32 affineMs = 0;
+			f32 parallelMs = 0;
+		};
+
+		// model pose and palette of random rigs, with glm 4x4 products, with MulAffine, and with MulAffine
+		// on the job threads. times are per update of all characters
+		static BenchmarkResult Benchmark(u32 characterCount, u32 jointCount);
+	};
+
+	// one per skinned mesh node, shared by all of its primitives
+	struct Skin
+	{
+		// node of the skinned mesh. palette is in this node's space
+		SharedPtr<Node> node;
+		SharedPtr<Skeleton> skeleton;
+
+		// skin joint index to skeleton joint index
+		Vector<u32> jointIndices;
+		Vector<mat4> inverseBindMatrices;
+		Vector<mat4> palette;
+		// first joint of this skin in the packed palette buffer
+		u32 paletteOffset = 0;
+		// bumped whenever the palette changes, so each buffer copy is written once per version
+		u32 paletteVersion = 0;
+
+		Skin(SharedPtr<Node> node, Vector<mat4>& inverseBindMatrices) : node{ node }, inverseBindMatrices{ inverseBindMatrices }
+		{
+			palette.resize(inverseBindMatrices.size(), mat4(1));
+		}
+
+		void SetSkeleton(SharedPtr<Skeleton> skeleton, Vector<u32>& jointIndices)
+		{
+			assert(jointIndices.size() == inverseBindMatrices.size());
+			this->skeleton = skeleton;
+			this->jointIndices = jointIndices;
+		}
+
+		void Update();
+	};
+}
@@ -11,9 +11,13 @@
 #include <graphics/Presentation.h>
 #include <graphics/Pipeline.h>
 #include <graphics/Geometry.h>
+#include <graphics/Crowd.h>
+#include <graphics/Culling.h>
+#include <graphics/IndirectDraw.h>
 #include <graphics/Import.h>
 #include <graphics/UIRender.h>
 #include <util/IO.h>
+#include <util/FreeListAllocator.h>
 
 namespace VulkanImpl
 {
@@ -61,23 +65,86 @@ namespace VulkanImpl
 	VkCommandPool commandPool;
 	Vector<VkCommandBuffer> commandBuffers;
 	Vector<VkCommandBuffer> computeCommandBuffers;
+	// range of a device memory block, see AllocateMemory
+	struct MemoryAllocation
+	{
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		u32 blockID = ~0u;
+	};
 	Vector<VkBuffer> vertexBuffers;
-	Vector<VkDeviceMemory> vertexBufferMemories;
+	Vector<MemoryAllocation> vertexBufferMemories;
 	Vector<VkBuffer> indexBuffers;
-	Vector<VkDeviceMemory > indexBufferMemories;
+	Vector<MemoryAllocation> indexBufferMemories;
+	// shared vertex and index buffers. meshes get a range of one instead of their own buffer and memory,
+	// so a pass binds them once and the allocation count stays far below maxMemoryAllocationCount
+	struct GeometryArena
+	{
+		u32 bufferID = ~0u;
+		Util::FreeListAllocator allocator;
+	};
+	const VkDeviceSize vertexArenaSize = 128 * 1024 * 1024;
+	const VkDeviceSize indexArenaSize = 32 * 1024 * 1024;
+	GeometryArena vertexArena;
+	GeometryArena indexArena;
 	Vector<VkBuffer> uniformBuffers;
-	Vector<VkDeviceMemory> uniformBufferMemories;
+	Vector<MemoryAllocation> uniformBufferMemories;
 	Vector<void*> uniformBuffersMapped;
 	Vector<VkDescriptorPool> descriptorPools;
 	Vector<Vector<VkDescriptorSet>> descriptorSetsPerPool;
+	// set 1 of every graphics pipeline: all material textures in one array, the material table and the draw transforms.
+	// the array is written after bind, loading a texture only fills a free slot
+	// lowered to the device's update after bind limits when the logical device is created
+	u32 maxBindlessTextures = 4096;
+	const u32 maxBindlessMaterials = 4096;
+	const u32 maxDrawTransforms = 16384;
+	int bindlessLayoutID = -1;
+	int bindlessPoolID = -1;
+	u32 bindlessSetID = 0;
+	// slot per image view and sampler pair, slot 0 is a white texel
+	Map<u64, u32> bindlessTextureSlots;
+	u32 bindlessMaterialCount = 0;
+	UniquePtr<Graphics::MaterialTableBuffer> materialTable;
+	UniquePtr<Graphics::TransformBuffer> transformBuffer;
+	// marked since the last frame was submitted
+	Vector<Graphics::PBRMaterial*> dirtyMaterials;
+	// pass set and pipeline layout last bound, the bindless set is bound with it
+	struct BoundDescriptorSets
+	{
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		VkDescriptorSet passSet = VK_NULL_HANDLE;
+	};
+	// per command buffer, indexed by its command list. the binds last recorded so unchanged ones are skipped, forgotten
+	// when recording starts. pipeline and cull mode are also forgotten at each pass. a cache line each since secondary
+	// command buffers are recorded on several threads
+	struct alignas(64) RecordingState
+	{
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		i32 cullMode = -1;
+		VkBuffer vertexBuffer = VK_NULL_HANDLE;
+		VkBuffer indexBuffer = VK_NULL_HANDLE;
+		BoundDescriptorSets descriptorSets;
+		// recorded since the last graphics submit
+		u32 binds = 0;
+		u32 draws = 0;
+	};
+	Vector<RecordingState> recordingStates;
+	// pool of each secondary command buffer, one buffer per pool so each can be recorded on its own thread.
+	// indexed by command list, null for the primaries in commandPool
+	Vector<VkCommandPool> commandBufferPools;
+	// multi draw indirect with a count buffer and a first instance
+	bool supportsIndirectDraw = false;
 	Vector<VkImage> textureImages;
-	Vector<VkDeviceMemory> textureImageMemories;
+	Vector<MemoryAllocation> textureImageMemories;
 	Vector<VkImageView> textureImageViews;
 	Vector<VkSampler> textureSamplers;
 	VkFormat depthFormatChosen;
 	VkImageView depthImageView;
 	Vector<VkBuffer> shaderStorageBuffers;
-	Vector<VkDeviceMemory> shaderStorageBufferMemories;
+	Vector<MemoryAllocation> shaderStorageBufferMemories;
+	// persistent mapping of host visible storage buffers, nullptr for device local ones
+	Vector<void*> shaderStorageBuffersMapped;
 	// imgui
 	VkCommandPool uiCommandPool;
 	Vector<VkCommandBuffer> uiCommandBuffers;
@@ -145,8 +212,188 @@ namespace VulkanImpl
 		throw std::runtime_error("failed to find suitable memory type!");
 	}
 
+	// resources are placed in large blocks per memory type instead of one vkAllocateMemory each, drivers limit
+	// the count to maxMemoryAllocationCount (often 4096). long lived resources use a free list per block,
+	// staging and readback buffers a linear block that rewinds once all of its ranges are freed
+	enum class MemoryPoolType { BUFFER, OPTIMAL_IMAGE, STAGING, DEDICATED };
+
+	struct MemoryBlock
+	{
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize size = 0;
+		u32 memoryTypeIndex = 0;
+		MemoryPoolType poolType = MemoryPoolType::BUFFER;
+		// host visible blocks stay mapped, a memory object can only be mapped once
+		u8* mapped = nullptr;
+		Util::FreeListAllocator allocator;
+		VkDeviceSize linearOffset = 0;
+		VkDeviceSize usedSize = 0;
+		u32 allocationCount = 0;
+	};
+
+	const VkDeviceSize deviceMemoryBlockSize = 64 * 1024 * 1024;
+	const VkDeviceSize hostMemoryBlockSize = 16 * 1024 * 1024;
+	Vector<MemoryBlock> memoryBlocks;
+
+	u32 CreateMemoryBlock(VkDeviceSize size, u32 memoryTypeIndex, MemoryPoolType poolType)
+	{
+		VkMemoryAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = size;
+		allocInfo.memoryTypeIndex = memoryTypeIndex;
+		VkDeviceMemory memory;
+		if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate device memory block!");
+		}
+
+		// reuse the slot of a freed dedicated block
+		u32 blockID = 0;
+		while (blockID < memoryBlocks.size() && memoryBlocks[blockID].memory != VK_NULL_HANDLE)
+			blockID++;
+		if (blockID == memoryBlocks.size())
+			memoryBlocks.emplace_back();
+		MemoryBlock& block = memoryBlocks[blockID];
+		block = MemoryBlock{};
+		block.memory = memory;
+		block.size = size;
+		block.memoryTypeIndex = memoryTypeIndex;
+		block.poolType = poolType;
+		block.allocator = Util::FreeListAllocator(size);
+
+		VkPhysicalDeviceMemoryProperties memProperties;
+		vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+		if (memProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+		{
+			void* data;
+			vkMapMemory(device, memory, 0, size, 0, &data);
+			block.mapped = static_cast<u8*>(data);
+		}
+		return blockID;
+	}
+
+	// offset in the block or invalidOffset
+	VkDeviceSize AllocateInBlock(MemoryBlock& block, VkDeviceSize size, VkDeviceSize alignment)
+	{
+		if (block.poolType == MemoryPoolType::STAGING)
+		{
+			VkDeviceSize offset = (block.linearOffset + alignment - 1) / alignment * alignment;
+			if (offset + size > block.size)
+				return Util::FreeListAllocator::invalidOffset;
+			block.linearOffset = offset + size;
+			return offset;
+		}
+		return block.allocator.Allocate(size, alignment);
+	}
+
+	// optimal tiling images get their own blocks so bufferImageGranularity never applies between neighbours
+	MemoryAllocation AllocateMemory(const VkMemoryRequirements& memRequirements, VkMemoryPropertyFlags properties, MemoryPoolType poolType)
+	{
+		u32 memoryTypeIndex = FindMemoryType(memRequirements.memoryTypeBits, properties);
+		const bool isHostVisible = (properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+		const VkDeviceSize blockSize = isHostVisible ? hostMemoryBlockSize : deviceMemoryBlockSize;
+
+		MemoryAllocation allocation;
+		allocation.size = memRequirements.size;
+		// large resources (render targets, the geometry arenas) would waste most of a shared block
+		if (memRequirements.size > blockSize / 2)
+		{
+			allocation.blockID = CreateMemoryBlock(memRequirements.size, memoryTypeIndex, MemoryPoolType::DEDICATED);
+			allocation.offset = 0;
+		}
+		else
+		{
+			for (u32 i = 0; i < memoryBlocks.size(); ++i)
+			{
+				MemoryBlock& block = memoryBlocks[i];
+				if (block.memory == VK_NULL_HANDLE || block.poolType != poolType || block.memoryTypeIndex != memoryTypeIndex)
+					continue;
+				VkDeviceSize offset = AllocateInBlock(block, memRequirements.size, memRequirements.alignment);
+				if (offset != Util::FreeListAllocator::invalidOffset)
+				{
+					allocation.blockID = i;
+					allocation.offset = offset;
+					break;
+				}
+			}
+			if (allocation.blockID == ~0u)
+			{
+				allocation.blockID = CreateMemoryBlock(blockSize, memoryTypeIndex, poolType);
+				allocation.offset = AllocateInBlock(memoryBlocks[allocation.blockID], memRequirements.size, memRequirements.alignment);
+			}
+		}
+
+		MemoryBlock& block = memoryBlocks[allocation.blockID];
+		block.allocationCount++;
+		block.usedSize += allocation.size;
+		allocation.memory = block.memory;
+		return allocation;
+	}
+
+	void FreeMemory(MemoryAllocation& allocation)
+	{
+		if (allocation.blockID == ~0u)
+			return;
+		MemoryBlock& block = memoryBlocks[allocation.blockID];
+		assert(block.memory == allocation.memory && block.allocationCount > 0);
+		block.allocationCount--;
+		block.usedSize -= allocation.size;
+		if (block.poolType == MemoryPoolType::DEDICATED)
+		{
+			vkFreeMemory(device, block.memory, nullptr);
+			block = MemoryBlock{};
+		}
+		else if (block.poolType == MemoryPoolType::STAGING)
+		{
+			if (block.allocationCount == 0)
+				block.linearOffset = 0;
+		}
+		else
+			block.allocator.Free(allocation.offset, allocation.size);
+		allocation = MemoryAllocation{};
+	}
+
+	void* MapMemory(const MemoryAllocation& allocation)
+	{
+		MemoryBlock& block = memoryBlocks[allocation.blockID];
+		assert(block.mapped != nullptr);
+		return block.mapped + allocation.offset;
+	}
+
+	Graphics::Device::MemoryStats GetMemoryStats()
+	{
+		Graphics::Device::MemoryStats stats;
+		u64 freeBytes = 0;
+		u64 fragmentedBytes = 0;
+		for (auto& block : memoryBlocks)
+		{
+			if (block.memory == VK_NULL_HANDLE)
+				continue;
+			stats.blockCount++;
+			stats.allocationCount += block.allocationCount;
+			stats.reservedBytes += block.size;
+			stats.usedBytes += block.usedSize;
+			if (block.poolType == MemoryPoolType::BUFFER || block.poolType == MemoryPoolType::OPTIMAL_IMAGE)
+			{
+				freeBytes += block.allocator.GetFreeSize();
+				fragmentedBytes += block.allocator.GetFreeSize() - block.allocator.GetLargestFreeBlock();
+			}
+		}
+		stats.fragmentation = freeBytes > 0 ? static_cast<f32>(fragmentedBytes) / freeBytes : 0.f;
+		return stats;
+	}
+
+	void FreeMemoryBlocks()
+	{
+		for (auto& block : memoryBlocks)
+		{
+			if (block.memory != VK_NULL_HANDLE)
+				vkFreeMemory(device, block.memory, nullptr);
+		}
+		memoryBlocks.clear();
+	}
+
 	void CreateImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, 
-		VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory, u32 mipLevels = 1,
+		VkMemoryPropertyFlags properties, VkImage& image, MemoryAllocation& imageMemory, u32 mipLevels = 1,
 		VkSampleCountFlagBits numSamples = VK_SAMPLE_COUNT_1_BIT, bool isCubemap = false) {
 		VkImageCreateInfo imageInfo{};
 		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -175,16 +422,9 @@ namespace VulkanImpl
 		VkMemoryRequirements memRequirements;
 		vkGetImageMemoryRequirements(device, image, &memRequirements);
 
-		VkMemoryAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		allocInfo.allocationSize = memRequirements.size;
-		allocInfo.memoryTypeIndex = FindMemoryType(memRequirements.memoryTypeBits, properties);
-
-		if (vkAllocateMemory(device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-			throw std::runtime_error("failed to allocate image memory!");
-		}
-
-		vkBindImageMemory(device, image, imageMemory, 0);
+		// linear images follow the same granularity rules as buffers
+		imageMemory = AllocateMemory(memRequirements, properties, tiling == VK_IMAGE_TILING_OPTIMAL ? MemoryPoolType::OPTIMAL_IMAGE : MemoryPoolType::BUFFER);
+		vkBindImageMemory(device, image, imageMemory.memory, imageMemory.offset);
 	}
 
 	void CreateSurface(GLFWwindow* window)
@@ -264,7 +504,8 @@ namespace VulkanImpl
 			tiling = VK_IMAGE_TILING_LINEAR;
 		if (presentation->depthTilingType == Graphics::Texture::TilingType::OPTIMAL)
 			tiling = VK_IMAGE_TILING_OPTIMAL;
-		const auto& features = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT;
+		// sampled by the depth pyramid build
+		const auto& features = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
 		for (VkFormat format : candidates) 
 		{
 			VkFormatProperties props;
@@ -281,25 +522,25 @@ namespace VulkanImpl
 		{
 			// depth resources already exist
 			VkImage& depthImage = textureImages[presentation->depthTextureID.id];
-			VkDeviceMemory& depthImageMemory = textureImageMemories[presentation->depthTextureID.memoryID];
+			MemoryAllocation& depthImageMemory = textureImageMemories[presentation->depthTextureID.memoryID];
 			VkImageView& depthImageView = textureImageViews[presentation->depthTextureID.viewID];
 			vkDestroyImage(VulkanImpl::device, depthImage, nullptr);
-			vkFreeMemory(VulkanImpl::device, depthImageMemory, nullptr);
+			FreeMemory(depthImageMemory);
 			vkDestroyImageView(device, depthImageView, nullptr);
-			CreateImage(swapChainExtent.width, swapChainExtent.height, depthFormatChosen, tiling, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			CreateImage(swapChainExtent.width, swapChainExtent.height, depthFormatChosen, tiling, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 				depthImage, depthImageMemory, 1, msaaSamples);
 			depthImageView = CreateImageView(depthImage, depthFormatChosen, VK_IMAGE_ASPECT_DEPTH_BIT);
 		}
 		else
 		{
 			VkImage& depthImage = textureImages.emplace_back();
-			VkDeviceMemory& depthImageMemory = textureImageMemories.emplace_back();
+			MemoryAllocation& depthImageMemory = textureImageMemories.emplace_back();
 			VkImageView& depthImageView = textureImageViews.emplace_back();
 			presentation->depthTextureID.id = textureImages.size() - 1;
 			presentation->depthTextureID.memoryID = textureImageMemories.size() - 1;
 			presentation->depthTextureID.viewID = textureImageViews.size() - 1;
 
-			CreateImage(swapChainExtent.width, swapChainExtent.height, depthFormatChosen, tiling, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
+			CreateImage(swapChainExtent.width, swapChainExtent.height, depthFormatChosen, tiling, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
 				depthImage, depthImageMemory, 1, msaaSamples);
 			depthImageView = CreateImageView(depthImage, depthFormatChosen, VK_IMAGE_ASPECT_DEPTH_BIT);
 		}
@@ -696,6 +937,44 @@ namespace VulkanImpl
 		localread.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_LOCAL_READ_FEATURES_KHR;
 		localread.dynamicRenderingLocalRead = true;
 		sync2.pNext = &localread;
+		VkPhysicalDeviceDescriptorIndexingFeatures supportedIndexing{};
+		supportedIndexing.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+		VkPhysicalDeviceVulkan12Features supported12{};
+		supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+		supported12.pNext = &supportedIndexing;
+		VkPhysicalDeviceFeatures2 supported{};
+		supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		supported.pNext = &supported12;
+		vkGetPhysicalDeviceFeatures2(physicalDevice, &supported);
+
+		// bindless material set, every draw reads its textures from one array. there is no per-mesh set to fall back to
+		if (!supported.features.shaderSampledImageArrayDynamicIndexing || !supportedIndexing.runtimeDescriptorArray ||
+			!supportedIndexing.descriptorBindingPartiallyBound || !supportedIndexing.descriptorBindingSampledImageUpdateAfterBind)
+		{
+			throw std::runtime_error("device does not support the descriptor indexing features of the bindless material set!");
+		}
+		VkPhysicalDeviceDescriptorIndexingProperties indexingProperties{};
+		indexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+		VkPhysicalDeviceProperties2 properties{};
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties.pNext = &indexingProperties;
+		vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+		// combined image samplers count as both samplers and sampled images
+		maxBindlessTextures = Min(maxBindlessTextures, Min(indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers,
+			Min(indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages, indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages)));
+		// the 1.2 struct replaces the descriptor indexing one, both cannot be chained
+		deviceFeatures.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+		VkPhysicalDeviceVulkan12Features vulkan12Features{};
+		vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+		vulkan12Features.runtimeDescriptorArray = VK_TRUE;
+		vulkan12Features.descriptorBindingPartiallyBound = VK_TRUE;
+		vulkan12Features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+		localread.pNext = &vulkan12Features;
+		// gpu culled draws, each command picks its draw object with firstInstance
+		supportsIndirectDraw = supported.features.multiDrawIndirect && supported.features.drawIndirectFirstInstance && supported12.drawIndirectCount;
+		deviceFeatures.multiDrawIndirect = supportsIndirectDraw ? VK_TRUE : VK_FALSE;
+		deviceFeatures.drawIndirectFirstInstance = supportsIndirectDraw ? VK_TRUE : VK_FALSE;
+		vulkan12Features.drawIndirectCount = supportsIndirectDraw ? VK_TRUE : VK_FALSE;
 
 		createInfo.pNext = &dynamicRenderFeature;
 		createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
@@ -804,7 +1083,7 @@ namespace VulkanImpl
 
 	}
 
-	void CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory)
+	void CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, MemoryAllocation& bufferMemory)
 	{
 		VkBufferCreateInfo bufferInfo{};
 		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -819,63 +1098,185 @@ namespace VulkanImpl
 		VkMemoryRequirements memRequirements;
 		vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
 
-		VkMemoryAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		allocInfo.allocationSize = memRequirements.size;
-		allocInfo.memoryTypeIndex = FindMemoryType(memRequirements.memoryTypeBits, properties);
-		if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-			throw std::runtime_error("failed to allocate vertex buffer memory!");
+		// only copied from or to, freed right after the copy
+		const bool isStaging = (usage & ~(VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT)) == 0;
+		bufferMemory = AllocateMemory(memRequirements, properties, isStaging ? MemoryPoolType::STAGING : MemoryPoolType::BUFFER);
+		vkBindBufferMemory(device, buffer, bufferMemory.memory, bufferMemory.offset);
+	}
+
+	// load time transfers are recorded into one command buffer and submitted together before the next frame,
+	// or when the staging ring wraps. graphics and compute share the queue, so submission order and the barrier
+	// at the end of the batch make the results visible without waiting. two batches alternate so one can be
+	// recorded while the other executes
+	struct UploadBatch
+	{
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		VkFence fence = VK_NULL_HANDLE;
+		bool isSubmitted = false;
+		// staging buffers larger than the ring, freed once the batch has executed
+		Vector<std::pair<VkBuffer, MemoryAllocation>> largeStagingBuffers;
+	};
+
+	// source of a copy, persistently mapped
+	struct StagingRange
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		u8* data = nullptr;
+	};
+
+	const VkDeviceSize stagingRingSize = 64 * 1024 * 1024;
+	VkBuffer stagingRing = VK_NULL_HANDLE;
+	MemoryAllocation stagingRingMemory;
+	// ranges behind the head belong to recorded or executing batches, it only rewinds once they have all completed
+	VkDeviceSize stagingRingHead = 0;
+	UploadBatch uploadBatches[2];
+	u32 currentUploadBatch = 0;
+	bool isRecordingUploads = false;
+
+	void CompleteUploadBatch(UploadBatch& batch)
+	{
+		if (!batch.isSubmitted)
+			return;
+		vkWaitForFences(device, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+		vkResetFences(device, 1, &batch.fence);
+		for (auto& [buffer, memory] : batch.largeStagingBuffers)
+		{
+			vkDestroyBuffer(device, buffer, nullptr);
+			FreeMemory(memory);
 		}
-		vkBindBufferMemory(device, buffer, bufferMemory, 0);
+		batch.largeStagingBuffers.clear();
+		batch.isSubmitted = false;
 	}
 
-	VkCommandBuffer BeginSingleTimeCommands()
+	VkCommandBuffer GetUploadCommandBuffer()
 	{
-		VkCommandBufferAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		allocInfo.commandPool = commandPool;
-		allocInfo.commandBufferCount = 1;
+		UploadBatch& batch = uploadBatches[currentUploadBatch];
+		if (isRecordingUploads)
+			return batch.commandBuffer;
+
+		if (batch.commandBuffer == VK_NULL_HANDLE)
+		{
+			VkCommandBufferAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			allocInfo.commandPool = commandPool;
+			allocInfo.commandBufferCount = 1;
+			vkAllocateCommandBuffers(device, &allocInfo, &batch.commandBuffer);
+
+			VkFenceCreateInfo fenceInfo{};
+			fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+			if (vkCreateFence(device, &fenceInfo, nullptr, &batch.fence) != VK_SUCCESS)
+				throw std::runtime_error("failed to create upload fence!");
+		}
+		// submitted two flushes ago
+		CompleteUploadBatch(batch);
+		vkResetCommandBuffer(batch.commandBuffer, 0);
 
-		VkCommandBuffer commandBuffer;
-		vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
 		VkCommandBufferBeginInfo beginInfo{};
 		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-		vkBeginCommandBuffer(commandBuffer, &beginInfo);
-		return commandBuffer;
+		vkBeginCommandBuffer(batch.commandBuffer, &beginInfo);
+		isRecordingUploads = true;
+		return batch.commandBuffer;
 	}
 
-	void EndSingleTimeCommands(VkCommandBuffer commandBuffer) {
-		vkEndCommandBuffer(commandBuffer);
+	void FlushUploads()
+	{
+		if (!isRecordingUploads)
+			return;
+		UploadBatch& batch = uploadBatches[currentUploadBatch];
+
+		// later submissions on the queue see every transfer of the batch
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+		vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+		vkEndCommandBuffer(batch.commandBuffer);
 
 		VkSubmitInfo submitInfo{};
 		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &commandBuffer;
+		submitInfo.pCommandBuffers = &batch.commandBuffer;
+		if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, batch.fence) != VK_SUCCESS)
+			throw std::runtime_error("failed to submit upload command buffer!");
+
+		batch.isSubmitted = true;
+		isRecordingUploads = false;
+		currentUploadBatch = (currentUploadBatch + 1) % 2;
+	}
+
+	// blocks until every recorded transfer has executed, for readbacks
+	void WaitUploads()
+	{
+		FlushUploads();
+		for (auto& batch : uploadBatches)
+			CompleteUploadBatch(batch);
+	}
 
-		vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-		vkQueueWaitIdle(graphicsQueue);
+	StagingRange AllocateStaging(VkDeviceSize size, VkDeviceSize alignment = 16)
+	{
+		StagingRange range;
+		if (size > stagingRingSize)
+		{
+			// owned by the batch recording the copy
+			GetUploadCommandBuffer();
+			auto& [buffer, memory] = uploadBatches[currentUploadBatch].largeStagingBuffers.emplace_back();
+			CreateBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, buffer, memory);
+			range.buffer = buffer;
+			range.data = static_cast<u8*>(MapMemory(memory));
+			return range;
+		}
+
+		if (stagingRing == VK_NULL_HANDLE)
+			CreateBuffer(stagingRingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingRing, stagingRingMemory);
+		VkDeviceSize offset = (stagingRingHead + alignment - 1) / alignment * alignment;
+		if (offset + size > stagingRingSize)
+		{
+			WaitUploads();
+			offset = 0;
+		}
+		stagingRingHead = offset + size;
+		range.buffer = stagingRing;
+		range.offset = offset;
+		range.data = static_cast<u8*>(MapMemory(stagingRingMemory)) + offset;
+		return range;
+	}
 
-		vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+	void DestroyUploads()
+	{
+		WaitUploads();
+		for (auto& batch : uploadBatches)
+		{
+			if (batch.fence != VK_NULL_HANDLE)
+				vkDestroyFence(device, batch.fence, nullptr);
+			batch = UploadBatch{};
+		}
+		if (stagingRing != VK_NULL_HANDLE)
+		{
+			vkDestroyBuffer(device, stagingRing, nullptr);
+			FreeMemory(stagingRingMemory);
+			stagingRing = VK_NULL_HANDLE;
+		}
 	}
 
-	void CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) 
+	// recorded into the upload batch, WaitUploads before reading dstBuffer on the cpu
+	void CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize dstOffset = 0, VkDeviceSize srcOffset = 0) 
 	{
-		VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
+		VkCommandBuffer commandBuffer = GetUploadCommandBuffer();
 
 		VkBufferCopy copyRegion{};
 		copyRegion.size = size;
+		copyRegion.srcOffset = srcOffset;
+		copyRegion.dstOffset = dstOffset;
 		vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-
-		EndSingleTimeCommands(commandBuffer);
 	}
 
 	void TransitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, 
 		u32 mipLevels = 1, VkCommandBuffer * cmdBuffer = nullptr, VkAccessFlags srcAccessMask = -1, 
 		VkAccessFlags dstAccessMask = -1, VkPipelineStageFlags srcStage = -1, VkPipelineStageFlags dstStage = -1, bool isCubemap = false) {
-		VkCommandBuffer commandBuffer = cmdBuffer ? *cmdBuffer : BeginSingleTimeCommands();
+		VkCommandBuffer commandBuffer = cmdBuffer ? *cmdBuffer : GetUploadCommandBuffer();
 
 		VkImageMemoryBarrier barrier{};
 		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -927,9 +1328,57 @@ namespace VulkanImpl
 			0, nullptr,
 			1, &barrier
 		);
+	}
+
+	// compute output of an animated mesh, starts as the rest pose. only the dynamic attributes are written
+	void CreateTransformedVertexBuffer(Graphics::Geometry& geometry)
+	{
+		using BasicVertex = Graphics::BasicVertex;
+		auto vertexData = geometry.GetVertexData();
+		VkDeviceSize transformedBufferSize = vertexData->GetVerticesCount() * sizeof(BasicVertex::DynamicVertex);
+
+		StagingRange staging = AllocateStaging(transformedBufferSize);
+		void* data = staging.data;
+		const BasicVertex::Vertex* srcVertices = (const BasicVertex::Vertex*)vertexData->GetVertices();
+		BasicVertex::DynamicVertex* dstVertices = (BasicVertex::DynamicVertex*)data;
+		for (u32 i = 0; i < vertexData->GetVerticesCount(); ++i)
+			dstVertices[i] = BasicVertex::DynamicVertex{ srcVertices[i].pos, srcVertices[i].normal, srcVertices[i].tangent };
+
+		// transfer src to read the compute output back for validation
+		auto vbUsage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		geometry.transformedVertexBuffer = MakeShared<Graphics::VertexBuffer>(transformedBufferSize, Graphics::Buffer::AccessType::WRITE, true);
+		geometry.geometryID.transformedVertexBufferID = vertexBuffers.size();
+		geometry.transformedVertexBuffer->extendedBufferIDs.push_back(vertexBuffers.size());
+		VkBuffer transformedVertexBuffer;
+		MemoryAllocation transformedVertexBufferMemory;
+		CreateBuffer(transformedBufferSize, vbUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, transformedVertexBuffer, transformedVertexBufferMemory);
+		vertexBuffers.push_back(transformedVertexBuffer);
+		vertexBufferMemories.push_back(transformedVertexBufferMemory);
+		CopyBuffer(staging.buffer, transformedVertexBuffer, transformedBufferSize, 0, staging.offset);
+
+		geometry.transformedVertexBuffer->binding.binding = 1;
+		geometry.transformedVertexBuffer->binding.shaderStageType = Graphics::ResourceBinding::ShaderStageType::COMPUTE;
+	}
 
-		if (!cmdBuffer)
-			EndSingleTimeCommands(commandBuffer);
+	// offset of a range of size bytes in the arena, created on first use. invalidOffset when full
+	VkDeviceSize AllocateFromArena(GeometryArena& arena, Vector<VkBuffer>& buffers, Vector<MemoryAllocation>& memories, VkDeviceSize arenaSize, 
+		VkBufferUsageFlags usage, VkDeviceSize size, VkDeviceSize alignment)
+	{
+		if (arena.bufferID == ~0u)
+		{
+			VkBuffer buffer;
+			MemoryAllocation memory;
+			CreateBuffer(arenaSize, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, memory);
+			arena.bufferID = buffers.size();
+			buffers.push_back(buffer);
+			memories.push_back(memory);
+			arena.allocator = Util::FreeListAllocator(arenaSize);
+		}
+		VkDeviceSize offset = arena.allocator.Allocate(size, alignment);
+		if (offset == Util::FreeListAllocator::invalidOffset)
+			DebugPrint("geometry arena full (%llu of %llu KB free, largest block %llu KB), using a dedicated buffer\n", 
+				arena.allocator.GetFreeSize() / 1024, arena.allocator.GetSize() / 1024, arena.allocator.GetLargestFreeBlock() / 1024);
+		return offset;
 	}
 
 	void CreateVertexBuffer(Graphics::Geometry &geometry)
@@ -938,51 +1387,47 @@ namespace VulkanImpl
 		const u8* vertices = vertexData->GetVertices();
 		VkDeviceSize bufferSize = vertexData->GetVerticesCount() * vertexData->GetVertexSize();
 
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingBufferMemory;
-		CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-
-		void* data;
-		vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
+		StagingRange staging = AllocateStaging(bufferSize);
+		void* data = staging.data;
 		memcpy(data, vertices, (size_t)bufferSize);
-		vkUnmapMemory(device, stagingBufferMemory);
-
-		VkBuffer vertexBuffer;
-		VkDeviceMemory vertexBufferMemory;
-		auto vbUsage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
-		if (vertexData->hasBlends || vertexData->hasSkeleton)
-			vbUsage |= VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
-		CreateBuffer(bufferSize, vbUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
-		vertexBuffers.push_back(vertexBuffer);
-		vertexBufferMemories.push_back(vertexBufferMemory);
-		geometry.geometryID.vertexBufferID = vertexBuffers.size() - 1;
+
+		// animated meshes keep their own buffer, the vertex compute pass reads it as a storage buffer from 0
+		const bool isAnimated = vertexData->hasBlends || vertexData->hasSkeleton;
+		VkDeviceSize arenaOffset = Util::FreeListAllocator::invalidOffset;
+		if (!isAnimated)
+		{
+			// aligned to the stride so the range starts at a whole vertex
+			arenaOffset = AllocateFromArena(vertexArena, vertexBuffers, vertexBufferMemories, vertexArenaSize, 
+				VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, bufferSize, vertexData->GetVertexSize());
+		}
+		if (arenaOffset != Util::FreeListAllocator::invalidOffset)
+		{
+			geometry.geometryID.vertexBufferID = vertexArena.bufferID;
+			geometry.geometryID.vertexOffset = static_cast<u32>(arenaOffset / vertexData->GetVertexSize());
+			CopyBuffer(staging.buffer, vertexBuffers[vertexArena.bufferID], bufferSize, arenaOffset, staging.offset);
+		}
+		else
+		{
+			VkBuffer vertexBuffer;
+			MemoryAllocation vertexBufferMemory;
+			auto vbUsage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+			// source of the vertex compute pass
+			if (isAnimated)
+				vbUsage |= VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+			CreateBuffer(bufferSize, vbUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
+			vertexBuffers.push_back(vertexBuffer);
+			vertexBufferMemories.push_back(vertexBufferMemory);
+			geometry.geometryID.vertexBufferID = vertexBuffers.size() - 1;
+			geometry.geometryID.vertexOffset = 0;
+			CopyBuffer(staging.buffer, vertexBuffer, bufferSize, 0, staging.offset);
+		}
 		geometry.vertexBuffer = MakeShared<Graphics::VertexBuffer>(bufferSize, Graphics::Buffer::AccessType::READONLY, false);
 		geometry.vertexBuffer->extendedBufferIDs.push_back(geometry.geometryID.vertexBufferID);
 		geometry.vertexBuffer->binding.binding = 0;
 		geometry.vertexBuffer->binding.shaderStageType = Graphics::ResourceBinding::ShaderStageType::COMPUTE;
-		CopyBuffer(stagingBuffer, vertexBuffer, bufferSize);
-		if (vertexData->hasSkeleton || vertexData->hasBlends)
-		{
-			geometry.transformedVertexBuffer = MakeShared<Graphics::VertexBuffer>(bufferSize, Graphics::Buffer::AccessType::WRITE, true);
-			geometry.geometryID.transformedVertexBufferID = vertexBuffers.size();
-			//for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
-			{
-				geometry.transformedVertexBuffer->extendedBufferIDs.push_back(vertexBuffers.size());
-				VkBuffer transformedVertexBuffer;
-				VkDeviceMemory transformedVertexBufferMemory;
-				CreateBuffer(bufferSize, vbUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, transformedVertexBuffer, transformedVertexBufferMemory);
-				vertexBuffers.push_back(transformedVertexBuffer);
-				vertexBufferMemories.push_back(transformedVertexBufferMemory);
-				CopyBuffer(stagingBuffer, transformedVertexBuffer, bufferSize);
-			}
-			
-			geometry.transformedVertexBuffer->binding.binding = 1;
-			geometry.transformedVertexBuffer->binding.shaderStageType = Graphics::ResourceBinding::ShaderStageType::COMPUTE;
-
-		}
 
-		vkDestroyBuffer(device, stagingBuffer, nullptr);
-		vkFreeMemory(device, stagingBufferMemory, nullptr);
+		if (isAnimated)
+			CreateTransformedVertexBuffer(geometry);
 	}
 
 	void CreateIndexBuffer(Graphics::Geometry& geometry)
@@ -991,24 +1436,28 @@ namespace VulkanImpl
 
 		VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
 
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingBufferMemory;
-		CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-
-		void* data;
-		vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
+		StagingRange staging = AllocateStaging(bufferSize);
+		void* data = staging.data;
 		memcpy(data, indices.data(), (size_t)bufferSize);
-		vkUnmapMemory(device, stagingBufferMemory);
-
-		auto& indexBuffer = indexBuffers.emplace_back();
-		auto& indexBufferMemory = indexBufferMemories.emplace_back();
-		CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
-		geometry.geometryID.indexBufferID = indexBuffers.size() - 1;
 
-		CopyBuffer(stagingBuffer, indexBuffer, bufferSize);
+		VkDeviceSize arenaOffset = AllocateFromArena(indexArena, indexBuffers, indexBufferMemories, indexArenaSize, 
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, bufferSize, sizeof(indices[0]));
+		if (arenaOffset != Util::FreeListAllocator::invalidOffset)
+		{
+			geometry.geometryID.indexBufferID = indexArena.bufferID;
+			geometry.geometryID.firstIndex = static_cast<u32>(arenaOffset / sizeof(indices[0]));
+			CopyBuffer(staging.buffer, indexBuffers[indexArena.bufferID], bufferSize, arenaOffset, staging.offset);
+		}
+		else
+		{
+			auto& indexBuffer = indexBuffers.emplace_back();
+			auto& indexBufferMemory = indexBufferMemories.emplace_back();
+			CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
+			geometry.geometryID.indexBufferID = indexBuffers.size() - 1;
+			geometry.geometryID.firstIndex = 0;
 
-		vkDestroyBuffer(device, stagingBuffer, nullptr);
-		vkFreeMemory(device, stagingBufferMemory, nullptr);
+			CopyBuffer(staging.buffer, indexBuffer, bufferSize, 0, staging.offset);
+		}
 	}
 
 	void CreateUniformBuffer(Graphics::Buffer& buffer, int numBuffer)
@@ -1021,7 +1470,7 @@ namespace VulkanImpl
 			assert(uniformBuffers.size() == uniformBufferMemories.size() && uniformBuffers.size() == uniformBuffersMapped.size());
 			buffer.extendedBufferIDs.push_back(uniformBuffers.size() - 1);
 			CreateBuffer(buffer.GetBufferSize(), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffer, uniformBufferMemory);
-			vkMapMemory(device, uniformBufferMemory, 0, buffer.GetBufferSize(), 0, &uniformBufferMapped);
+			uniformBufferMapped = MapMemory(uniformBufferMemory);
 		}
 	}
 
@@ -1045,6 +1494,8 @@ namespace VulkanImpl
 			flags = flags == 0 ? VK_BUFFER_USAGE_INDEX_BUFFER_BIT : (flags | VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
 		if (EnumBitwiseAnd(bufferUsageType, Graphics::Buffer::BufferUsageType::BUFFER_UNIFORM))
 			flags = flags == 0 ? VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT : (flags | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+		if (EnumBitwiseAnd(bufferUsageType, Graphics::Buffer::BufferUsageType::BUFFER_INDIRECT))
+			flags = flags == 0 ? VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT : (flags | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
 		return flags;
 		
 	}
@@ -1054,14 +1505,9 @@ namespace VulkanImpl
 		if (bufferSize == 0)
 			return;
 		// Create a staging buffer used to upload data to the gpu
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingBufferMemory;
-		CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-
-		void* data;
-		vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
+		StagingRange staging = AllocateStaging(bufferSize);
+		void* data = staging.data;
 		memcpy(data, buffer->bufferData.data(), (size_t)bufferSize);
-		vkUnmapMemory(device, stagingBufferMemory);
 		for (int i = 0; i < (forAllFramesInFlight ? MAX_FRAMES_IN_FLIGHT : 1); ++i)
 		{
 			auto & shaderStorageBuffer = shaderStorageBuffers.emplace_back();
@@ -1073,10 +1519,22 @@ namespace VulkanImpl
 				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
 				shaderStorageBuffer, 
 				shaderStorageBufferMemory);
-			CopyBuffer(stagingBuffer, shaderStorageBuffer, bufferSize);
+			CopyBuffer(staging.buffer, shaderStorageBuffer, bufferSize, 0, staging.offset);
+		}
+	}
+
+	// storage buffer per frame in flight that the cpu writes every frame
+	void CreateMappedStorageBuffer(u32 bufferSize, Graphics::Buffer::BufferUsageType bufferUsageType, Graphics::Buffer& buffer)
+	{
+		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+		{
+			auto& shaderStorageBuffer = shaderStorageBuffers.emplace_back();
+			auto& shaderStorageBufferMemory = shaderStorageBufferMemories.emplace_back();
+			buffer.extendedBufferIDs.push_back(shaderStorageBuffers.size() - 1);
+			CreateBuffer(bufferSize, MapToVulkanBUfferUsageFlags(bufferUsageType), VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, shaderStorageBuffer, shaderStorageBufferMemory);
+			shaderStorageBuffersMapped.resize(shaderStorageBuffers.size(), nullptr);
+			shaderStorageBuffersMapped.back() = MapMemory(shaderStorageBufferMemory);
 		}
-		vkDestroyBuffer(device, stagingBuffer, nullptr);
-		vkFreeMemory(device, stagingBufferMemory, nullptr);
 	}
 
 	Graphics::PipeLineID CreateComputePipeline(SharedPtr<Graphics::Shader> computeShader, Graphics::ComputePipeline* pipeline, int layoutID)
@@ -1171,13 +1629,17 @@ namespace VulkanImpl
 		VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
 		vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 
-		const Graphics::VertexBinding &vertexBinding = pipeline->vertexDesc->GetVertexBinding();
+		const Vector<Graphics::VertexBinding> &vertexBindings = pipeline->vertexDesc->GetVertexBindings();
 		const Vector<Graphics::VertexAttribute>& vertexAttributes = pipeline->vertexDesc->GetVertexAttributes();
-		VkVertexInputBindingDescription bindingDescription{};
-		bindingDescription.binding = vertexBinding.binding;
-		bindingDescription.stride = vertexBinding.stride;
-		bindingDescription.inputRate = vertexBinding.inputRateType == Graphics::VertexBinding::InputRateType::VERTEX ?
-			VK_VERTEX_INPUT_RATE_VERTEX : VK_VERTEX_INPUT_RATE_INSTANCE;
+		Vector<VkVertexInputBindingDescription> bindingDescriptions;
+		for (const auto& vertexBinding : vertexBindings)
+		{
+			auto& bindingDescription = bindingDescriptions.emplace_back();
+			bindingDescription.binding = vertexBinding.binding;
+			bindingDescription.stride = vertexBinding.stride;
+			bindingDescription.inputRate = vertexBinding.inputRateType == Graphics::VertexBinding::InputRateType::VERTEX ?
+				VK_VERTEX_INPUT_RATE_VERTEX : VK_VERTEX_INPUT_RATE_INSTANCE;
+		}
 		Vector<VkVertexInputAttributeDescription> attributeDescriptionsVK;
 		for (const auto& attribute : vertexAttributes)
 		{
@@ -1200,9 +1662,9 @@ namespace VulkanImpl
 			else if (attribute.vertexFormatType == Graphics::VertexAttribute::VertexFormatType::UVEC4)
 				attributeDescVK.format = VK_FORMAT_R32G32B32A32_UINT;
 		}
-		vertexInputInfo.vertexBindingDescriptionCount = 1;
+		vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
 		vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptionsVK.size());
-		vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+		vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
 		vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptionsVK.data();
 
 		VkPipelineRasterizationStateCreateInfo rasterizer{};
@@ -1303,24 +1765,30 @@ namespace VulkanImpl
 		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
 		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 		pipelineLayoutInfo.setLayoutCount = 2;
-		VkDescriptorSetLayout layouts[] = { descriptorSetLayouts[pipeline->layoutID], descriptorSetLayouts[pipeline->perMeshLayoutID] };
+		VkDescriptorSetLayout layouts[] = { descriptorSetLayouts[pipeline->layoutID], descriptorSetLayouts[bindlessLayoutID] };
 		pipelineLayoutInfo.pSetLayouts = layouts;
 
-		VkPushConstantRange pushConstantRanges[2];
-		pushConstantRanges[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT; // world matrix
+		VkPushConstantRange pushConstantRanges[4];
+		pushConstantRanges[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT; // transform index
 		pushConstantRanges[0].offset = 0; // Start offset
-		pushConstantRanges[0].size = sizeof(mat4) * 2;
+		pushConstantRanges[0].size = sizeof(u32);
 		pushConstantRanges[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT; // texture index
 		pushConstantRanges[1].offset = pushConstantRanges[0].size; // Start offset
 		pushConstantRanges[1].size = sizeof(u32);
-		pipelineLayoutInfo.pushConstantRangeCount = 2; // Optional
+		pushConstantRanges[2].stageFlags = VK_SHADER_STAGE_VERTEX_BIT; // skin palette offset
+		pushConstantRanges[2].offset = pushConstantRanges[1].offset + pushConstantRanges[1].size;
+		pushConstantRanges[2].size = sizeof(u32);
+		pushConstantRanges[3].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT; // material index
+		pushConstantRanges[3].offset = pushConstantRanges[2].offset + pushConstantRanges[2].size;
+		pushConstantRanges[3].size = sizeof(u32);
+		pipelineLayoutInfo.pushConstantRangeCount = 4; // Optional
 		pipelineLayoutInfo.pPushConstantRanges = pushConstantRanges; // Optional
 		if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create pipeline layout!");
 		}
 
 		VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-		colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+		colorBlendAttachment.colorWriteMask = pipeline->colorWriteEnable ? VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT : 0;
 		colorBlendAttachment.blendEnable = pipeline->blendEnabled ? VK_TRUE : VK_FALSE;
 		colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA; // TODO
 		colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA; // Optional
@@ -1407,6 +1875,8 @@ namespace VulkanImpl
 			return VK_ATTACHMENT_LOAD_OP_CLEAR;
 		if (opType == Graphics::AttachmentOpType::DONTCARE)
 			return VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		if (opType == Graphics::AttachmentOpType::LOAD)
+			return VK_ATTACHMENT_LOAD_OP_LOAD;
 		return VK_ATTACHMENT_LOAD_OP_NONE_EXT;
 	}
 	VkAttachmentStoreOp MapToVulkanStoreOp(Graphics::AttachmentOpType opType)
@@ -1464,7 +1934,7 @@ namespace VulkanImpl
 			auto& colorImageMemory = textureImageMemories[presentation->colorTextureID.memoryID];
 			auto& colorImageView = textureImageViews[presentation->colorTextureID.viewID];
 			vkDestroyImage(device, colorImage, nullptr);
-			vkFreeMemory(device, colorImageMemory, nullptr);
+			FreeMemory(colorImageMemory);
 			vkDestroyImageView(device, colorImageView, nullptr);
 			CreateImage(swapChainExtent.width, swapChainExtent.height, colorFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 				colorImage, colorImageMemory, 1, msaaSamples);
@@ -1512,6 +1982,9 @@ namespace VulkanImpl
 			throw std::runtime_error("failed to allocate command buffers!");
 		}
 
+		recordingStates.resize(commandBuffers.size());
+		commandBufferPools.resize(commandBuffers.size(), VK_NULL_HANDLE);
+
 		Vector<Graphics::CommandList> commandLists;
 		for (u32 i = 0; i < commandBuffers.size(); ++i)
 		{
@@ -1546,48 +2019,232 @@ namespace VulkanImpl
 		return commandLists;
 	}
 
-	void Draw(Graphics::CommandList commandList, Graphics::Geometry& geometry, SharedPtr<Graphics::GraphicsPipeline> pipeline, Graphics::DescriptorPoolID descriptorPoolID, int swapID, int updateSwapID)
+	// recorded after the primaries, in a pool of its own
+	Graphics::CommandList CreateSecondaryCommandBuffer()
+	{
+		QueueFamilyIndices queueFamilyIndices = FindQueueFamilies(physicalDevice);
+
+		VkCommandPool pool;
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		// reset whole before every recording
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsAndComputeFamily.value();
+		if (vkCreateCommandPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create command pool!");
+		}
+
+		VkCommandBuffer commandBuffer;
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = pool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		allocInfo.commandBufferCount = 1;
+		if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate command buffers!");
+		}
+
+		commandBuffers.push_back(commandBuffer);
+		commandBufferPools.push_back(pool);
+		recordingStates.resize(commandBuffers.size());
+
+		Graphics::CommandList commandList;
+		commandList.commandListID = commandBuffers.size() - 1;
+		commandList.isSecondary = true;
+		return commandList;
+	}
+
+	// the counters are kept until the submit
+	void ForgetBinds(Graphics::CommandList commandList)
+	{
+		auto& state = recordingStates[commandList.commandListID];
+		state.pipeline = VK_NULL_HANDLE;
+		state.cullMode = -1;
+		state.vertexBuffer = VK_NULL_HANDLE;
+		state.indexBuffer = VK_NULL_HANDLE;
+		state.descriptorSets = BoundDescriptorSets{};
+	}
+
+	void BindGraphicsPipeline(Graphics::CommandList commandList, VkPipeline pipeline)
+	{
+		auto& state = recordingStates[commandList.commandListID];
+		if (state.pipeline == pipeline)
+			return;
+		vkCmdBindPipeline(commandBuffers[commandList.commandListID], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+		state.pipeline = pipeline;
+		state.binds++;
+	}
+
+	void SetCullMode(Graphics::CommandList commandList, bool isDoubleSided)
+	{
+		i32 cullMode = isDoubleSided ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT;
+		auto& state = recordingStates[commandList.commandListID];
+		if (state.cullMode == cullMode)
+			return;
+		vkCmdSetCullMode(commandBuffers[commandList.commandListID], cullMode);
+		state.cullMode = cullMode;
+		state.binds++;
+	}
+
+	void Draw(Graphics::CommandList commandList, Graphics::Geometry& geometry, const mat4& worldMatrix, SharedPtr<Graphics::GraphicsPipeline> pipeline, Graphics::DescriptorPoolID descriptorPoolID, int swapID, int updateSwapID)
 	{
 		auto pipelineID = pipeline->pipelineID.id;
 		auto& graphicsPipeline = pipelines[pipelineID];
 		VkCommandBuffer commandBuffer = commandBuffers[commandList.commandListID];
+		auto& state = recordingStates[commandList.commandListID];
 
-		//vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+		// a variant may be bound from the previous draw
+		BindGraphicsPipeline(commandList, graphicsPipeline);
 		auto& vertexBuffer = vertexBuffers[geometry.geometryID.vertexBufferID];
-		bool needsComputeVertex = geometry.GetVertexData()->hasSkeleton || geometry.GetVertexData()->hasBlends;
+		auto& indexBuffer = indexBuffers[geometry.geometryID.indexBufferID];
+		// animated meshes go through DrawVariant
+		assert(!geometry.GetVertexData()->hasSkeleton && !geometry.GetVertexData()->hasBlends);
 	
-		VkBuffer vbs[] = { needsComputeVertex ? vertexBuffers[geometry.transformedVertexBuffer->extendedBufferIDs[0]] : vertexBuffer };
+		VkBuffer vbs[] = { vertexBuffer };
 		VkDeviceSize offsets[] = { 0 };
 
-		UpdateUniformBuffer(geometry.materialUniformBuffer.GetData(), geometry.materialUniformBuffer.GetBufferSize(), geometry.materialUniformBuffer, swapID);
-
-		vkCmdPushConstants(commandBuffer, pipelineLayouts[pipelineID], VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(mat4), &geometry.node->worldMatrix);
-		glm::mat4 invTModel = Math::InverseTranspose(geometry.node->worldMatrix);
-		vkCmdPushConstants(commandBuffer, pipelineLayouts[pipelineID], VK_SHADER_STAGE_VERTEX_BIT, sizeof(mat4), sizeof(mat4), &invTModel);
+		// the normal matrix is derived from the world matrix in the vertex shader
+		u32 transformIndex = transformBuffer->Allocate(worldMatrix);
+		vkCmdPushConstants(commandBuffer, pipelineLayouts[pipelineID], VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(u32), &transformIndex);
 		u32 hasTangent = geometry.GetVertexData()->hasTangent ? 1 : 0;
-		vkCmdPushConstants(commandBuffer, pipelineLayouts[pipelineID], VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(mat4)*2, sizeof(u32), &hasTangent);
+		vkCmdPushConstants(commandBuffer, pipelineLayouts[pipelineID], VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(u32), sizeof(u32), &hasTangent);
+		vkCmdPushConstants(commandBuffer, pipelineLayouts[pipelineID], VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(u32) * 3, sizeof(u32), &geometry.material->materialIndex);
 		//vkCmdPushConstants(commandBuffer, pipelineLayouts[geometry.basicUniform->layoutID], VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(mat4), sizeof(u32), &geometry.mainTexture.textureID.id);
 
-		vkCmdBindVertexBuffers(commandBuffer, 0, 1, vbs, offsets);
-		vkCmdBindIndexBuffer(commandBuffer, indexBuffers[geometry.geometryID.indexBufferID], 0, VK_INDEX_TYPE_UINT16);
-		auto uniformDescriptorSet = descriptorSetsPerPool[descriptorPoolID.id][swapID];
-		auto perMeshDescriptorSet = descriptorSetsPerPool[descriptorPoolID.id][geometry.geometryID.setID];
-		VkDescriptorSet descriptorSets[] = { uniformDescriptorSet, perMeshDescriptorSet };
-
-		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts[pipelineID], 0, 2, descriptorSets, 0, nullptr);
+		// meshes in the arenas share these, bound once per command buffer
+		if (state.vertexBuffer != vertexBuffer)
+		{
+			vkCmdBindVertexBuffers(commandBuffer, 0, 1, vbs, offsets);
+			state.vertexBuffer = vertexBuffer;
+			state.binds++;
+		}
+		if (state.indexBuffer != indexBuffer)
+		{
+			vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT16);
+			state.indexBuffer = indexBuffer;
+			state.binds++;
+		}
+		// materials are picked by the pushed index, the sets only change with the pass
+		VkDescriptorSet descriptorSets[] = { descriptorSetsPerPool[descriptorPoolID.id][swapID], descriptorSetsPerPool[bindlessPoolID][bindlessSetID] };
+		auto& boundSets = state.descriptorSets;
+		if (boundSets.layout != pipelineLayouts[pipelineID] || boundSets.passSet != descriptorSets[0])
+		{
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts[pipelineID], 0, 2, descriptorSets, 0, nullptr);
+			boundSets.layout = pipelineLayouts[pipelineID];
+			boundSets.passSet = descriptorSets[0];
+			state.binds++;
+		}
 
-		if (geometry.material->material->isDoubleSided)
-			vkCmdSetCullMode(commandBuffer, VK_CULL_MODE_NONE);
-		else 
-			vkCmdSetCullMode(commandBuffer, VK_CULL_MODE_BACK_BIT);
+		SetCullMode(commandList, geometry.material->material->isDoubleSided);
+		state.draws++;
 		u32 indicesCount = static_cast<u32>(geometry.GetIndicesData().size());
 		if (indicesCount == 0)
-			vkCmdDraw(commandBuffer, geometry.GetVertexData()->GetVerticesCount(), 1, 0, 0);
+			vkCmdDraw(commandBuffer, geometry.GetVertexData()->GetVerticesCount(), 1, geometry.geometryID.vertexOffset, 0);
+		else 
+			vkCmdDrawIndexed(commandBuffer, indicesCount, 1, geometry.geometryID.firstIndex, geometry.geometryID.vertexOffset, 0);
+	}
+
+	// draw with a variant of the pass pipeline, left bound for the next draw of the same variant. secondStream is optional,
+	// variantConstant is pushed at offset 8 (palette offset or crowd time)
+	void DrawVariant(Graphics::CommandList commandList, Graphics::GLTFMesh& mesh, SharedPtr<Graphics::GraphicsPipeline> pipeline, SharedPtr<Graphics::GraphicsPipeline> variant, 
+		VkBuffer secondStream, u32 variantConstant, int swapID, u32 instanceCount = 1)
+	{
+		auto variantID = variant->pipelineID.id;
+		auto& variantLayout = pipelineLayouts[variantID];
+		VkCommandBuffer commandBuffer = commandBuffers[commandList.commandListID];
+		auto& state = recordingStates[commandList.commandListID];
+
+		BindGraphicsPipeline(commandList, pipelines[variantID]);
+
+		u32 transformIndex = transformBuffer->Allocate(mesh.node->worldMatrix);
+		vkCmdPushConstants(commandBuffer, variantLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(u32), &transformIndex);
+		u32 hasTangent = mesh.GetVertexData()->hasTangent ? 1 : 0;
+		vkCmdPushConstants(commandBuffer, variantLayout, VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(u32), sizeof(u32), &hasTangent);
+		vkCmdPushConstants(commandBuffer, variantLayout, VK_SHADER_STAGE_VERTEX_BIT, sizeof(u32) * 2, sizeof(u32), &variantConstant);
+		vkCmdPushConstants(commandBuffer, variantLayout, VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(u32) * 3, sizeof(u32), &mesh.material->materialIndex);
+
+		// the second stream is per mesh, only the shared first one and the index buffer can be skipped
+		VkBuffer vbs[] = { vertexBuffers[mesh.geometryID.vertexBufferID], secondStream };
+		VkDeviceSize offsets[] = { 0, 0 };
+		if (secondStream != VK_NULL_HANDLE)
+		{
+			vkCmdBindVertexBuffers(commandBuffer, 0, 2, vbs, offsets);
+			state.vertexBuffer = vbs[0];
+			state.binds++;
+		}
+		else if (state.vertexBuffer != vbs[0])
+		{
+			vkCmdBindVertexBuffers(commandBuffer, 0, 1, vbs, offsets);
+			state.vertexBuffer = vbs[0];
+			state.binds++;
+		}
+		VkBuffer indexBuffer = indexBuffers[mesh.geometryID.indexBufferID];
+		if (state.indexBuffer != indexBuffer)
+		{
+			vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT16);
+			state.indexBuffer = indexBuffer;
+			state.binds++;
+		}
+
+		VkDescriptorSet descriptorSets[] = { descriptorSetsPerPool[variant->descriptorPoolID.id][swapID], descriptorSetsPerPool[bindlessPoolID][bindlessSetID] };
+		auto& boundSets = state.descriptorSets;
+		if (boundSets.layout != variantLayout || boundSets.passSet != descriptorSets[0])
+		{
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, variantLayout, 0, 2, descriptorSets, 0, nullptr);
+			boundSets.layout = variantLayout;
+			boundSets.passSet = descriptorSets[0];
+			state.binds++;
+		}
+
+		SetCullMode(commandList, mesh.material->material->isDoubleSided);
+		state.draws++;
+		u32 indicesCount = static_cast<u32>(mesh.GetIndicesData().size());
+		if (indicesCount == 0)
+			vkCmdDraw(commandBuffer, mesh.GetVertexData()->GetVerticesCount(), instanceCount, mesh.geometryID.vertexOffset, 0);
 		else 
-			vkCmdDrawIndexed(commandBuffer, indicesCount, 1, 0, 0, 0);
+			vkCmdDrawIndexed(commandBuffer, indicesCount, instanceCount, mesh.geometryID.firstIndex, mesh.geometryID.vertexOffset, 0);
+	}
+
+	// up to maxDrawCount commands from indirectBuffer, the count is read from countOffset. binds are tracked as in Draw,
+	// the variant reads everything per draw from the object table so nothing is pushed
+	void DrawIndexedIndirectCount(Graphics::CommandList commandList, SharedPtr<Graphics::GraphicsPipeline> variant, VkBuffer vertexBuffer, VkBuffer indexBuffer, bool isDoubleSided,
+		VkBuffer indirectBuffer, VkDeviceSize commandOffset, VkDeviceSize countOffset, u32 maxDrawCount, int swapID)
+	{
+		auto variantID = variant->pipelineID.id;
+		auto& variantLayout = pipelineLayouts[variantID];
+		VkCommandBuffer commandBuffer = commandBuffers[commandList.commandListID];
+		auto& state = recordingStates[commandList.commandListID];
+
+		BindGraphicsPipeline(commandList, pipelines[variantID]);
+		if (state.vertexBuffer != vertexBuffer)
+		{
+			VkDeviceSize offsets[] = { 0 };
+			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, offsets);
+			state.vertexBuffer = vertexBuffer;
+			state.binds++;
+		}
+		if (state.indexBuffer != indexBuffer)
+		{
+			vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT16);
+			state.indexBuffer = indexBuffer;
+			state.binds++;
+		}
+		VkDescriptorSet descriptorSets[] = { descriptorSetsPerPool[variant->descriptorPoolID.id][swapID], descriptorSetsPerPool[bindlessPoolID][bindlessSetID] };
+		auto& boundSets = state.descriptorSets;
+		if (boundSets.layout != variantLayout || boundSets.passSet != descriptorSets[0])
+		{
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, variantLayout, 0, 2, descriptorSets, 0, nullptr);
+			boundSets.layout = variantLayout;
+			boundSets.passSet = descriptorSets[0];
+			state.binds++;
+		}
+
+		SetCullMode(commandList, isDoubleSided);
+		state.draws++;
+		vkCmdDrawIndexedIndirectCount(commandBuffer, indirectBuffer, commandOffset, indirectBuffer, countOffset, maxDrawCount, sizeof(VkDrawIndexedIndirectCommand));
 	}
 
-	void Dispatch(Graphics::CommandList commandList, int pipelineID, int layoutID, int descriptorPoolID, int swapID, vec3 threadSz, vec3 invocationSz, Graphics::PushConstant *pushConstant = nullptr)
+	void Dispatch(Graphics::CommandList commandList, int pipelineID, int layoutID, int descriptorPoolID, int setID, vec3 threadSz, vec3 invocationSz, Graphics::PushConstant *pushConstant = nullptr)
 	{
 		auto& computePipeline = VulkanImpl::pipelines[pipelineID];
 		VkCommandBuffer commandBuffer = VulkanImpl::computeCommandBuffers[commandList.commandListID];
@@ -1605,7 +2262,7 @@ namespace VulkanImpl
 			vkCmdPushConstants(commandBuffer, pipelineLayouts[pipelineID], VK_SHADER_STAGE_COMPUTE_BIT, 0, pushConstant->data.size() * sizeof(u8), pushConstant->data.data());
 		}
 
-        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipelineLayout, 0, 1, &descriptorSetsPerPool[descriptorPoolID][swapID], 0, nullptr);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipelineLayout, 0, 1, &descriptorSetsPerPool[descriptorPoolID][setID], 0, nullptr);
 
         vkCmdDispatch(commandBuffer, ceilf(threadSz[0] / invocationSz[0]), ceilf(threadSz[1] / invocationSz[1]), ceilf(threadSz[2] / invocationSz[2]));
 	}
@@ -1614,6 +2271,7 @@ namespace VulkanImpl
 	{
 		VkCommandBuffer commandBuffer = commandBuffers[commandList.commandListID];
 		vkResetCommandBuffer(commandBuffer, 0);
+		ForgetBinds(commandList);
 
 		VkCommandBufferBeginInfo beginInfo{};
 		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -1627,16 +2285,42 @@ namespace VulkanImpl
 			-1, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
 	}
 
-	void BeginRenderPass(Graphics::CommandList commandList, SharedPtr<Graphics::RenderPass> renderPass, Graphics::PipeLineID pipelineID, SharedPtr<Graphics::BasicUniformBuffer> basicUniform, u32 swapID, SharedPtr<Graphics::Presentation> presentation, u32 subPass)
+	// the viewport and scissor of every pass, not inherited by secondary command buffers
+	void SetViewport(VkCommandBuffer commandBuffer, SharedPtr<Graphics::Presentation> presentation)
 	{
-		VkCommandBuffer commandBuffer = commandBuffers[commandList.commandListID];
+		VkViewport viewport{};
+		viewport.x = 0.0f;
+		viewport.y = 0.0f;
+		f32 adjustedWidth = presentation->swapChainDetails.aspectRatio * swapChainExtent.height; 
+		f32 adjustedHeight = 1.f / presentation->swapChainDetails.aspectRatio * swapChainExtent.width;
+		viewport.width = static_cast<float>(swapChainExtent.width);
+		viewport.height = static_cast<float>(swapChainExtent.height);
 
-		Vector<VkClearValue> clearValues(2);
-		clearValues[0].color = { {0.0f, 0.0f, 0.0f, 0.0f} };
-		clearValues[1].depthStencil = { 1.0f, 0 };
+		// ensure only full width is displayed
+		viewport.height = adjustedHeight;
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
-		Vector< VkRenderingAttachmentInfoKHR> colorAttachments;
-		
+		VkRect2D scissor{};
+		scissor.offset = { 0, 0 };
+		scissor.extent = swapChainExtent;
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+	}
+
+	// with secondaryContents the primary may only execute secondary command buffers until the pass ends, they bind
+	// everything themselves
+	void BeginRenderPass(Graphics::CommandList commandList, SharedPtr<Graphics::RenderPass> renderPass, Graphics::PipeLineID pipelineID, SharedPtr<Graphics::BasicUniformBuffer> basicUniform, u32 swapID, SharedPtr<Graphics::Presentation> presentation, u32 subPass,
+		bool secondaryContents = false)
+	{
+		VkCommandBuffer commandBuffer = commandBuffers[commandList.commandListID];
+
+		Vector<VkClearValue> clearValues(2);
+		clearValues[0].color = { {0.0f, 0.0f, 0.0f, 0.0f} };
+		clearValues[1].depthStencil = { 1.0f, 0 };
+
+		Vector< VkRenderingAttachmentInfoKHR> colorAttachments;
+		
 		VkRenderingAttachmentInfoKHR swapchain_attachment_info{};
 		swapchain_attachment_info.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
 		swapchain_attachment_info.imageView = textureImageViews[presentation->colorTextureID.viewID];
@@ -1687,29 +2371,24 @@ namespace VulkanImpl
 		render_info.colorAttachmentCount = colorAttachments.size();
 		render_info.pColorAttachments = colorAttachments.data();
 		render_info.pDepthAttachment = &depth_attachment_info;
+		render_info.flags = secondaryContents ? VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT : 0;
 
 		vkCmdBeginRendering(commandBuffer, &render_info);
 
-		auto& graphicsPipeline = pipelines[pipelineID.id];
-		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
-		VkViewport viewport{};
-		viewport.x = 0.0f;
-		viewport.y = 0.0f;
-		f32 adjustedWidth = presentation->swapChainDetails.aspectRatio * swapChainExtent.height; 
-		f32 adjustedHeight = 1.f / presentation->swapChainDetails.aspectRatio * swapChainExtent.width;
-		viewport.width = static_cast<float>(swapChainExtent.width);
-		viewport.height = static_cast<float>(swapChainExtent.height);
-
-		// ensure only full width is displayed
-		viewport.height = adjustedHeight;
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
-		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-
-		VkRect2D scissor{};
-		scissor.offset = { 0, 0 };
-		scissor.extent = swapChainExtent;
-		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+		auto& state = recordingStates[commandList.commandListID];
+		state.cullMode = -1;
+		if (secondaryContents)
+		{
+			state.pipeline = VK_NULL_HANDLE;
+		}
+		else
+		{
+			auto& graphicsPipeline = pipelines[pipelineID.id];
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+			state.pipeline = graphicsPipeline;
+			state.binds++;
+			SetViewport(commandBuffer, presentation);
+		}
 
 		UpdateUniformBuffer(basicUniform->GetData(), basicUniform->GetBufferSize(), *basicUniform, swapID);
 	}
@@ -1734,6 +2413,10 @@ namespace VulkanImpl
 		vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
 
 		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+		auto& state = recordingStates[commandList.commandListID];
+		state.pipeline = graphicsPipeline;
+		state.cullMode = -1;
+		state.binds++;
 		//VkViewport viewport{};
 		//viewport.x = 0.0f;
 		//viewport.y = 0.0f;
@@ -1754,6 +2437,62 @@ namespace VulkanImpl
 		//vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 	}
 
+	// begins a secondary command buffer drawing in the subpass of the pass begun with secondaryContents. its pool holds
+	// only this buffer and the frame's fence has released it, so any one thread can reset and record it
+	void BeginSecondaryCommandBuffer(Graphics::CommandList commandList, SharedPtr<Graphics::RenderPass> renderPass, u32 subPass, SharedPtr<Graphics::Presentation> presentation)
+	{
+		assert(commandList.isSecondary);
+		VkCommandBuffer commandBuffer = commandBuffers[commandList.commandListID];
+		vkResetCommandPool(device, commandBufferPools[commandList.commandListID], 0);
+		ForgetBinds(commandList);
+
+		// same formats as the attachments of BeginRenderPass and the pipelines of the subpass
+		const auto& subpass = renderPass->subpasses[subPass];
+		Vector<VkFormat> colorFormats(subpass.attachments.size());
+		colorFormats[0] = swapChainImageFormat;
+		for (int i = 1; i < subpass.attachments.size(); ++i)
+			colorFormats[i] = MapToVulkanFormat(subpass.attachments[i].formatType);
+
+		VkCommandBufferInheritanceRenderingInfo renderingInfo{};
+		renderingInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+		renderingInfo.colorAttachmentCount = colorFormats.size();
+		renderingInfo.pColorAttachmentFormats = colorFormats.data();
+		renderingInfo.depthAttachmentFormat = depthFormatChosen;
+		renderingInfo.rasterizationSamples = msaaSamples;
+
+		VkCommandBufferInheritanceInfo inheritanceInfo{};
+		inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritanceInfo.pNext = &renderingInfo;
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+			throw std::runtime_error("failed to begin recording command buffer!");
+		}
+		SetViewport(commandBuffer, presentation);
+	}
+
+	void EndSecondaryCommandBuffer(Graphics::CommandList commandList)
+	{
+		if (vkEndCommandBuffer(commandBuffers[commandList.commandListID]) != VK_SUCCESS) {
+			throw std::runtime_error("failed to record command buffer!");
+		}
+	}
+
+	// in order, inside the pass begun with secondaryContents
+	void ExecuteSecondaryCommandBuffers(Graphics::CommandList commandList, const Vector<Graphics::CommandList>& secondaryLists, u32 first, u32 count)
+	{
+		if (count == 0)
+			return;
+		Vector<VkCommandBuffer> secondaryBuffers(count);
+		for (u32 i = 0; i < count; ++i)
+			secondaryBuffers[i] = commandBuffers[secondaryLists[first + i].commandListID];
+		vkCmdExecuteCommands(commandBuffers[commandList.commandListID], count, secondaryBuffers.data());
+	}
+
 	void EndRenderPass(Graphics::CommandList commandList)
 	{
 		VkCommandBuffer commandBuffer = commandBuffers[commandList.commandListID];
@@ -1766,11 +2505,18 @@ namespace VulkanImpl
 	void DrawBuffer(Graphics::CommandList commandList, Graphics::Buffer& buffer, u32 bufferSize, u32 swapID, Graphics::DescriptorPoolID &descriptorPoolID, SharedPtr<Graphics::BasicUniformBuffer> basicUniform, Graphics::PipeLineID pipelineID)
 	{
 		VkCommandBuffer commandBuffer = commandBuffers[commandList.commandListID];
+		auto& state = recordingStates[commandList.commandListID];
 		VkDeviceSize offsets[] = { 0 };
 		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &shaderStorageBuffers[buffer.extendedBufferIDs[swapID]], offsets);
+		state.vertexBuffer = shaderStorageBuffers[buffer.extendedBufferIDs[swapID]];
+		state.binds++;
 		UpdateUniformBuffer(basicUniform->GetData(), basicUniform->GetBufferSize(), *basicUniform, swapID);
 
 		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts[pipelineID.id], 0, 1, &(descriptorSetsPerPool[descriptorPoolID.id][swapID]), 0, nullptr);
+		// only the pass set, the next mesh draw binds both again
+		state.descriptorSets = BoundDescriptorSets{};
+		state.binds++;
+		state.draws++;
 
 		vkCmdDraw(commandBuffer, bufferSize, 1, 0, 0);
 	}
@@ -1900,6 +2646,10 @@ namespace VulkanImpl
 			auto& poolSize = poolSizes.emplace_back();
 			poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 			poolSize.descriptorCount = numTextures;
+			// pass textures can also be subpass inputs
+			auto& inputPoolSize = poolSizes.emplace_back();
+			inputPoolSize.type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+			inputPoolSize.descriptorCount = numTextures;
 		}
 
 		VkDescriptorPoolCreateInfo poolInfo{};
@@ -2023,11 +2773,11 @@ namespace VulkanImpl
 		return startNewSetsIndex;
 	}
 
-	void CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, bool isCubemap = false) {
-		VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
+	void CopyBufferToImage(VkBuffer buffer, VkDeviceSize bufferOffset, VkImage image, uint32_t width, uint32_t height, bool isCubemap = false) {
+		VkCommandBuffer commandBuffer = GetUploadCommandBuffer();
 		Vector<VkBufferImageCopy> regions;
 		auto &region = regions.emplace_back();
-		region.bufferOffset = 0;
+		region.bufferOffset = bufferOffset;
 		region.bufferRowLength = 0;
 		region.bufferImageHeight = 0;
 		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -2046,7 +2796,7 @@ namespace VulkanImpl
 			for (int i = 1; i < 6; ++i)
 			{
 				auto &region = regions.emplace_back();
-				region.bufferOffset = width * height * i * 4;
+				region.bufferOffset = bufferOffset + width * height * i * 4;
 				region.bufferRowLength = 0;
 				region.bufferImageHeight = 0;
 				region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -2070,7 +2820,6 @@ namespace VulkanImpl
 			static_cast<u32>(regions.size()),
 			regions.data()
 		);
-		EndSingleTimeCommands(commandBuffer);
 	}
 
 	void GenerateMipmaps(VkImage image, VkFormat imageFormat, i32 texWidth, i32 texHeight, u32 mipLevels)
@@ -2083,7 +2832,7 @@ namespace VulkanImpl
 			throw std::runtime_error("texture image format does not support linear blitting!");
 		}
 
-		VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
+		VkCommandBuffer commandBuffer = GetUploadCommandBuffer();
 
 		VkImageMemoryBarrier barrier{};
 		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -2158,7 +2907,6 @@ namespace VulkanImpl
 			0, nullptr,
 			1, &barrier);
 
-		EndSingleTimeCommands(commandBuffer);
 	}
 
 	void CreateTextureImage(Graphics::Texture& texture, stbi_uc* pixels, i32 width, i32 height, u32 mipLevels, bool isAttachment = false,
@@ -2168,13 +2916,11 @@ namespace VulkanImpl
 		if (isCubemap)
 			imageSize *= 6;
 		assert(width > 0 && height > 0);
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingBufferMemory;
+		StagingRange staging;
 		if (pixels != nullptr || !pixelsArray.empty())
 		{
-			CreateBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-			void* data;
-			vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data);
+			staging = AllocateStaging(imageSize);
+			void* data = staging.data;
 			if (isCubemap)
 			{
 				VkDeviceSize layerSize = imageSize / 6;
@@ -2185,7 +2931,6 @@ namespace VulkanImpl
 			}
 			else 
 				memcpy(data, pixels, static_cast<size_t>(imageSize));
-			vkUnmapMemory(device, stagingBufferMemory);
 			stbi_image_free(pixels);
 			if (isCubemap)
 			{
@@ -2208,7 +2953,7 @@ namespace VulkanImpl
 		else
 		{
 			vkDestroyImage(device, textureImage, nullptr);
-			vkFreeMemory(device, textureImageMemory, nullptr);
+			FreeMemory(textureImageMemory);
 			vkDestroyImageView(device, textureImageView, nullptr);
 		}
 
@@ -2223,10 +2968,7 @@ namespace VulkanImpl
 			MapToVulkanImageLayout(texture.initialLayout), mipLevels, nullptr, -1, -1, -1, -1, isCubemap);
 		if (pixels != nullptr || isCubemap)
 		{
-			CopyBufferToImage(stagingBuffer, textureImage, static_cast<u32>(width), static_cast<u32>(height), isCubemap);
-
-			vkDestroyBuffer(device, stagingBuffer, nullptr);
-			vkFreeMemory(device, stagingBufferMemory, nullptr);
+			CopyBufferToImage(staging.buffer, staging.offset, textureImage, static_cast<u32>(width), static_cast<u32>(height), isCubemap);
 		}
 
 		if (mipLevels > 1)
@@ -2277,6 +3019,143 @@ namespace VulkanImpl
 		}
 	}
 
+	u32 RegisterBindlessTexture(const Graphics::Texture& texture)
+	{
+		u64 key = (static_cast<u64>(texture.textureID.viewID) << 32) | texture.textureID.samplerID;
+		auto slot = bindlessTextureSlots.find(key);
+		if (slot != bindlessTextureSlots.end())
+			return slot->second;
+		u32 newSlot = static_cast<u32>(bindlessTextureSlots.size());
+		if (newSlot >= maxBindlessTextures)
+			throw std::runtime_error("bindless texture array is full!");
+
+		VkDescriptorImageInfo imageInfo{};
+		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imageInfo.imageView = textureImageViews[texture.textureID.viewID];
+		imageInfo.sampler = textureSamplers[texture.textureID.samplerID];
+		VkWriteDescriptorSet descriptorWrite{};
+		descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite.dstSet = descriptorSetsPerPool[bindlessPoolID][bindlessSetID];
+		descriptorWrite.dstBinding = 0;
+		descriptorWrite.dstArrayElement = newSlot;
+		descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		descriptorWrite.descriptorCount = 1;
+		descriptorWrite.pImageInfo = &imageInfo;
+		vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+		bindlessTextureSlots[key] = newSlot;
+		return newSlot;
+	}
+
+	// set 1 of every graphics pipeline, created with the first one
+	void InitBindless()
+	{
+		if (bindlessLayoutID >= 0)
+			return;
+
+		VkDescriptorSetLayoutBinding bindings[4]{};
+		bindings[0].binding = 0;
+		bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[0].descriptorCount = maxBindlessTextures;
+		bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		bindings[1].binding = 1;
+		bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[1].descriptorCount = 1;
+		bindings[1].stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS;
+		bindings[2].binding = 2;
+		bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[2].descriptorCount = 1;
+		bindings[2].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		// IndirectDraw object table, only written when gpu culling is set up
+		bindings[3].binding = 3;
+		bindings[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[3].descriptorCount = 1;
+		bindings[3].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		// unused slots are never sampled, new ones are written while earlier frames are in flight
+		VkDescriptorBindingFlags bindingFlags[4] = { VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT, 0, 0, VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT };
+		VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+		bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+		bindingFlagsInfo.bindingCount = 4;
+		bindingFlagsInfo.pBindingFlags = bindingFlags;
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.pNext = &bindingFlagsInfo;
+		layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+		layoutInfo.bindingCount = 4;
+		layoutInfo.pBindings = bindings;
+		auto& descriptorSetLayout = descriptorSetLayouts.emplace_back();
+		bindlessLayoutID = descriptorSetLayouts.size() - 1;
+		if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS)
+			throw std::runtime_error("failed to create bindless descriptor set layout!");
+
+		VkDescriptorPoolSize poolSizes[2]{};
+		poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		poolSizes[0].descriptorCount = maxBindlessTextures;
+		poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		poolSizes[1].descriptorCount = 3;
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+		poolInfo.poolSizeCount = 2;
+		poolInfo.pPoolSizes = poolSizes;
+		poolInfo.maxSets = 1;
+		auto& descriptorPool = descriptorPools.emplace_back();
+		bindlessPoolID = descriptorPools.size() - 1;
+		if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
+			throw std::runtime_error("failed to create bindless descriptor pool!");
+
+		// one row per material, std430 array stride
+		static_assert(sizeof(Graphics::PBRMaterial::MaterialData) % 16 == 0);
+		materialTable = MakeUnique<Graphics::MaterialTableBuffer>(maxBindlessMaterials);
+		// one region per frame in flight so the set is shared, the pushed index includes the region
+		transformBuffer = MakeUnique<Graphics::TransformBuffer>(maxDrawTransforms, MAX_FRAMES_IN_FLIGHT);
+		descriptorSetsPerPool.resize(descriptorPools.size());
+		bindlessSetID = CreateDescriptorSets(bindlessLayoutID, 1, bindlessPoolID, Vector<Graphics::Buffer*>{ materialTable.get(), transformBuffer.get() });
+
+		// slot 0, sampled by materials without a texture
+		stbi_uc* white = (stbi_uc*)malloc(4);
+		memset(white, 0xff, 4);
+		Graphics::Texture whiteTexture;
+		CreateTextureImage(whiteTexture, white, 1, 1, 1);
+		Graphics::Sampler whiteSampler;
+		whiteTexture.textureID.samplerID = whiteSampler.id;
+		RegisterBindlessTexture(whiteTexture);
+	}
+
+	// gives the material its row in the table and its textures a slot in the array. materials shared by meshes are registered once
+	void RegisterMaterial(Graphics::PBRMaterial& material)
+	{
+		if (material.materialIndex != ~0u)
+			return;
+		InitBindless();
+		if (bindlessMaterialCount >= maxBindlessMaterials)
+			throw std::runtime_error("material table is full!");
+
+		auto& data = *material.material;
+		data.albedoTexIndex = data.hasAlbedoTex ? RegisterBindlessTexture(material.albedoTexture) : 0;
+		data.metallicTexIndex = data.hasMetallicRoughnessTex ? RegisterBindlessTexture(material.metallicTexture) : 0;
+		data.normalTexIndex = data.hasNormalTex ? RegisterBindlessTexture(material.normalTexture) : 0;
+		data.occlusionTexIndex = data.hasOcclusionTex ? RegisterBindlessTexture(material.occlusionTexture) : 0;
+		data.emissiveTexIndex = data.hasEmissiveTex ? RegisterBindlessTexture(material.emissiveTexture) : 0;
+		material.materialIndex = bindlessMaterialCount++;
+		material.MarkDirty();
+	}
+
+	// rows of the materials marked since the last frame, recorded before its submit
+	void UploadDirtyMaterials()
+	{
+		if (dirtyMaterials.empty())
+			return;
+		// earlier frames may still read the rows being replaced
+		vkCmdPipelineBarrier(GetUploadCommandBuffer(), VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+		for (auto material : dirtyMaterials)
+		{
+			materialTable->Upload(*material);
+			material->isDirty = false;
+		}
+		dirtyMaterials.clear();
+	}
+
 	void CreateUIRenderpass()
 	{
 		// Create an attachment description for the render pass
@@ -2457,9 +3336,12 @@ namespace Graphics
 	{
 		VulkanImpl::PickPhysicalDevice();
 		VulkanImpl::CreateLogicalDevice();
+		supportsIndirectDraw = VulkanImpl::supportsIndirectDraw;
+		depthSamples = static_cast<u32>(VulkanImpl::msaaSamples);
 		VulkanImpl::CreateCommandPool();
 		commandLists = VulkanImpl::CreateCommandBuffers();
 		computeCommandLists = VulkanImpl::CreateComputeCommandBuffers();
+		secondaryCommandLists.resize(VulkanImpl::MAX_FRAMES_IN_FLIGHT);
 
 		// TODO should be here?
 		VulkanImpl::CreateSyncObjects();
@@ -2492,6 +3374,9 @@ namespace Graphics
 		auto &commandList = GetCommandList(swapID);
 		commandList.imageIndex = imageIndex;
 		VulkanImpl::RecordCommandBuffer(commandList);
+		reservedSecondaryLists = 0;
+		if (VulkanImpl::transformBuffer)
+			VulkanImpl::transformBuffer->Reset(swapID);
 		return true;
 	}
 
@@ -2537,9 +3422,23 @@ namespace Graphics
 		submitInfo.signalSemaphoreCount = 1;
 		submitInfo.pSignalSemaphores = signalSemaphores;
 
+		VulkanImpl::UploadDirtyMaterials();
+		VulkanImpl::FlushUploads();
 		if (vkQueueSubmit(VulkanImpl::graphicsQueue, 1, &submitInfo, VulkanImpl::pipelineInFlightFences[VulkanImpl::fenceIndexGraphics][swapID]) != VK_SUCCESS) {
 			throw std::runtime_error("failed to submit draw command buffer!");
 		}
+		graphicsSubmitCount++;
+		auto countRecorded = [&](const CommandList& recordedList)
+		{
+			auto& state = VulkanImpl::recordingStates[recordedList.commandListID];
+			bindCount += state.binds;
+			drawCount += state.draws;
+			state.binds = 0;
+			state.draws = 0;
+		};
+		countRecorded(commandList);
+		for (u32 i = 0; i < reservedSecondaryLists; ++i)
+			countRecorded(secondaryCommandLists[swapID][i]);
 
 		// submit to the swapchain
 		VkPresentInfoKHR presentInfo{};
@@ -2589,6 +3488,13 @@ namespace Graphics
 
 		VkCommandBuffer commandBuffer = VulkanImpl::computeCommandBuffers[commandList.commandListID];
 
+		// compute results are read as vertex buffers by the following graphics submission
+		VkMemoryBarrier memoryBarrier{};
+		memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
 		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
 			throw std::runtime_error("failed to record compute command buffer!");
 		}
@@ -2603,20 +3509,35 @@ namespace Graphics
 		VkSemaphore toSignal{ VulkanImpl::pipelineWaitSemaphore[pipelineID].empty() ? nullptr : VulkanImpl::pipelineWaitSemaphore[pipelineID][swapID] };
 		submitInfo.signalSemaphoreCount = VulkanImpl::pipelineWaitSemaphore[pipelineID].empty() ? 0 : 1;
 		submitInfo.pSignalSemaphores = &toSignal;
+		VulkanImpl::FlushUploads();
 		if (vkQueueSubmit(VulkanImpl::computeQueue, 1, &submitInfo, VulkanImpl::pipelineInFlightFences[VulkanImpl::fenceIndexCompute][swapID]) != VK_SUCCESS) {
 			throw std::runtime_error("failed to submit compute command buffer!");
 		};
+		computeSubmitCount++;
 	}
 
-	void Device::BeginRenderPass(Graphics::RenderContext& context)
+	CommandList& Device::GetCommandList(const RenderContext& context)
+	{
+		u32 swapID = context.frameID % VulkanImpl::MAX_FRAMES_IN_FLIGHT;
+		if (context.secondaryList == RenderContext::PRIMARY)
+			return commandLists[swapID];
+		return secondaryCommandLists[swapID][context.secondaryList];
+	}
+
+	void Device::BeginRenderPass(Graphics::RenderContext& context, bool secondaryContents)
 	{
 		SharedPtr<Graphics::RenderPass> renderPass = context.renderPass;
 		const u32 frameID = context.frameID;
 		u32 swapID = frameID % VulkanImpl::MAX_FRAMES_IN_FLIGHT;
 		auto pso = context.renderPass->subpasses[context.subPass].pso;
 		auto& commandList = GetCommandList(swapID);
+		assert(context.secondaryList == RenderContext::PRIMARY);
 	
-		VulkanImpl::BeginRenderPass(commandList, renderPass, pso->pipelineID, pso->uniformDesc, swapID, context.presentation, context.subPass);
+		VulkanImpl::BeginRenderPass(commandList, renderPass, pso->pipelineID, pso->uniformDesc, swapID, context.presentation, context.subPass, secondaryContents);
+		passInSecondaryLists = secondaryContents;
+		passFirstSecondaryList = reservedSecondaryLists;
+		if (secondaryContents)
+			BeginSecondaryRecording(context, ReserveSecondaryLists(context, 1));
 	}
 
 	void Device::EndRenderPass(Graphics::RenderContext& context)
@@ -2624,19 +3545,56 @@ namespace Graphics
 		const u32 frameID = context.frameID;
 		u32 swapID = frameID % VulkanImpl::MAX_FRAMES_IN_FLIGHT;
 		auto& commandList = GetCommandList(swapID);
+		if (passInSecondaryLists)
+		{
+			EndSecondaryRecording(context);
+			VulkanImpl::ExecuteSecondaryCommandBuffers(commandList, secondaryCommandLists[swapID], passFirstSecondaryList, reservedSecondaryLists - passFirstSecondaryList);
+			passInSecondaryLists = false;
+		}
 		VulkanImpl::EndRenderPass(commandList);
 		context.subPass = 0;
 	}
 
+	u32 Device::ReserveSecondaryLists(Graphics::RenderContext& context, u32 count)
+	{
+		assert(passInSecondaryLists);
+		u32 swapID = context.frameID % VulkanImpl::MAX_FRAMES_IN_FLIGHT;
+		auto& frameLists = secondaryCommandLists[swapID];
+		while (frameLists.size() < reservedSecondaryLists + count)
+			frameLists.push_back(VulkanImpl::CreateSecondaryCommandBuffer());
+		u32 first = reservedSecondaryLists;
+		reservedSecondaryLists += count;
+		return first;
+	}
+
+	void Device::BeginSecondaryRecording(Graphics::RenderContext& context, u32 list)
+	{
+		context.secondaryList = list;
+		VulkanImpl::BeginSecondaryCommandBuffer(GetCommandList(context), context.renderPass, context.subPass, context.presentation);
+	}
+
+	void Device::EndSecondaryRecording(Graphics::RenderContext& context)
+	{
+		VulkanImpl::EndSecondaryCommandBuffer(GetCommandList(context));
+		context.secondaryList = RenderContext::PRIMARY;
+	}
+
 	void Device::BeginSubPass(Graphics::RenderContext& context)
 	{
 		const u32 frameID = context.frameID;
 		u32 swapID = frameID % VulkanImpl::MAX_FRAMES_IN_FLIGHT;
 		auto& commandList = GetCommandList(swapID);
+		// the barrier between the subpasses is recorded in the primary
+		assert(!passInSecondaryLists);
 		auto pso = context.renderPass->subpasses[context.subPass].pso;
 		VulkanImpl::BeginSubPass(commandList, context.renderPass, pso->pipelineID, context.presentation);
 	}
 
+	Device::MemoryStats Device::GetMemoryStats()
+	{
+		return VulkanImpl::GetMemoryStats();
+	}
+
 	void Device::CleanUp()
 	{
 		// UI
@@ -2662,18 +3620,19 @@ namespace Graphics
 				vkDestroyFence(VulkanImpl::device, inFlightFence, nullptr);
 		}
 
+		VulkanImpl::DestroyUploads();
 		for (auto& buffer : VulkanImpl::vertexBuffers)
 			vkDestroyBuffer(VulkanImpl::device, buffer, nullptr);
 		for (auto& memory : VulkanImpl::vertexBufferMemories)
-			vkFreeMemory(VulkanImpl::device, memory, nullptr);
+			VulkanImpl::FreeMemory(memory);
 		for (auto buffer : VulkanImpl::indexBuffers)
 			vkDestroyBuffer(VulkanImpl::device, buffer, nullptr);
 		for (auto& memory : VulkanImpl::indexBufferMemories)
-			vkFreeMemory(VulkanImpl::device, memory, nullptr);
+			VulkanImpl::FreeMemory(memory);
 		for (auto& texture : VulkanImpl::textureImages)
 			vkDestroyImage(VulkanImpl::device, texture, nullptr);
 		for (auto& memory : VulkanImpl::textureImageMemories)
-			vkFreeMemory(VulkanImpl::device, memory, nullptr);
+			VulkanImpl::FreeMemory(memory);
 		for (auto& textureView : VulkanImpl::textureImageViews)
 			vkDestroyImageView(VulkanImpl::device, textureView, nullptr);
 		for (auto& sampler : VulkanImpl::textureSamplers)
@@ -2681,13 +3640,14 @@ namespace Graphics
 		for (auto& buffer : VulkanImpl::shaderStorageBuffers)
 			vkDestroyBuffer(VulkanImpl::device, buffer, nullptr);
 		for (auto& memory : VulkanImpl::shaderStorageBufferMemories)
-			vkFreeMemory(VulkanImpl::device, memory, nullptr);
+			VulkanImpl::FreeMemory(memory);
 
 
 		for (size_t i = 0; i < VulkanImpl::uniformBuffers.size(); i++) {
 			vkDestroyBuffer(VulkanImpl::device, VulkanImpl::uniformBuffers[i], nullptr);
-			vkFreeMemory(VulkanImpl::device, VulkanImpl::uniformBufferMemories[i], nullptr);
+			VulkanImpl::FreeMemory(VulkanImpl::uniformBufferMemories[i]);
 		}
+		VulkanImpl::FreeMemoryBlocks();
 		for (auto& pool : VulkanImpl::descriptorPools)
 			vkDestroyDescriptorPool(VulkanImpl::device, pool, nullptr);
 
@@ -2696,6 +3656,9 @@ namespace Graphics
 		
 
 		vkDestroyCommandPool(VulkanImpl::device, VulkanImpl::commandPool, nullptr);
+		for (auto& pool : VulkanImpl::commandBufferPools)
+			if (pool != VK_NULL_HANDLE)
+				vkDestroyCommandPool(VulkanImpl::device, pool, nullptr);
 
 		for (auto& layout : VulkanImpl::pipelineLayouts)
 			vkDestroyPipelineLayout(VulkanImpl::device, layout, nullptr);
@@ -2765,7 +3728,8 @@ namespace Graphics
 		for (auto buffer : this->buffers)
 			allBuffers.push_back(buffer.get());
 
-		int poolID = VulkanImpl::CreateDescriptorPool(this->maxNumMeshes * VulkanImpl::MAX_FRAMES_IN_FLIGHT, this->numTexPerMesh * this->maxNumMeshes * VulkanImpl::MAX_FRAMES_IN_FLIGHT, this->buffers.size() * VulkanImpl::MAX_FRAMES_IN_FLIGHT, this->numTexPerMesh * this->maxNumMeshes);
+		// only the per frame sets, materials are in the bindless set
+		int poolID = VulkanImpl::CreateDescriptorPool(allBuffers.size() * VulkanImpl::MAX_FRAMES_IN_FLIGHT, this->textures.size() * VulkanImpl::MAX_FRAMES_IN_FLIGHT, this->buffers.size() * VulkanImpl::MAX_FRAMES_IN_FLIGHT);
 		this->descriptorPoolID.id = poolID;
 
 		// first set: per frame uniform
@@ -2773,19 +3737,8 @@ namespace Graphics
 		this->layoutID = layoutID;
 		this->setID = VulkanImpl::CreateDescriptorSets(layoutID, VulkanImpl::MAX_FRAMES_IN_FLIGHT, poolID, allBuffers, this->textures);
 
-		// second set layout: per mesh material textures
-		Texture baseColor;
-		baseColor.binding.binding = 0;
-		Texture metallic;
-		metallic.binding.binding = 1;
-		Texture normal;
-		normal.binding.binding = 2;
-		Texture occlusion;
-		occlusion.binding.binding = 3;
-		Texture emissive;
-		emissive.binding.binding = 4;
-		PBRUniformBuffer materialUniform;
-		this->perMeshLayoutID = VulkanImpl::CreateDescriptorSetLayout(Vector<Graphics::Buffer*>{&materialUniform}, Vector<Graphics::Texture>{baseColor, metallic, normal, occlusion, emissive});
+		// second set: material textures and table
+		VulkanImpl::InitBindless();
 
 		pipelineID = VulkanImpl::CreateGraphicsPipeline(vertexShader, fragmentShader, this, renderPassID, attachments);
 
@@ -2818,13 +3771,16 @@ namespace Graphics
 		{
 			if (buffer->GetBufferType() == Buffer::BufferType::UNIFORM)
 				numUniform += Max(buffer->extendedBufferIDs.size(), (size_t)1);
-			if (buffer->GetBufferType() == Buffer::BufferType::STRUCTURED)
+			// vertex buffers are bound as storage buffers too
+			if (buffer->GetBufferType() == Buffer::BufferType::STRUCTURED || buffer->GetBufferType() == Buffer::BufferType::VERTEX || buffer->GetBufferType() == Buffer::BufferType::VERTEX_WRITE)
 				numSSBO += Max(buffer->extendedBufferIDs.size(), (size_t)1);
 		}
 		for (auto& tex : this->textures)
 			numTex++;
+		// the pipeline's own sets plus the persistent resource sets
+		u32 numSets = 1 + maxResourceSets;
 		// create descriptor pool
-		int poolID = VulkanImpl::CreateDescriptorPool(VulkanImpl::MAX_FRAMES_IN_FLIGHT * numUniform, numTex, VulkanImpl::MAX_FRAMES_IN_FLIGHT * numSSBO);
+		int poolID = VulkanImpl::CreateDescriptorPool(VulkanImpl::MAX_FRAMES_IN_FLIGHT * numUniform * numSets, numTex * numSets, VulkanImpl::MAX_FRAMES_IN_FLIGHT * numSSBO * numSets);
 		this->descriptorPoolID.id = poolID;
 		// create descriptor sets
 		VulkanImpl::CreateDescriptorSets(layoutID, VulkanImpl::MAX_FRAMES_IN_FLIGHT, poolID, allBuffers, this->textures);
@@ -2847,6 +3803,22 @@ namespace Graphics
 		VulkanImpl::Dispatch(commandList, this->pipelineID.id, this->layoutID, this->descriptorPoolID.id, swapID, this->threadSz, this->invocationSz, this->pushConstants.empty() ? nullptr : &this->pushConstants[0]);
 	}
 
+	void ComputePipeline::Dispatch(ComputeContext& context, int resourceSetID)
+	{
+		u32 swapID = context.frameID % VulkanImpl::MAX_FRAMES_IN_FLIGHT;
+		auto& commandList = context.device->GetComputeCommandList(swapID);
+		VulkanImpl::Dispatch(commandList, this->pipelineID.id, this->layoutID, this->descriptorPoolID.id, resourceSetID + swapID, this->threadSz, this->invocationSz, this->pushConstants.empty() ? nullptr : &this->pushConstants[0]);
+	}
+
+	int ComputePipeline::CreateResourceSets(Vector<SharedPtr<Buffer>>& buffers, Vector<Texture>& textures)
+	{
+		Vector<Graphics::Buffer*> allBuffers{ };
+		for (auto buffer : buffers)
+			allBuffers.push_back(buffer.get());
+		// set i points at the frame i copy of each buffer
+		return VulkanImpl::CreateDescriptorSets(this->layoutID, VulkanImpl::MAX_FRAMES_IN_FLIGHT, this->descriptorPoolID.id, allBuffers, textures);
+	}
+
 	void UniformBuffer::UpdateUniformBuffer(int frameID)
 	{
 		VulkanImpl::UpdateUniformBuffer(GetData(), GetBufferSize(), *this, frameID % VulkanImpl::MAX_FRAMES_IN_FLIGHT);
@@ -2872,13 +3844,10 @@ namespace Graphics
 		VulkanImpl::CreateVertexBuffer(*this);
 		VulkanImpl::CreateIndexBuffer(*this);
 		material = MakeShared<PBRMaterial>();
-		materialUniformBuffer.pbrMaterial = material.get();
 		material->albedoTexture = mainTexture;
 		material->material->hasAlbedoTex = 1;
 
-		geometryID.setID = VulkanImpl::CreateDescriptorSets(pipeline->perMeshLayoutID, 1, pipeline->descriptorPoolID.id, Vector<Graphics::Buffer*>{&this->materialUniformBuffer},
-			Vector<Graphics::Texture>{ this->mainTexture }
-		);
+		VulkanImpl::RegisterMaterial(*material);
 	}
 
 	Cube::Cube(SharedPtr<GraphicsPipeline> pipeline, Texture mainTexture)
@@ -2932,13 +3901,8 @@ namespace Graphics
 		VulkanImpl::CreateVertexBuffer(*this);
 		// VulkanImpl::CreateIndexBuffer(*this);
 		material = MakeShared<PBRMaterial>();
-		materialUniformBuffer.pbrMaterial = material.get();
-		material->albedoTexture = mainTexture;
-		material->material->hasAlbedoTex = 1;
-
-		geometryID.setID = VulkanImpl::CreateDescriptorSets(pipeline->perMeshLayoutID, 1, pipeline->descriptorPoolID.id, Vector<Graphics::Buffer*>{&this->materialUniformBuffer},
-			Vector<Graphics::Texture>{ this->mainTexture}
-		);
+		// the cubemap is sampled through the skybox pass set, the material array only holds 2d textures
+		VulkanImpl::RegisterMaterial(*material);
 	}
 
 	OBJMesh::OBJMesh(SharedPtr<GraphicsPipeline> pipeline, Texture mainTexture, String filename)
@@ -2947,21 +3911,13 @@ namespace Graphics
 		auto vertexDesc = MakeShared<BasicVertex>();
 		Import::LoadOBJ(*vertexDesc, indices, filename);
 		this->vertexDesc = vertexDesc;
+		bounds = vertexDesc->GetBounds();
 		VulkanImpl::CreateVertexBuffer(*this);
 		VulkanImpl::CreateIndexBuffer(*this);
 		material = MakeShared<PBRMaterial>();
-		materialUniformBuffer.pbrMaterial = material.get();
 		material->albedoTexture = mainTexture;
 		material->material->hasAlbedoTex = 1;
-		Vector<Graphics::Texture> textures{};
-		textures.push_back(material->albedoTexture);
-		textures.push_back(material->metallicTexture);
-		textures.push_back(material->normalTexture);
-		textures.push_back(material->occlusionTexture);
-		textures.push_back(material->emissiveTexture);
-		geometryID.setID = VulkanImpl::CreateDescriptorSets(pipeline->perMeshLayoutID, 1, pipeline->descriptorPoolID.id, Vector<Graphics::Buffer*>{&this->materialUniformBuffer},
-			textures
-		);
+		VulkanImpl::RegisterMaterial(*material);
 	}
 	
 	OBJMesh::OBJMesh(SharedPtr<GraphicsPipeline> pipeline, String filename)
@@ -2970,36 +3926,26 @@ namespace Graphics
 		auto vertexDesc = MakeShared<BasicVertex>();
 		Import::LoadOBJ(*vertexDesc, indices, filename);
 		this->vertexDesc = vertexDesc;
+		bounds = vertexDesc->GetBounds();
 		VulkanImpl::CreateVertexBuffer(*this);
 		VulkanImpl::CreateIndexBuffer(*this);
 		material = MakeShared<PBRMaterial>();
-		materialUniformBuffer.pbrMaterial = material.get();
 		material->albedoTexture = mainTexture;
-		Vector<Graphics::Texture> textures{};
-		textures.push_back(material->albedoTexture);
-		textures.push_back(material->metallicTexture);
-		textures.push_back(material->normalTexture);
-		textures.push_back(material->occlusionTexture);
-		textures.push_back(material->emissiveTexture);
-		geometryID.setID = VulkanImpl::CreateDescriptorSets(pipeline->perMeshLayoutID, 1, pipeline->descriptorPoolID.id, Vector<Graphics::Buffer*>{&this->materialUniformBuffer},
-			textures
-		);
+		VulkanImpl::RegisterMaterial(*material);
 	}
 
-	GLTFMesh::GLTFMesh(SharedPtr<GraphicsPipeline> pipeline, String filename, tinygltf::Primitive& mesh, tinygltf::Model& model, SharedPtr<PBRMaterial> pbrMat, Vector<mat4> invBindMatrices)
-		: Geometry(Texture()), inverseBindMatrices{invBindMatrices}
+	GLTFMesh::GLTFMesh(SharedPtr<GraphicsPipeline> pipeline, String filename, tinygltf::Primitive& mesh, tinygltf::Model& model, SharedPtr<PBRMaterial> pbrMat)
+		: Geometry(Texture())
 	{
 		if (pbrMat != nullptr)
-		{
 			material = pbrMat;
-			materialUniformBuffer.pbrMaterial = material.get();
-		}
 		else 
 			material = MakeShared<PBRMaterial>();
 
 		auto vertexDesc = MakeShared<BasicVertex>();
-		Import::LoadGLTFMesh(filename, mesh, model, *vertexDesc, indices, material->albedoTexture, material->metallicTexture, material->normalTexture, material->occlusionTexture, material->emissiveTexture);
+		Import::LoadGLTFMesh(filename, mesh, model, *vertexDesc, indices, material->albedoTexture, material->metallicTexture, material->normalTexture, material->occlusionTexture, material->emissiveTexture, bounds);
 		this->vertexDesc = vertexDesc;
+		Culling::InitAnimatedBounds(*this);
 		VulkanImpl::CreateVertexBuffer(*this);
 		VulkanImpl::CreateIndexBuffer(*this);
 
@@ -3011,13 +3957,14 @@ namespace Graphics
 			Vector<Buffer::BufferUsageType> jointsBufferUsage;
 			jointsBufferUsage.push_back(Buffer::BufferUsageType::BUFFER_STORAGE);
 			jointsBufferUsage.push_back(Buffer::BufferUsageType::BUFFER_TRANSFER_DST);
+			// also a vertex stream for vertex shader skinning
+			jointsBufferUsage.push_back(Buffer::BufferUsageType::BUFFER_VERTEX);
 			jointWeightData = MakeShared<StructuredBuffer>(vertexDesc->GetSkeletonVertices(), vertexDesc->GetSkeletonVerticesCount(), jointsBufferBinding, jointsBufferUsage);
-			skeletonMatrixData = MakeShared<SkeletonUniformBuffer>();
 		}
 
 		if (vertexDesc->hasBlends)
 		{
-			morphWeightData = MakeShared<BlendWeightsUniformBuffer>();
+			morphWeightData = MakeShared<BlendWeightsBuffer>(vertexDesc->blendTargetCount);
 			ResourceBinding morphDataBufferBinding;
 			morphDataBufferBinding.binding = 5;
 			morphDataBufferBinding.shaderStageType = ResourceBinding::ShaderStageType::COMPUTE;
@@ -3027,59 +3974,406 @@ namespace Graphics
 			morphTargetsData = MakeShared<StructuredBuffer>(vertexDesc->GetMorphVertices(), vertexDesc->GetMorphVerticesCount(), morphDataBufferBinding, morphsBufferUsage);
 		}
 
-		Vector<Graphics::Texture> textures{};
+		VulkanImpl::RegisterMaterial(*material);
+	}
+
+
+	GLTFMesh::GLTFMesh(const GLTFMesh& prototype, SharedPtr<Node> node)
+		: Geometry(Texture())
+	{
+		this->node = node;
+		material = prototype.material;
+		geometryID = prototype.geometryID;
+		vertexBuffer = prototype.vertexBuffer;
+		vertexDesc = prototype.vertexDesc;
+		indices = prototype.indices;
+		jointWeightData = prototype.jointWeightData;
+		morphTargetsData = prototype.morphTargetsData;
+		bounds = prototype.bounds;
+		restBounds = prototype.restBounds;
+		jointBounds = prototype.jointBounds;
+		morphDisplacements = prototype.morphDisplacements;
+
+		if (vertexDesc->hasBlends)
+			morphWeightData = MakeShared<BlendWeightsBuffer>(std::static_pointer_cast<BasicVertex>(vertexDesc)->blendTargetCount);
+		if (vertexDesc->hasSkeleton || vertexDesc->hasBlends)
+			VulkanImpl::CreateTransformedVertexBuffer(*this);
+	}
+
+	GLTFMesh::GLTFMesh(const GLTFMesh& materialSource, SharedPtr<BasicVertex> vertexData, Vector<u16>&& indices, SharedPtr<Node> node)
+		: Geometry(Texture())
+	{
+		this->node = node;
+		material = materialSource.material;
+		vertexDesc = vertexData;
+		bounds = vertexData->GetBounds();
+		this->indices = std::move(indices);
+		VulkanImpl::CreateVertexBuffer(*this);
+		VulkanImpl::CreateIndexBuffer(*this);
+	}
+
+	void GLTFMesh::Update(f32 deltaTime)
+	{
+		if (skin && skin->paletteVersion != lastPaletteVersion)
+		{
+			lastPaletteVersion = skin->paletteVersion;
+			poseDirty = true;
+		}
+		if (node->morphWeights != lastMorphWeights)
+		{
+			lastMorphWeights = node->morphWeights;
+			poseDirty = true;
+		}
+
+		auto vertexData = GetVertexData();
+		// palette is built and uploaded once per skin
+		vertexConstant.paletteOffset = skin ? skin->paletteOffset : 0;
+		vertexConstant.hasNormal = vertexData->hasNormal ? 1 : 0;
+		vertexConstant.hasTangent = vertexData->hasTangent ? 1 : 0;
+		vertexConstant.hasSkeleton = vertexData->hasSkeleton ? 1 : 0;
+		// blend deltas are skipped entirely while every weight is zero
+		bool hasActiveBlendShape = false;
+		for (f32 weight : node->morphWeights)
+			hasActiveBlendShape |= weight != 0.f;
+		vertexConstant.hasBlendShape = vertexData->hasBlends && hasActiveBlendShape ? 1 : 0;
+		vertexConstant.vertexCount = vertexData->GetVerticesCount();
+		vertexConstant.vertexStride = sizeof(BasicVertex::Vertex) / sizeof(u32);
+		vertexConstant.skinStride = sizeof(BasicVertex::JointWeightVertex) / sizeof(u32);
+		vertexConstant.skinWeightOffset = 4;
+		vertexConstant.blendShapeCount = node->morphWeights.size();
+		vertexConstant.normalizedBlendShapes = 0;
+		vertexConstant.blend_weight_stride = sizeof(BasicVertex::BlendVertexData) / sizeof(u32); 
+	}
+
+
+	void Geometry::Draw(RenderContext& context)
+	{
+		u32 swapID = context.frameID % VulkanImpl::MAX_FRAMES_IN_FLIGHT;
+		auto& commandList = context.device->GetCommandList(context);
+
+		VulkanImpl::Draw(commandList, *this, node->worldMatrix, context.renderPass->subpasses[context.subPass].pso, context.renderPass->subpasses[context.subPass].pso->descriptorPoolID, swapID, (context.updateFrameID) % VulkanImpl::MAX_FRAMES_IN_FLIGHT);
+	}
+
+	void GLTFMesh::Draw(RenderContext& context)
+	{
+		auto pso = context.renderPass->subpasses[context.subPass].pso;
+		u32 swapID = context.frameID % VulkanImpl::MAX_FRAMES_IN_FLIGHT;
+		auto& commandList = context.device->GetCommandList(context);
+		if (!vertexDesc->hasSkeleton && !vertexDesc->hasBlends)
 		{
-			textures.push_back(material->albedoTexture);
-			textures.push_back(material->metallicTexture);
-			textures.push_back(material->normalTexture);
-			textures.push_back(material->occlusionTexture);
-			textures.push_back(material->emissiveTexture);
+			if (instanceMatrices.empty())
+			{
+				Geometry::Draw(context);
+			}
+			else if (pso->instancedVariant)
+			{
+				// every instance in one draw, the node transform is pushed once
+				VkBuffer instances = VulkanImpl::shaderStorageBuffers[instanceData->extendedBufferIDs[0]];
+				VulkanImpl::DrawVariant(commandList, *this, pso, pso->instancedVariant, instances, 0, swapID, static_cast<u32>(instanceMatrices.size()));
+			}
+			else
+			{
+				// one draw per instance. the node is shared with the other primitives, which may be recorded on other threads
+				for (auto& instanceMatrix : instanceMatrices)
+					VulkanImpl::Draw(commandList, *this, node->worldMatrix * instanceMatrix, pso, pso->descriptorPoolID, swapID, context.updateFrameID % VulkanImpl::MAX_FRAMES_IN_FLIGHT);
+			}
+			return;
 		}
-		geometryID.setID = VulkanImpl::CreateDescriptorSets(pipeline->perMeshLayoutID, 1, pipeline->descriptorPoolID.id, Vector<Graphics::Buffer*>{&this->materialUniformBuffer},
-			textures
-		);		
+		if (skinningMode == SkinningMode::VERTEX_SHADER && pso->skinnedVariant)
+		{
+			// rest pose vertices and the joint weights the compute pass reads
+			VkBuffer jointWeights = VulkanImpl::shaderStorageBuffers[jointWeightData->extendedBufferIDs[0]];
+			VulkanImpl::DrawVariant(commandList, *this, pso, pso->skinnedVariant, jointWeights, skin->paletteOffset, swapID);
+			return;
+		}
+		// static attributes from the source vertices, the rest from the compute or cpu output
+		assert(pso->animatedVariant);
+		VkBuffer transformedVertices = skinningMode == SkinningMode::CPU ?
+			VulkanImpl::shaderStorageBuffers[hostVertices->extendedBufferIDs[swapID]] :
+			VulkanImpl::vertexBuffers[transformedVertexBuffer->extendedBufferIDs[0]];
+		VulkanImpl::DrawVariant(commandList, *this, pso, pso->animatedVariant, transformedVertices, 0, swapID);
 	}
 
+	void Crowd::Draw(RenderContext& context, u32 instanceCount, f32 time)
+	{
+		if (instanceCount == 0)
+			return;
+		u32 swapID = context.frameID % VulkanImpl::MAX_FRAMES_IN_FLIGHT;
+		auto& commandList = context.device->GetCommandList(context);
+		u32 timeBits;
+		memcpy(&timeBits, &time, sizeof(f32));
+		// positions and normals come from the animation buffer, only the static attributes from the mesh
+		VulkanImpl::DrawVariant(commandList, *mesh, context.renderPass->subpasses[context.subPass].pso, pipeline, VK_NULL_HANDLE, timeBits, swapID, instanceCount);
+	}
 
-	void GLTFMesh::Update(f32 deltaTime)
+	void IndirectDraw::BindObjectTable()
 	{
-		if (vertexDesc->hasSkeleton)
+		VulkanImpl::InitBindless();
+		VulkanImpl::UpdateDescriptorSets(VulkanImpl::bindlessPoolID, Vector<Buffer*>{ objectBuffer.get() }, Vector<Texture>{}, VulkanImpl::bindlessSetID, 1, 0);
+		// no frame has counted yet
+		for (u32 i = 0; i < VulkanImpl::MAX_FRAMES_IN_FLIGHT; ++i)
+			memset(viewBuffer->Map(i), 0, sizeof(CullView));
+	}
+
+	void IndirectDraw::Cull(RenderContext& context, const mat4& viewProj, bool occlusion)
+	{
+		lastViewProj = viewProj;
+		occlusionTested = false;
+		if (objects.empty())
+			return;
+		u32 swapID = context.frameID % VulkanImpl::MAX_FRAMES_IN_FLIGHT;
+		auto& commandList = context.device->GetCommandList(swapID);
+		VkCommandBuffer graphicsCommandBuffer = VulkanImpl::commandBuffers[commandList.commandListID];
+		VkBuffer objectTable = VulkanImpl::shaderStorageBuffers[objectBuffer->extendedBufferIDs[0]];
+		VkBuffer commands = VulkanImpl::shaderStorageBuffers[commandBuffer->extendedBufferIDs[0]];
+
+		// before anything of the frame binds the pyramid
+		if (occlusion && depthPyramid->Resize(context))
+			VulkanImpl::UpdateDescriptorSets(cullPipeline->descriptorPoolID.id, Vector<Buffer*>{ depthPyramid->pyramidBuffer.get() }, Vector<Texture>{}, 0, VulkanImpl::MAX_FRAMES_IN_FLIGHT);
+		occlusionTested = occlusion && depthPyramid->isValid;
+
+		// counters of the last frame that used this copy, it finished before recording began
+		CullView& view = *(CullView*)viewBuffer->Map(context.frameID);
+		stats.objects = static_cast<u32>(objects.size());
+		stats.frustumCulled = view.frustumCulled;
+		stats.occluded = view.occluded;
+		stats.rescued = view.firstPhaseOccluded - view.occluded;
+		Math::Frustum frustum(viewProj);
+		for (int i = 0; i < 6; ++i)
+			view.planes[i] = vec4(frustum.nx[i], frustum.ny[i], frustum.nz[i], frustum.d[i]);
+		view.viewProj = viewProj;
+		view.pyramidViewProj = pyramidViewProj;
+		view.frustumCulled = 0;
+		view.firstPhaseOccluded = 0;
+		view.occluded = 0;
+
+		// submitted before this frame, earlier frames may still read the rows being replaced
+		if (!dirtyObjects.empty())
 		{
-			mat4 invWorld = Math::Inverse(node->worldMatrix);
-			for (int i = 0; i < joints.size(); ++i)
+			vkCmdPipelineBarrier(VulkanImpl::GetUploadCommandBuffer(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+			for (u32 object : dirtyObjects)
 			{
-				auto joint = joints[i];
-				auto jointMatrix = (invWorld * joint->worldMatrix * inverseBindMatrices[i]);
-				skeletonMatrixData->data[i] = jointMatrix;
+				VulkanImpl::StagingRange staging = VulkanImpl::AllocateStaging(sizeof(Object));
+				memcpy(staging.data, &objects[object], sizeof(Object));
+				VulkanImpl::CopyBuffer(staging.buffer, objectTable, sizeof(Object), object * sizeof(Object), staging.offset);
+				isDirty[object] = false;
 			}
+			dirtyObjects.clear();
 		}
 
-		auto vertexData = GetVertexData();
-		vertexData->vertexConstant.hasNormal = vertexData->hasNormal ? 1 : 0;
-		vertexData->vertexConstant.hasTangent = vertexData->hasTangent ? 1 : 0;
-		vertexData->vertexConstant.hasSkeleton = vertexData->hasSkeleton ? 1 : 0;
-		vertexData->vertexConstant.hasBlendShape = vertexData->hasBlends ? 1 : 0;
-		vertexData->vertexConstant.vertexCount = vertexData->GetVerticesCount();
-		vertexData->vertexConstant.vertexStride = sizeof(BasicVertex::Vertex) / sizeof(u32);
-		vertexData->vertexConstant.skinStride = sizeof(BasicVertex::JointWeightVertex) / sizeof(u32);
-		vertexData->vertexConstant.skinWeightOffset = 4;
-		vertexData->vertexConstant.blendShapeCount = node->morphWeights.size();
-		vertexData->vertexConstant.normalizedBlendShapes = 0;
-		vertexData->vertexConstant.blend_weight_stride = sizeof(BasicVertex::BlendVertexData) / sizeof(u32); 
+		// the previous frame may still draw from the commands
+		vkCmdPipelineBarrier(graphicsCommandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+		vkCmdFillBuffer(graphicsCommandBuffer, commands, 0, maxGroups * sizeof(u32), 0);
+		VkMemoryBarrier clearBarrier{};
+		clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(graphicsCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+		Dispatch(context, CullConstant{ static_cast<u32>(objects.size()), maxDrawsPerGroup, 0, occlusionTested ? 1u : 0u });
+	}
+
+	void IndirectDraw::CullOccluded(RenderContext& context)
+	{
+		if (objects.empty())
+			return;
+		depthPyramid->Build(context);
+		pyramidViewProj = lastViewProj;
+		if (!occlusionTested)
+			return;
+		u32 swapID = context.frameID % VulkanImpl::MAX_FRAMES_IN_FLIGHT;
+		VkCommandBuffer graphicsCommandBuffer = VulkanImpl::commandBuffers[context.device->GetCommandList(swapID).commandListID];
+
+		// the pre-pass read the counts the second phase adds to
+		VkMemoryBarrier phaseBarrier{};
+		phaseBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		phaseBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		phaseBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(graphicsCommandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &phaseBarrier, 0, nullptr, 0, nullptr);
+
+		Dispatch(context, CullConstant{ static_cast<u32>(objects.size()), maxDrawsPerGroup, 1, 1 });
+	}
+
+	void IndirectDraw::Dispatch(RenderContext& context, const CullConstant& constant)
+	{
+		u32 swapID = context.frameID % VulkanImpl::MAX_FRAMES_IN_FLIGHT;
+		VkCommandBuffer graphicsCommandBuffer = VulkanImpl::commandBuffers[context.device->GetCommandList(swapID).commandListID];
+		cullPipeline->pushConstants[0].SetData(&constant, sizeof(CullConstant));
+		auto cullPipelineID = cullPipeline->pipelineID.id;
+		vkCmdBindPipeline(graphicsCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, VulkanImpl::pipelines[cullPipelineID]);
+		vkCmdPushConstants(graphicsCommandBuffer, VulkanImpl::pipelineLayouts[cullPipelineID], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullConstant), &constant);
+		vkCmdBindDescriptorSets(graphicsCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, VulkanImpl::pipelineLayouts[cullPipelineID], 0, 1,
+			&VulkanImpl::descriptorSetsPerPool[cullPipeline->descriptorPoolID.id][swapID], 0, nullptr);
+		vkCmdDispatch(graphicsCommandBuffer, (constant.objectCount + groupSize - 1) / groupSize, 1, 1);
+
+		// the counters are read on the cpu once the frame finished
+		VkMemoryBarrier commandBarrier{};
+		commandBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		commandBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		commandBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(graphicsCommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &commandBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	void IndirectDraw::DrawDepth(RenderContext& context)
+	{
+		auto pso = context.renderPass->subpasses[context.subPass].pso;
+		if (objects.empty())
+			return;
+		u32 swapID = context.frameID % VulkanImpl::MAX_FRAMES_IN_FLIGHT;
+		auto& commandList = context.device->GetCommandList(context);
+		VkBuffer commands = VulkanImpl::shaderStorageBuffers[commandBuffer->extendedBufferIDs[0]];
+		for (u32 group = 0; group < groups.size(); ++group)
+		{
+			if (groups[group].isMasked)
+				continue;
+			VkDeviceSize commandOffset = maxGroups * sizeof(u32) + group * maxDrawsPerGroup * sizeof(DrawCommand);
+			VkBuffer positions = VulkanImpl::shaderStorageBuffers[positionBuffers[groups[group].positionBuffer]->extendedBufferIDs[0]];
+			VulkanImpl::DrawIndexedIndirectCount(commandList, pso, positions, VulkanImpl::indexBuffers[groups[group].indexBufferID],
+				groups[group].isDoubleSided, commands, commandOffset, group * sizeof(u32), groups[group].objectCount, swapID);
+		}
+	}
 
-		for (int i = 0; i < node->morphWeights.size(); ++i)
+	bool DepthPyramid::Resize(RenderContext& context)
+	{
+		const TextureID& depthTextureID = context.presentation->depthTextureID;
+		const u64 currentView = (u64)VulkanImpl::textureImageViews[depthTextureID.viewID];
+		const bool sizeChanged = header.width != VulkanImpl::swapChainExtent.width || header.height != VulkanImpl::swapChainExtent.height;
+		if (!sizeChanged && currentView == depthView)
+			return false;
+		isValid = false;
+		if (sizeChanged)
+		{
+			SetSize(VulkanImpl::swapChainExtent.width, VulkanImpl::swapChainExtent.height);
+			pyramidBuffer->Resize(GetBufferSize());
+			UploadHeader();
+			buildPipeline->threadSz = vec3(header.levels[0].width, header.levels[0].height, 1);
+		}
+		else
 		{
-			morphWeightData->data[i] = node->morphWeights[i];
+			// sets of the frames in flight may hold the old view
+			vkDeviceWaitIdle(VulkanImpl::device);
 		}
+		depthView = currentView;
+		// the view keeps its slot when the swapchain is recreated
+		VulkanImpl::UpdateDescriptorSets(buildPipeline->descriptorPoolID.id, Vector<Buffer*>{ pyramidBuffer.get() }, buildPipeline->textures, 0, VulkanImpl::MAX_FRAMES_IN_FLIGHT);
+		return sizeChanged;
 	}
 
+	void DepthPyramid::UploadHeader()
+	{
+		// submitted before this frame, earlier frames may still read the old levels
+		vkCmdPipelineBarrier(VulkanImpl::GetUploadCommandBuffer(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+		VulkanImpl::StagingRange staging = VulkanImpl::AllocateStaging(sizeof(Header));
+		memcpy(staging.data, &header, sizeof(Header));
+		VulkanImpl::CopyBuffer(staging.buffer, VulkanImpl::shaderStorageBuffers[pyramidBuffer->extendedBufferIDs[0]], sizeof(Header), 0, staging.offset);
+	}
 
-	void Geometry::Draw(RenderContext& context)
+	void DepthPyramid::Build(RenderContext& context)
 	{
 		u32 swapID = context.frameID % VulkanImpl::MAX_FRAMES_IN_FLIGHT;
-		auto& commandList = context.device->GetCommandList(swapID);
+		VkCommandBuffer graphicsCommandBuffer = VulkanImpl::commandBuffers[context.device->GetCommandList(swapID).commandListID];
+
+		VkImageMemoryBarrier depthBarrier{};
+		depthBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		depthBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		depthBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		depthBarrier.image = VulkanImpl::textureImages[context.presentation->depthTextureID.id];
+		// layout transitions of a depth stencil format cover both aspects
+		depthBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | (VulkanImpl::depthFormatChosen == VK_FORMAT_D32_SFLOAT ? 0 : VK_IMAGE_ASPECT_STENCIL_BIT);
+		depthBarrier.subresourceRange.levelCount = 1;
+		depthBarrier.subresourceRange.layerCount = 1;
+		// the pre-pass depth, and the culling that read the previous pyramid before it is overwritten
+		depthBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		depthBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		depthBarrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		depthBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(graphicsCommandBuffer, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &depthBarrier);
+
+		auto buildPipelineID = buildPipeline->pipelineID.id;
+		vkCmdBindPipeline(graphicsCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, VulkanImpl::pipelines[buildPipelineID]);
+		vkCmdBindDescriptorSets(graphicsCommandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, VulkanImpl::pipelineLayouts[buildPipelineID], 0, 1,
+			&VulkanImpl::descriptorSetsPerPool[buildPipeline->descriptorPoolID.id][swapID], 0, nullptr);
+		VkMemoryBarrier levelBarrier{};
+		levelBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		levelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		for (u32 level = 0; level < header.levelCount; ++level)
+		{
+			BuildConstant constant{ level, sampleCount, { 0, 0 } };
+			vkCmdPushConstants(graphicsCommandBuffer, VulkanImpl::pipelineLayouts[buildPipelineID], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(BuildConstant), &constant);
+			vkCmdDispatch(graphicsCommandBuffer, (header.levels[level].width + groupSize - 1) / groupSize, (header.levels[level].height + groupSize - 1) / groupSize, 1);
+			// the next level reads this one, the culling reads all of them
+			vkCmdPipelineBarrier(graphicsCommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &levelBarrier, 0, nullptr, 0, nullptr);
+		}
 
-		VulkanImpl::Draw(commandList, *this, context.renderPass->subpasses[context.subPass].pso, context.renderPass->subpasses[context.subPass].pso->descriptorPoolID, swapID, (context.updateFrameID) % VulkanImpl::MAX_FRAMES_IN_FLIGHT);
+		// back for the passes that draw after the build
+		depthBarrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		depthBarrier.srcAccessMask = 0;
+		depthBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		vkCmdPipelineBarrier(graphicsCommandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &depthBarrier);
+		isValid = true;
+	}
+
+	void IndirectDraw::Draw(RenderContext& context)
+	{
+		auto pso = context.renderPass->subpasses[context.subPass].pso;
+		if (objects.empty() || !pso->indirectVariant)
+			return;
+		u32 swapID = context.frameID % VulkanImpl::MAX_FRAMES_IN_FLIGHT;
+		auto& commandList = context.device->GetCommandList(context);
+		VkBuffer commands = VulkanImpl::shaderStorageBuffers[commandBuffer->extendedBufferIDs[0]];
+		for (u32 group = 0; group < groups.size(); ++group)
+		{
+			VkDeviceSize commandOffset = maxGroups * sizeof(u32) + group * maxDrawsPerGroup * sizeof(DrawCommand);
+			VulkanImpl::DrawIndexedIndirectCount(commandList, pso->indirectVariant, VulkanImpl::vertexBuffers[groups[group].vertexBufferID], VulkanImpl::indexBuffers[groups[group].indexBufferID],
+				groups[group].isDoubleSided, commands, commandOffset, group * sizeof(u32), groups[group].objectCount, swapID);
+		}
+	}
+
+	void IndirectDraw::ReadCommands(Vector<u32>& counts, Vector<DrawCommand>& commands)
+	{
+		VkDeviceSize bufferSize = GetCommandBufferSize();
+		VkBuffer readbackBuffer;
+		VulkanImpl::MemoryAllocation readbackBufferMemory;
+		VulkanImpl::CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, readbackBuffer, readbackBufferMemory);
+
+		// the frame that culled may still be in flight
+		vkDeviceWaitIdle(VulkanImpl::device);
+		VulkanImpl::CopyBuffer(VulkanImpl::shaderStorageBuffers[commandBuffer->extendedBufferIDs[0]], readbackBuffer, bufferSize);
+		VulkanImpl::WaitUploads();
+
+		u8* data = (u8*)VulkanImpl::MapMemory(readbackBufferMemory);
+		counts.resize(maxGroups);
+		memcpy(counts.data(), data, maxGroups * sizeof(u32));
+		commands.resize(maxGroups * maxDrawsPerGroup);
+		memcpy(commands.data(), data + maxGroups * sizeof(u32), commands.size() * sizeof(DrawCommand));
+
+		vkDestroyBuffer(VulkanImpl::device, readbackBuffer, nullptr);
+		VulkanImpl::FreeMemory(readbackBufferMemory);
+	}
+
+	void GLTFMesh::ReadTransformedVertices(Vector<BasicVertex::DynamicVertex>& out)
+	{
+		VkDeviceSize bufferSize = transformedVertexBuffer->GetBufferSize();
+		VkBuffer readbackBuffer;
+		VulkanImpl::MemoryAllocation readbackBufferMemory;
+		VulkanImpl::CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, readbackBuffer, readbackBufferMemory);
+
+		// compute queue may still be writing
+		vkDeviceWaitIdle(VulkanImpl::device);
+		VulkanImpl::CopyBuffer(VulkanImpl::vertexBuffers[transformedVertexBuffer->extendedBufferIDs[0]], readbackBuffer, bufferSize);
+		VulkanImpl::WaitUploads();
+
+		out.resize(bufferSize / sizeof(BasicVertex::DynamicVertex));
+		void* data;
+		data = VulkanImpl::MapMemory(readbackBufferMemory);
+		memcpy(out.data(), data, out.size() * sizeof(BasicVertex::DynamicVertex));
+
+		vkDestroyBuffer(VulkanImpl::device, readbackBuffer, nullptr);
+		VulkanImpl::FreeMemory(readbackBufferMemory);
 	}
 
 	Texture::Texture(String filename, FormatType formatType, bool autoMipchain)
@@ -3126,14 +4420,149 @@ namespace Graphics
 	void StructuredBuffer::Init()
 	{
 		if (extendedBufferIDs.size() == 0)
-			VulkanImpl::CreateStorageBuffer(GetBufferSize(), GetUsageType(), this);
+		{
+			VulkanImpl::CreateStorageBuffer(GetBufferSize(), GetUsageType(), this, !sharedAcrossFrames);
+			// descriptor sets index the copy by frame
+			while (sharedAcrossFrames && extendedBufferIDs.size() > 0 && extendedBufferIDs.size() < VulkanImpl::MAX_FRAMES_IN_FLIGHT)
+				extendedBufferIDs.push_back(extendedBufferIDs[0]);
+		}
+
+	}
+
+	void SkinPaletteBuffer::Init()
+	{
+		VulkanImpl::CreateMappedStorageBuffer(GetBufferSize(), GetUsageType(), *this);
+		// no version yet, the first write of every skin goes through
+		copyVersions.assign(VulkanImpl::MAX_FRAMES_IN_FLIGHT, Vector<u32>(numJoints, ~0u));
+	}
+
+	void SkinPaletteBuffer::Write(int frameID, u32 offset, const Vector<mat4>& palette, u32 version)
+	{
+		assert(offset + palette.size() <= numJoints);
+		const u32 copy = frameID % VulkanImpl::MAX_FRAMES_IN_FLIGHT;
+		if (copyVersions[copy][offset] == version)
+			return;
+		copyVersions[copy][offset] = version;
+		vec4* rows = (vec4*)VulkanImpl::shaderStorageBuffersMapped[extendedBufferIDs[copy]] + offset * rowsPerJoint;
+		// affine, so the last row is always (0, 0, 0, 1) and is not stored
+		for (const auto& m : palette)
+		{
+			rows[0] = vec4(m[0][0], m[1][0], m[2][0], m[3][0]);
+			rows[1] = vec4(m[0][1], m[1][1], m[2][1], m[3][1]);
+			rows[2] = vec4(m[0][2], m[1][2], m[2][2], m[3][2]);
+			rows += rowsPerJoint;
+		}
+	}
+
+	void BlendWeightsBuffer::Init()
+	{
+		VulkanImpl::CreateMappedStorageBuffer(GetBufferSize(), GetUsageType(), *this);
+	}
+
+	void BlendWeightsBuffer::Write(int frameID, const Vector<f32>& weights)
+	{
+		f32* data = (f32*)VulkanImpl::shaderStorageBuffersMapped[extendedBufferIDs[frameID % VulkanImpl::MAX_FRAMES_IN_FLIGHT]];
+		memcpy(data, weights.data(), Min(static_cast<u32>(weights.size()), numWeights) * sizeof(f32));
+	}
+
+	void MaterialTableBuffer::Init()
+	{
+		auto& shaderStorageBuffer = VulkanImpl::shaderStorageBuffers.emplace_back();
+		auto& shaderStorageBufferMemory = VulkanImpl::shaderStorageBufferMemories.emplace_back();
+		extendedBufferIDs.push_back(VulkanImpl::shaderStorageBuffers.size() - 1);
+		VulkanImpl::CreateBuffer(GetBufferSize(), VulkanImpl::MapToVulkanBUfferUsageFlags(GetUsageType()), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, shaderStorageBuffer, shaderStorageBufferMemory);
+	}
+
+	void MaterialTableBuffer::Upload(const PBRMaterial& material)
+	{
+		assert(material.materialIndex < numMaterials);
+		const VkDeviceSize rowSize = sizeof(PBRMaterial::MaterialData);
+		VulkanImpl::StagingRange staging = VulkanImpl::AllocateStaging(rowSize);
+		memcpy(staging.data, material.material.get(), rowSize);
+		VulkanImpl::CopyBuffer(staging.buffer, VulkanImpl::shaderStorageBuffers[extendedBufferIDs[0]], rowSize, material.materialIndex * rowSize, staging.offset);
+	}
+
+	void TransformBuffer::Init()
+	{
+		auto& shaderStorageBuffer = VulkanImpl::shaderStorageBuffers.emplace_back();
+		auto& shaderStorageBufferMemory = VulkanImpl::shaderStorageBufferMemories.emplace_back();
+		extendedBufferIDs.push_back(VulkanImpl::shaderStorageBuffers.size() - 1);
+		VulkanImpl::CreateBuffer(GetBufferSize(), VulkanImpl::MapToVulkanBUfferUsageFlags(GetUsageType()), VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, shaderStorageBuffer, shaderStorageBufferMemory);
+		VulkanImpl::shaderStorageBuffersMapped.resize(VulkanImpl::shaderStorageBuffers.size(), nullptr);
+		VulkanImpl::shaderStorageBuffersMapped.back() = VulkanImpl::MapMemory(shaderStorageBufferMemory);
+	}
+
+	void TransformBuffer::Reset(int frameID)
+	{
+		this->frameID = frameID % numFrames;
+		count = 0;
+	}
+
+	u32 TransformBuffer::Allocate(const mat4& model)
+	{
+		u32 slot = count.fetch_add(1, std::memory_order_relaxed);
+		if (slot >= numTransformsPerFrame)
+			throw std::runtime_error("transform buffer is full!");
+		u32 index = frameID * numTransformsPerFrame + slot;
+		// each thread writes in order, the mapped memory may be write combined
+		mat4* transforms = (mat4*)VulkanImpl::shaderStorageBuffersMapped[extendedBufferIDs[0]];
+		memcpy(transforms + index, &model, sizeof(mat4));
+		return index;
+	}
+
+	void PBRMaterial::MarkDirty()
+	{
+		// unregistered materials are uploaded when registered
+		if (isDirty || materialIndex == ~0u)
+			return;
+		isDirty = true;
+		VulkanImpl::dirtyMaterials.push_back(this);
+	}
+
+	void HostVertexBuffer::Init()
+	{
+		VulkanImpl::CreateMappedStorageBuffer(GetBufferSize(), GetUsageType(), *this);
+	}
+
+	void* HostVertexBuffer::Map(int frameID)
+	{
+		return VulkanImpl::shaderStorageBuffersMapped[extendedBufferIDs[frameID % VulkanImpl::MAX_FRAMES_IN_FLIGHT]];
+	}
 
+	void HostStorageBuffer::Init()
+	{
+		VulkanImpl::CreateMappedStorageBuffer(GetBufferSize(), GetUsageType(), *this);
+	}
+
+	void* HostStorageBuffer::Map(int frameID)
+	{
+		return VulkanImpl::shaderStorageBuffersMapped[extendedBufferIDs[frameID % VulkanImpl::MAX_FRAMES_IN_FLIGHT]];
+	}
+
+	void DeviceStorageBuffer::Init()
+	{
+		auto& shaderStorageBuffer = VulkanImpl::shaderStorageBuffers.emplace_back();
+		auto& shaderStorageBufferMemory = VulkanImpl::shaderStorageBufferMemories.emplace_back();
+		VulkanImpl::CreateBuffer(GetBufferSize(), VulkanImpl::MapToVulkanBUfferUsageFlags(GetUsageType()), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, shaderStorageBuffer, shaderStorageBufferMemory);
+		// descriptor sets index the copy by frame
+		extendedBufferIDs.assign(VulkanImpl::MAX_FRAMES_IN_FLIGHT, static_cast<u32>(VulkanImpl::shaderStorageBuffers.size() - 1));
+	}
+
+	void DeviceStorageBuffer::Resize(u32 dataSize)
+	{
+		vkDeviceWaitIdle(VulkanImpl::device);
+		this->dataSize = Max(dataSize, 4u);
+		const u32 bufferID = extendedBufferIDs[0];
+		vkDestroyBuffer(VulkanImpl::device, VulkanImpl::shaderStorageBuffers[bufferID], nullptr);
+		VulkanImpl::FreeMemory(VulkanImpl::shaderStorageBufferMemories[bufferID]);
+		VulkanImpl::CreateBuffer(GetBufferSize(), VulkanImpl::MapToVulkanBUfferUsageFlags(GetUsageType()), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			VulkanImpl::shaderStorageBuffers[bufferID], VulkanImpl::shaderStorageBufferMemories[bufferID]);
 	}
 
 	void StructuredBuffer::DrawBuffer(RenderContext& context, u32 numVertex)
 	{
 		u32 swapID = context.frameID % VulkanImpl::MAX_FRAMES_IN_FLIGHT;
-		auto& commandList = context.device->GetCommandList(swapID);
+		auto& commandList = context.device->GetCommandList(context);
 		auto pso = context.renderPass->subpasses[context.subPass].pso;
 		VulkanImpl::DrawBuffer(commandList, *this, numVertex, swapID, pso->descriptorPoolID, pso->uniformDesc, pso->pipelineID);
 	}
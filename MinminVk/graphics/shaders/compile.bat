@@ -6,10 +6,19 @@ glslc particleelcwind.comp -o particleelcwind.spv
 glslc particles.vert -o particlesvert.spv
 glslc particles.frag -o particlesfrag.spv
 glslc skinnedmesh.vert -o skinnedmeshvert.spv
+glslc crowd.vert -o crowdvert.spv
+glslc instanced.vert -o instancedvert.spv
 glslc computevertex.comp -o computevertex.spv
 glslc gbuffer.vert -o gbuffervert.spv
 glslc gbuffer.frag -o gbufferfrag.spv
 glslc fsquad.vert -o fsquadvert.spv 
 glslc fsquad.frag -o fsquadfrag.spv
 glslc skybox.vert -o skyboxvert.spv
-glslc skybox.frag -o skyboxfrag.spv
\ No newline at end of file
+glslc skybox.frag -o skyboxfrag.spv
+glslc cullindirect.comp -o cullindirect.spv
+glslc indirect.vert -o indirectvert.spv
+glslc -DINDIRECT_DRAW triangle.frag -o triangleindirectfrag.spv
+glslc depthprepass.vert -o depthprepassvert.spv
+glslc depthprepass.frag -o depthprepassfrag.spv
+glslc depthpyramid.comp -o depthpyramid.spv
+glslc -DMULTISAMPLED depthpyramid.comp -o depthpyramidms.spv
\ No newline at end of file
@@ -0,0 +1,95 @@
+#version 450
+
+#include "transformcommon.glsl"
+
+// plays a clip baked by VertexAnimation::Bake, one instance per crowd member
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 model;
+    mat4 view;
+    mat4 proj;
+    vec4 lightDirection;
+    vec4 cameraPosition;
+    vec4 lightIntensity;
+} ubo;
+
+// frame major, position as half xyz, octahedral normal as two snorm8 in the last half
+layout(binding = 1, std430) readonly buffer VertexAnimationData {
+    uint frameCount;
+    uint vertexCount;
+    float frameRate;
+    float duration;
+    uvec2 texels[];
+} vat;
+
+struct Instance {
+    vec4 positionYaw;
+    vec4 timeOffsetRate;
+};
+
+layout(binding = 2, std430) readonly buffer InstanceData {
+    Instance instances[];
+} crowd;
+
+layout(push_constant) uniform PushConstants {
+    uint transformIndex;
+    layout(offset = 8) float time;
+} pushConst;
+
+layout(location = 1) in vec3 inColor;
+layout(location = 2) in vec2 inTexCoord;
+layout(location = 4) in vec4 inTangent;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) out vec3 fragNormal;
+layout(location = 3) out vec3 fragPosWS;
+layout(location = 4) out mat3 fragTBN;
+
+vec3 DecodeOctahedral(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
+void Fetch(uint frame, out vec3 position, out vec3 normal) {
+    uvec2 texel = vat.texels[frame * vat.vertexCount + gl_VertexIndex];
+    position = vec3(unpackHalf2x16(texel.x), unpackHalf2x16(texel.y).x);
+    normal = DecodeOctahedral(unpackSnorm4x8(texel.y >> 16).xy);
+}
+
+void main() {
+    Instance instance = crowd.instances[gl_InstanceIndex];
+
+    // loop the clip, blend the two nearest baked frames
+    float t = pushConst.time * instance.timeOffsetRate.y + instance.timeOffsetRate.x;
+    float frame = mod(t, max(vat.duration, 0.0001)) * vat.frameRate;
+    uint frame0 = min(uint(frame), vat.frameCount - 1);
+    uint frame1 = min(frame0 + 1, vat.frameCount - 1);
+    vec3 position0, normal0, position1, normal1;
+    Fetch(frame0, position0, normal0);
+    Fetch(frame1, position1, normal1);
+    vec3 position = mix(position0, position1, fract(frame));
+    vec3 normal = normalize(mix(normal0, normal1, fract(frame)));
+
+    // the mesh's own transform, then the instance's rotation around its origin and offset
+    float c = cos(instance.positionYaw.w);
+    float s = sin(instance.positionYaw.w);
+    mat3 rotation = mat3(c, 0.0, -s, 0.0, 1.0, 0.0, s, 0.0, c);
+    mat4 modelMatrix = transformTable.models[pushConst.transformIndex];
+    vec3 origin = modelMatrix[3].xyz;
+    vec3 positionW = vec3(modelMatrix * vec4(position, 1.0)) - origin;
+    fragPosWS = rotation * positionW + origin + instance.positionYaw.xyz;
+    gl_Position = ubo.proj * ubo.view * vec4(fragPosWS, 1.0);
+    fragColor = inColor;
+    fragTexCoord = inTexCoord;
+
+    vec3 normalW = normalize(rotation * (NormalMatrix(modelMatrix) * normal));
+    fragNormal = normalW;
+    // tangents are not baked, the rest pose tangent made orthogonal to the animated normal
+    vec3 tangentW = normalize(rotation * vec3(modelMatrix * vec4(inTangent.xyz, 0)));
+    tangentW = normalize(tangentW - dot(tangentW, normalW) * normalW);
+    vec3 bitangentW = cross(normalW, tangentW) * inTangent.w;
+
+    fragTBN = mat3(tangentW, normalize(bitangentW), normalW);
+}
@@ -0,0 +1,5 @@
+#version 450
+
+// depth only, no color is written
+void main() {
+}
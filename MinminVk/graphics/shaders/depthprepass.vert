@@ -0,0 +1,28 @@
+#version 450
+
+#include "drawobjectcommon.glsl"
+
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 model;
+    mat4 view;
+    mat4 proj;
+    vec4 lightDirection;
+    vec4 cameraPosition;
+    vec4 lightIntensity;
+} ubo;
+
+// objects culled and drawn by IndirectDraw, indexed by the command's firstInstance
+layout(set = 1, binding = 3, std430) readonly buffer DrawObjects {
+    DrawObject objects[];
+} drawObjects;
+
+layout(location = 0) in vec3 inPosition;
+
+// same math as indirect.vert, which draws over this depth with an equal test
+invariant gl_Position;
+
+void main() {
+    mat4 modelMatrix = drawObjects.objects[gl_InstanceIndex].worldMatrix;
+    vec3 positionWS = vec3(modelMatrix * vec4(inPosition, 1.0));
+    gl_Position = ubo.proj * ubo.view * vec4(positionWS, 1.0);
+}
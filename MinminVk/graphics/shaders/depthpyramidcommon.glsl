@@ -0,0 +1,19 @@
+#define MAX_PYRAMID_LEVELS 16
+
+// level of the DepthPyramid buffer, texels row by row from offset
+struct PyramidLevel {
+    uint width;
+    uint height;
+    uint offset;
+    uint padding;
+};
+
+// start of the DepthPyramid buffer, the texels follow
+struct PyramidHeader {
+    uint levelCount;
+    // of the depth attachment
+    uint width;
+    uint height;
+    uint padding;
+    PyramidLevel levels[MAX_PYRAMID_LEVELS];
+};
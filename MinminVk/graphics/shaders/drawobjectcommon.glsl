@@ -0,0 +1,13 @@
+// row of the IndirectDraw object table, the draw's firstInstance is its index
+struct DrawObject {
+    mat4 worldMatrix;
+    // node space
+    vec4 boundsMin;
+    vec4 boundsMax;
+    uint indexCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint materialIndex;
+    uint hasTangent;
+    uint group;
+};
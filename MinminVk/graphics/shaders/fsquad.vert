@@ -10,8 +10,7 @@ layout(binding = 0) uniform UniformBufferObject {
 } ubo;
 
 layout(push_constant) uniform PushConstants {
-    mat4 modelMatrix;
-    mat4 inverseTransposeModel;
+    uint transformIndex;
 } pushConst;
 
 layout(location = 0) in vec3 inPosition;
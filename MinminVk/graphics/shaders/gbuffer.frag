@@ -1,4 +1,5 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
 layout (location = 0) in vec3 inNormal;
 layout (location = 1) in vec4 inColor;
@@ -17,16 +18,14 @@ layout (constant_id = 1) const float FAR_PLANE = 1000.0f;
 
 layout(push_constant) uniform PushConstants {
     //mat4 modelMatrix;
-    layout(offset = 128) uint hasTangent;
+    layout(offset = 4) uint hasTangent;
+    layout(offset = 12) uint materialIndex;
 } pushConst;
 
-layout(set = 1, binding = 0) uniform sampler2D texColor;
-layout(set = 1, binding = 1) uniform sampler2D texMetallic;
-layout(set = 1, binding = 2) uniform sampler2D texNormal;
-layout(set = 1, binding = 3) uniform sampler2D texOcclusion;
-layout(set = 1, binding = 4) uniform sampler2D texEmissive;
+// every material texture, indexed by the material's slots
+layout(set = 1, binding = 0) uniform sampler2D textures[];
 
-layout(set = 1, binding = 5) uniform UniformBufferMat {
+struct MaterialData {
     vec4 baseColor;
     vec4 emissiveColor;
     float metallic;
@@ -40,7 +39,16 @@ layout(set = 1, binding = 5) uniform UniformBufferMat {
     uint alphaMode;
     float alphaCutoff;
     float occlusionStrength;
-} uboMat;
+    uint albedoTexIndex;
+    uint metallicTexIndex;
+    uint normalTexIndex;
+    uint occlusionTexIndex;
+    uint emissiveTexIndex;
+};
+
+layout(set = 1, binding = 1, std430) readonly buffer MaterialTable {
+    MaterialData materials[];
+} materialTable;
 
 float linearDepth(float depth)
 {
@@ -50,46 +58,47 @@ float linearDepth(float depth)
 
 void main() 
 {
+	MaterialData material = materialTable.materials[pushConst.materialIndex];
 	outPositionDepth = vec4(inWorldPos, 1.0);
 
 	vec3 N = normalize(inNormal);
-    if (uboMat.hasNormalTex > 0 && pushConst.hasTangent > 0)
+    if (material.hasNormalTex > 0 && pushConst.hasTangent > 0)
     {
-        vec3 normalTex = texture(texNormal, inTexCoord).rgb;
+        vec3 normalTex = texture(textures[material.normalTexIndex], inTexCoord).rgb;
         N = normalize(normalTex * 2. - vec3(1.));
         N = normalize(fragTBN * N);
     }
-    if (uboMat.isDoubleSided == 1 && !gl_FrontFacing)
+    if (material.isDoubleSided == 1 && !gl_FrontFacing)
     {
         N = -N;
     }
 	outNormal = vec4(N, 0.0);
 
- 	vec3 albedo = uboMat.baseColor.xyz * inColor.rgb;
+ 	vec3 albedo = material.baseColor.xyz * inColor.rgb;
     
-    vec4 colorFromTex = texture(texColor, inTexCoord);
-    if (uboMat.alphaMode == 2)
+    vec4 colorFromTex = texture(textures[material.albedoTexIndex], inTexCoord);
+    if (material.alphaMode == 2)
     {
-        if (colorFromTex.a < uboMat.alphaCutoff)
+        if (colorFromTex.a < material.alphaCutoff)
             discard;
     }
-    if (uboMat.hasAlbedoTex > 0)
+    if (material.hasAlbedoTex > 0)
         albedo *= colorFromTex.rgb;
 	outAlbedo = vec4(albedo, 0);
 
-	float metallic = uboMat.metallic;
-	float roughness = uboMat.roughness;
-	if (uboMat.hasMetallicRoughnessTex > 0)
+	float metallic = material.metallic;
+	float roughness = material.roughness;
+	if (material.hasMetallicRoughnessTex > 0)
     {
-        vec3 mr = texture(texMetallic, inTexCoord).rgb;
+        vec3 mr = texture(textures[material.metallicTexIndex], inTexCoord).rgb;
         metallic = mr.b;
         roughness = mr.g;
     }
 	outSpecular = vec4(metallic, roughness, 0, 0);
 
-	if (uboMat.hasEmissiveTex > 0)
+	if (material.hasEmissiveTex > 0)
     {
-        vec3 emissive = texture(texEmissive, inTexCoord).rgb * uboMat.emissiveColor.rgb;
+        vec3 emissive = texture(textures[material.emissiveTexIndex], inTexCoord).rgb * material.emissiveColor.rgb;
 		// pack emissive into outAlbedo.a, outSpecular.b, outSpecular.a
         outAlbedo = vec4(albedo, emissive.r);
 		outSpecular = vec4(outSpecular.rg, emissive.g, emissive.b);
@@ -1,5 +1,7 @@
 #version 450
 
+#include "transformcommon.glsl"
+
 layout (location = 0) out vec3 outNormal;
 layout (location = 1) out vec4 outColor;
 layout (location = 2) out vec3 outWorldPos;
@@ -16,8 +18,7 @@ layout(binding = 0) uniform UniformBufferObject {
 } ubo;
 
 layout(push_constant) uniform PushConstants {
-    mat4 modelMatrix;
-    mat4 inverseTransposeModel;
+    uint transformIndex;
 } pushConst;
 
 layout(location = 0) in vec3 inPosition;
@@ -29,18 +30,19 @@ layout(location = 4) in vec4 inTangent;
 
 void main() 
 {
-    outWorldPos = vec3(pushConst.modelMatrix * vec4(inPosition, 1.0));
+    mat4 modelMatrix = transformTable.models[pushConst.transformIndex];
+    outWorldPos = vec3(modelMatrix * vec4(inPosition, 1.0));
     gl_Position = ubo.proj * ubo.view * vec4(outWorldPos, 1.0);
 
     vec3 normal = inNormal;
-    vec3 normalW = normalize(vec3(pushConst.inverseTransposeModel * vec4(normalize(normal), 0)));
+    vec3 normalW = normalize(NormalMatrix(modelMatrix) * normalize(normal));
     outNormal = normalW;
 	
 	outColor = vec4(inColor, 1);
 
     outTexCoord = inTexCoord;
 
-    vec3 tangentW = normalize(vec3(pushConst.modelMatrix * vec4(normalize(inTangent.xyz), 0)));
+    vec3 tangentW = normalize(vec3(modelMatrix * vec4(normalize(inTangent.xyz), 0)));
     //tangentW = normalize(tangentW - dot(tangentW, normalW) * normalW);
     vec3 bitangentW = cross(normalW, tangentW) * inTangent.w;
 
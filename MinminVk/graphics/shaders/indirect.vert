@@ -0,0 +1,50 @@
+#version 450
+
+#include "drawobjectcommon.glsl"
+#include "transformcommon.glsl"
+
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 model;
+    mat4 view;
+    mat4 proj;
+    vec4 lightDirection;
+    vec4 cameraPosition;
+    vec4 lightIntensity;
+} ubo;
+
+// objects culled and drawn by IndirectDraw, indexed by the command's firstInstance
+layout(set = 1, binding = 3, std430) readonly buffer DrawObjects {
+    DrawObject objects[];
+} drawObjects;
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inColor;
+layout(location = 2) in vec2 inTexCoord;
+layout(location = 3) in vec3 inNormal;
+layout(location = 4) in vec4 inTangent;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) out vec3 fragNormal;
+layout(location = 3) out vec3 fragPosWS;
+layout(location = 4) out mat3 fragTBN;
+// material index and tangent flag, pushed for the other draws
+layout(location = 7) flat out uvec2 fragDrawObject;
+// same depth as depthprepass.vert, so the pre-pass depth passes the equal test
+invariant gl_Position;
+
+void main() { 
+    DrawObject object = drawObjects.objects[gl_InstanceIndex];
+    mat4 modelMatrix = object.worldMatrix;
+    fragPosWS = vec3(modelMatrix * vec4(inPosition, 1.0));
+    gl_Position = ubo.proj * ubo.view * vec4(fragPosWS, 1.0);
+    fragColor = inColor;
+    fragTexCoord = inTexCoord;
+    vec3 normalW = normalize(NormalMatrix(modelMatrix) * normalize(inNormal));
+    fragNormal = normalW;
+    vec3 tangentW = normalize(vec3(modelMatrix * vec4(normalize(inTangent.xyz), 0)));
+    vec3 bitangentW = cross(normalW, tangentW) * inTangent.w;
+
+    fragTBN = mat3(tangentW, normalize(bitangentW), normalW);
+    fragDrawObject = uvec2(object.materialIndex, object.hasTangent);
+}
@@ -0,0 +1,45 @@
+#version 450
+
+#include "transformcommon.glsl"
+
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 model;
+    mat4 view;
+    mat4 proj;
+    vec4 lightDirection;
+    vec4 cameraPosition;
+    vec4 lightIntensity;
+} ubo;
+
+layout(push_constant) uniform PushConstants {
+    uint transformIndex;
+} pushConst;
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inColor;
+layout(location = 2) in vec2 inTexCoord;
+layout(location = 3) in vec3 inNormal;
+layout(location = 4) in vec4 inTangent;
+// EXT_mesh_gpu_instancing transform relative to the node, locations 5 to 8
+layout(location = 5) in mat4 inInstanceMatrix;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) out vec3 fragNormal;
+layout(location = 3) out vec3 fragPosWS;
+layout(location = 4) out mat3 fragTBN;
+
+void main() { 
+    mat4 modelMatrix = transformTable.models[pushConst.transformIndex] * inInstanceMatrix;
+    mat3 normalMatrix = NormalMatrix(modelMatrix);
+    fragPosWS = vec3(modelMatrix * vec4(inPosition, 1.0));
+    gl_Position = ubo.proj * ubo.view * vec4(fragPosWS, 1.0);
+    fragColor = inColor;
+    fragTexCoord = inTexCoord;
+    vec3 normalW = normalize(normalMatrix * normalize(inNormal));
+    fragNormal = normalW;
+    vec3 tangentW = normalize(vec3(modelMatrix * vec4(normalize(inTangent.xyz), 0)));
+    vec3 bitangentW = cross(normalW, tangentW) * inTangent.w;
+
+    fragTBN = mat3(tangentW, normalize(bitangentW), normalW);
+}
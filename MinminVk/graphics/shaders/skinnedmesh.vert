@@ -1,6 +1,8 @@
 #version 450
 
-// DEPRECATED. computevertex.comp is used now
+#include "transformcommon.glsl"
+
+// skinning in the vertex shader, alternative to computevertex.comp for meshes without blend shapes
 layout(binding = 0) uniform UniformBufferObject {
     mat4 model;
     mat4 view;
@@ -8,21 +10,25 @@ layout(binding = 0) uniform UniformBufferObject {
     vec4 lightDirection;
     vec4 cameraPosition;
     vec4 lightIntensity;
-    mat4 jointMatrices[128]; 
 } ubo;
 
+// palettes of all skins, three rows per joint
+layout(binding = 1, std430) readonly buffer SkeletonData {
+    vec4 data[];
+} bone_transforms;
+
 layout(push_constant) uniform PushConstants {
-    mat4 modelMatrix;
-    mat4 inverseTransposeModel;
+    uint transformIndex;
+    layout(offset = 8) uint paletteOffset;
 } pushConst;
 
 layout(location = 0) in vec3 inPosition;
-layout(location = 1) in vec2 inTexCoord;
-layout(location = 2) in vec3 inNormal;
-layout(location = 3) in vec4 inWeights;
-layout(location = 4) in uvec4 inJoints;
-layout(location = 5) in vec4 inTangent;
-layout(location = 6) in vec3 inColor;
+layout(location = 1) in vec3 inColor;
+layout(location = 2) in vec2 inTexCoord;
+layout(location = 3) in vec3 inNormal;
+layout(location = 4) in vec4 inTangent;
+layout(location = 5) in uvec4 inJoints;
+layout(location = 6) in vec4 inWeights;
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
@@ -31,26 +37,36 @@ layout(location = 3) out vec3 fragPosWS;
 layout(location = 4) out mat3 fragTBN;
 
 void main() {
-    //gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
-    mat4 skinMatrix = 
-        inWeights.x * ubo.jointMatrices[int(inJoints.x)] +
-        inWeights.y * ubo.jointMatrices[int(inJoints.y)] +
-        inWeights.z * ubo.jointMatrices[int(inJoints.z)] +
-        inWeights.w * ubo.jointMatrices[int(inJoints.w)];
-    
-    fragPosWS = vec3(pushConst.modelMatrix * skinMatrix * vec4(inPosition, 1.0));
-
-    gl_Position = ubo.proj * ubo.view
-        * vec4(fragPosWS, 1.0);
-    
-    fragTexCoord = inTexCoord;
+    uvec4 rows = (uvec4(pushConst.paletteOffset) + inJoints) * 3;
+    vec4 row0 =
+        inWeights.x * bone_transforms.data[rows.x + 0] +
+        inWeights.y * bone_transforms.data[rows.y + 0] +
+        inWeights.z * bone_transforms.data[rows.z + 0] +
+        inWeights.w * bone_transforms.data[rows.w + 0];
+    vec4 row1 =
+        inWeights.x * bone_transforms.data[rows.x + 1] +
+        inWeights.y * bone_transforms.data[rows.y + 1] +
+        inWeights.z * bone_transforms.data[rows.z + 1] +
+        inWeights.w * bone_transforms.data[rows.w + 1];
+    vec4 row2 =
+        inWeights.x * bone_transforms.data[rows.x + 2] +
+        inWeights.y * bone_transforms.data[rows.y + 2] +
+        inWeights.z * bone_transforms.data[rows.z + 2] +
+        inWeights.w * bone_transforms.data[rows.w + 2];
+
+    vec3 position = vec3(dot(row0, vec4(inPosition, 1.0)), dot(row1, vec4(inPosition, 1.0)), dot(row2, vec4(inPosition, 1.0)));
+    vec3 normal = vec3(dot(row0.xyz, inNormal), dot(row1.xyz, inNormal), dot(row2.xyz, inNormal));
+    vec3 tangent = vec3(dot(row0.xyz, inTangent.xyz), dot(row1.xyz, inTangent.xyz), dot(row2.xyz, inTangent.xyz));
 
-    vec3 normalW = normalize(vec3(pushConst.inverseTransposeModel * transpose(inverse(skinMatrix)) * vec4(normalize(inNormal), 0)));
+    mat4 modelMatrix = transformTable.models[pushConst.transformIndex];
+    fragPosWS = vec3(modelMatrix * vec4(position, 1.0));
+    gl_Position = ubo.proj * ubo.view * vec4(fragPosWS, 1.0);
+    fragColor = inColor;
+    fragTexCoord = inTexCoord;
+    vec3 normalW = normalize(NormalMatrix(modelMatrix) * normalize(normal));
     fragNormal = normalW;
-    vec3 tangentW = normalize(vec3(pushConst.modelMatrix * skinMatrix * vec4(normalize(inTangent.xyz), 0)));
-    //tangentW = normalize(tangentW - dot(tangentW, normalW) * normalW);
+    vec3 tangentW = normalize(vec3(modelMatrix * vec4(normalize(tangent), 0)));
     vec3 bitangentW = cross(normalW, tangentW) * inTangent.w;
 
     fragTBN = mat3(tangentW, normalize(bitangentW), normalW);
-    fragColor = inColor;
-}
\ No newline at end of file
+}
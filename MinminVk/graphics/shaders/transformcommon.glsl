@@ -0,0 +1,13 @@
+// world matrices of the draws recorded this frame, indexed by the pushed transform index
+layout(set = 1, binding = 2, std430) readonly buffer TransformTable {
+    mat4 models[];
+} transformTable;
+
+// cofactor of the upper 3x3, the inverse transpose scaled by the determinant.
+// normals are normalized after, only the sign of the determinant is kept
+mat3 NormalMatrix(mat4 m) {
+    vec3 c0 = cross(m[1].xyz, m[2].xyz);
+    vec3 c1 = cross(m[2].xyz, m[0].xyz);
+    vec3 c2 = cross(m[0].xyz, m[1].xyz);
+    return mat3(c0, c1, c2) * sign(dot(m[0].xyz, c0));
+}
@@ -1,4 +1,5 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
 #include "lightingcommon.glsl"
 
@@ -12,9 +13,20 @@ layout(location = 0) out vec4 outColor;
 
 layout(push_constant) uniform PushConstants {
     //mat4 modelMatrix;
-    layout(offset = 128) uint hasTangent;
+    layout(offset = 4) uint hasTangent;
+    layout(offset = 12) uint materialIndex;
 } pushConst;
 
+#ifdef INDIRECT_DRAW
+// from the draw object, indirect draws have no per draw push constants
+layout(location = 7) flat in uvec2 fragDrawObject;
+#define MATERIAL_INDEX fragDrawObject.x
+#define HAS_TANGENT fragDrawObject.y
+#else
+#define MATERIAL_INDEX pushConst.materialIndex
+#define HAS_TANGENT pushConst.hasTangent
+#endif
+
 layout(binding = 0) uniform UniformBufferPass {
     mat4 model;
     mat4 view;
@@ -24,13 +36,10 @@ layout(binding = 0) uniform UniformBufferPass {
     vec4 lightIntensity;
 } uboPass;
 
-layout(set = 1, binding = 0) uniform sampler2D texColor;
-layout(set = 1, binding = 1) uniform sampler2D texMetallic;
-layout(set = 1, binding = 2) uniform sampler2D texNormal;
-layout(set = 1, binding = 3) uniform sampler2D texOcclusion;
-layout(set = 1, binding = 4) uniform sampler2D texEmissive;
+// every material texture, indexed by the material's slots
+layout(set = 1, binding = 0) uniform sampler2D textures[];
 
-layout(set = 1, binding = 5) uniform UniformBufferMat {
+struct MaterialData {
     vec4 baseColor;
     vec4 emissiveColor;
     float metallic;
@@ -44,33 +53,43 @@ layout(set = 1, binding = 5) uniform UniformBufferMat {
     uint alphaMode;
     float alphaCutoff;
     float occlusionStrength;
-} uboMat;
+    uint albedoTexIndex;
+    uint metallicTexIndex;
+    uint normalTexIndex;
+    uint occlusionTexIndex;
+    uint emissiveTexIndex;
+};
+
+layout(set = 1, binding = 1, std430) readonly buffer MaterialTable {
+    MaterialData materials[];
+} materialTable;
 
 void main() {
+    MaterialData material = materialTable.materials[MATERIAL_INDEX];
 
     vec3 lightIntensity = vec3(uboPass.lightIntensity);
     vec3 l_metal_brdf = vec3(0.0);
-    float metallic = uboMat.metallic; 
-    float roughness = uboMat.roughness; 
+    float metallic = material.metallic; 
+    float roughness = material.roughness; 
     vec3 n = normalize(fragNormal);
     vec3 l = normalize(uboPass.lightDirection.xyz);
     vec3 v = normalize(uboPass.cameraPosition.xyz - fragPosWS); 
     vec3 h = normalize(l + v);         
 
-    if (uboMat.hasMetallicRoughnessTex > 0)
+    if (material.hasMetallicRoughnessTex > 0)
     {
-        vec3 mr = texture(texMetallic, fragTexCoord).rgb;
+        vec3 mr = texture(textures[material.metallicTexIndex], fragTexCoord).rgb;
         metallic = mr.b;
         roughness = mr.g;
     }
-    if (uboMat.hasNormalTex > 0 && pushConst.hasTangent > 0)
+    if (material.hasNormalTex > 0 && HAS_TANGENT > 0)
     {
-        vec3 normalTex = texture(texNormal, fragTexCoord).rgb;
+        vec3 normalTex = texture(textures[material.normalTexIndex], fragTexCoord).rgb;
         n = normalize(normalTex * 2. - vec3(1.));
         n = normalize(fragTBN * n);
     }
 
-    if (uboMat.isDoubleSided == 1 && !gl_FrontFacing)
+    if (material.isDoubleSided == 1 && !gl_FrontFacing)
     {
         n = -n;
     }
@@ -78,25 +97,25 @@ void main() {
     metallic = clamp(metallic, 0, 1);
     roughness = clamp(roughness, 0, 1);
     float intensity = 1; // TODO (light attenuation)
-    vec3 albedo = uboMat.baseColor.xyz * fragColor;
+    vec3 albedo = material.baseColor.xyz * fragColor;
     
-    vec4 colorFromTex = texture(texColor, fragTexCoord);
-    if (uboMat.hasAlbedoTex > 0)
+    vec4 colorFromTex = texture(textures[material.albedoTexIndex], fragTexCoord);
+    if (material.hasAlbedoTex > 0)
         albedo *= colorFromTex.rgb;
 
     // cutoff
-    if (uboMat.alphaMode == 2)
+    if (material.alphaMode == 2)
     {
-        if (colorFromTex.a < uboMat.alphaCutoff)
+        if (colorFromTex.a < material.alphaCutoff)
             discard;
     }
 
-    if (uboMat.hasOcclusionTex > 0)
+    if (material.hasOcclusionTex > 0)
     {
         // direct lighting unaffected
         // TODO enable when implemented indirect lighting
-        //vec3 occ = texture(texOcclusion, fragTexCoord).rgb;
-        //float occFactor = 1.0 + uboMat.occlusionStrength * (occ.r - 1.0);
+        //vec3 occ = texture(textures[material.occlusionTexIndex], fragTexCoord).rgb;
+        //float occFactor = 1.0 + material.occlusionStrength * (occ.r - 1.0);
     }
 
 
@@ -120,15 +139,15 @@ void main() {
     l_dielectric_brdf = mix(l_diffuse, l_specular_dielectric, dielectric_fresnel);
     vec3 l_color = mix(l_dielectric_brdf, l_metal_brdf, metallic);
 
-    if (uboMat.hasEmissiveTex > 0)
+    if (material.hasEmissiveTex > 0)
     {
-        vec3 emissive = texture(texEmissive, fragTexCoord).rgb * uboMat.emissiveColor.rgb;
+        vec3 emissive = texture(textures[material.emissiveTexIndex], fragTexCoord).rgb * material.emissiveColor.rgb;
         l_color += emissive;
     }
 
 
-    outColor = vec4(l_color, colorFromTex.a * uboMat.baseColor.a);
-    //outColor = vec4( texture(texColor, fragTexCoord).rgb, 1);
+    outColor = vec4(l_color, colorFromTex.a * material.baseColor.a);
+    //outColor = vec4( texture(textures[material.albedoTexIndex], fragTexCoord).rgb, 1);
     //outColor = vec4(1);
     //outColor = vec4(fragNormal, 1);
     //outColor = vec4(roughness,0,0, 1);
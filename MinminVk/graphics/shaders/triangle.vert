@@ -1,5 +1,7 @@
 #version 450
 
+#include "transformcommon.glsl"
+
 layout(binding = 0) uniform UniformBufferObject {
     mat4 model;
     mat4 view;
@@ -10,8 +12,7 @@ layout(binding = 0) uniform UniformBufferObject {
 } ubo;
 
 layout(push_constant) uniform PushConstants {
-    mat4 modelMatrix;
-    mat4 inverseTransposeModel;
+    uint transformIndex;
 } pushConst;
 
 layout(location = 0) in vec3 inPosition;
@@ -27,14 +28,15 @@ layout(location = 3) out vec3 fragPosWS;
 layout(location = 4) out mat3 fragTBN;
 
 void main() { 
-    fragPosWS = vec3(pushConst.modelMatrix * vec4(inPosition, 1.0));
+    mat4 modelMatrix = transformTable.models[pushConst.transformIndex];
+    fragPosWS = vec3(modelMatrix * vec4(inPosition, 1.0));
     gl_Position = ubo.proj * ubo.view * vec4(fragPosWS, 1.0);
     fragColor = inColor;
     fragTexCoord = inTexCoord;
     vec3 normal = inNormal;
-    vec3 normalW = normalize(vec3(pushConst.inverseTransposeModel * vec4(normalize(normal), 0)));
+    vec3 normalW = normalize(NormalMatrix(modelMatrix) * normalize(normal));
     fragNormal = normalW;
-    vec3 tangentW = normalize(vec3(pushConst.modelMatrix * vec4(normalize(inTangent.xyz), 0)));
+    vec3 tangentW = normalize(vec3(modelMatrix * vec4(normalize(inTangent.xyz), 0)));
     //tangentW = normalize(tangentW - dot(tangentW, normalW) * normalW);
     vec3 bitangentW = cross(normalW, tangentW) * inTangent.w;
 
@@ -0,0 +1,74 @@
+#include "FreeListAllocator.h"
+#include <cassert>
+
+using namespace Util;
+
+FreeListAllocator::FreeListAllocator(u64 size)
+	: size{ size }, freeSize{ size }
+{
+	if (size > 0)
+		freeBlocks[0] = size;
+}
+
+u64 FreeListAllocator::Allocate(u64 allocationSize, u64 alignment)
+{
+	assert(alignment > 0);
+	if (allocationSize == 0)
+		allocationSize = 1;
+	for (auto block = freeBlocks.begin(); block != freeBlocks.end(); ++block)
+	{
+		u64 blockOffset = block->first;
+		u64 blockEnd = block->first + block->second;
+		u64 offset = (blockOffset + alignment - 1) / alignment * alignment;
+		if (offset + allocationSize > blockEnd)
+			continue;
+
+		freeBlocks.erase(block);
+		// padding in front and the rest stay free
+		if (offset > blockOffset)
+			freeBlocks[blockOffset] = offset - blockOffset;
+		if (offset + allocationSize < blockEnd)
+			freeBlocks[offset + allocationSize] = blockEnd - (offset + allocationSize);
+		freeSize -= allocationSize;
+		return offset;
+	}
+	return invalidOffset;
+}
+
+void FreeListAllocator::Free(u64 offset, u64 allocationSize)
+{
+	if (allocationSize == 0)
+		allocationSize = 1;
+	assert(offset + allocationSize <= size);
+	freeSize += allocationSize;
+
+	auto next = freeBlocks.lower_bound(offset);
+	assert(next == freeBlocks.end() || next->first >= offset + allocationSize);
+	// merge with the block ending where this one starts
+	if (next != freeBlocks.begin())
+	{
+		auto previous = std::prev(next);
+		assert(previous->first + previous->second <= offset);
+		if (previous->first + previous->second == offset)
+		{
+			offset = previous->first;
+			allocationSize += previous->second;
+			freeBlocks.erase(previous);
+		}
+	}
+	// and with the one starting where it ends
+	if (next != freeBlocks.end() && next->first == offset + allocationSize)
+	{
+		allocationSize += next->second;
+		freeBlocks.erase(next);
+	}
+	freeBlocks[offset] = allocationSize;
+}
+
+u64 FreeListAllocator::GetLargestFreeBlock() const
+{
+	u64 largest = 0;
+	for (auto& [offset, blockSize] : freeBlocks)
+		largest = Max(largest, blockSize);
+	return largest;
+}
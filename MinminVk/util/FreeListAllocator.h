@@ -0,0 +1,33 @@
+#pragma once
+
+#include <util/Type.h>
+
+namespace Util
+{
+	// offsets into a fixed size range, for sub-allocating one large gpu buffer. first fit over the free blocks,
+	// which are kept sorted by offset and merged with their neighbours when a range is freed
+	struct FreeListAllocator
+	{
+		static const u64 invalidOffset = ~0ull;
+
+		FreeListAllocator(u64 size = 0);
+
+		// offset is a multiple of alignment, which does not need to be a power of two (a vertex stride).
+		// invalidOffset if no free block fits
+		u64 Allocate(u64 size, u64 alignment = 1);
+
+		// size as allocated
+		void Free(u64 offset, u64 size);
+
+		u64 GetSize() const { return size; }
+		u64 GetFreeSize() const { return freeSize; }
+		u64 GetLargestFreeBlock() const;
+		u32 GetFreeBlockCount() const { return static_cast<u32>(freeBlocks.size()); }
+
+	private:
+		u64 size;
+		u64 freeSize;
+		// offset to size
+		Map<u64, u64> freeBlocks;
+	};
+}
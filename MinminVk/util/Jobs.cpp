@@ -0,0 +1,126 @@
+#include "Jobs.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+namespace Util
+{
+	namespace
+	{
+		thread_local bool insideJob = false;
+		std::atomic<bool> jobsEnabled{ true };
+
+		struct JobPool
+		{
+			Vector<std::thread> workers;
+			std::mutex submitMutex;
+			std::mutex mutex;
+			std::condition_variable wake;
+			std::condition_variable done;
+
+			const std::function<void(u32)>* job = nullptr;
+			u32 count = 0;
+			std::atomic<u32> next{ 0 };
+			u32 generation = 0;
+			u32 busyWorkers = 0;
+			bool quit = false;
+
+			JobPool()
+			{
+				u32 numThreads = std::thread::hardware_concurrency();
+				u32 numWorkers = numThreads > 1 ? numThreads - 1 : 0;
+				for (u32 i = 0; i < numWorkers; ++i)
+					workers.emplace_back([this]() { WorkerLoop(); });
+			}
+
+			~JobPool()
+			{
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					quit = true;
+				}
+				wake.notify_all();
+				for (auto& worker : workers)
+					worker.join();
+			}
+
+			void RunJobs()
+			{
+				insideJob = true;
+				for (u32 i = next.fetch_add(1); i < count; i = next.fetch_add(1))
+					(*job)(i);
+				insideJob = false;
+			}
+
+			void WorkerLoop()
+			{
+				u32 seenGeneration = 0;
+				while (true)
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					wake.wait(lock, [&]() { return quit || (job != nullptr && generation != seenGeneration); });
+					if (quit)
+						return;
+					seenGeneration = generation;
+					busyWorkers++;
+					lock.unlock();
+
+					RunJobs();
+
+					lock.lock();
+					busyWorkers--;
+					lock.unlock();
+					done.notify_one();
+				}
+			}
+		};
+
+		JobPool& GetPool()
+		{
+			static JobPool pool;
+			return pool;
+		}
+	}
+
+	void Jobs::ParallelFor(u32 count, const std::function<void(u32)>& job)
+	{
+		if (count == 0)
+			return;
+
+		JobPool& pool = GetPool();
+		if (count == 1 || insideJob || !jobsEnabled || pool.workers.empty())
+		{
+			for (u32 i = 0; i < count; ++i)
+				job(i);
+			return;
+		}
+
+		std::lock_guard<std::mutex> submitLock(pool.submitMutex);
+		std::unique_lock<std::mutex> lock(pool.mutex);
+		pool.job = &job;
+		pool.count = count;
+		pool.next = 0;
+		pool.generation++;
+		lock.unlock();
+		pool.wake.notify_all();
+
+		pool.RunJobs();
+
+		// every index is claimed, wait for the workers still running theirs
+		lock.lock();
+		pool.done.wait(lock, [&]() { return pool.busyWorkers == 0; });
+		pool.job = nullptr;
+	}
+
+	u32 Jobs::GetWorkerCount()
+	{
+		return static_cast<u32>(GetPool().workers.size());
+	}
+
+	void Jobs::SetEnabled(bool enabled)
+	{
+		jobsEnabled = enabled;
+	}
+}
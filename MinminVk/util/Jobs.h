@@ -0,0 +1,19 @@
+#pragma once
+
+#include <util/Type.h>
+#include <functional>
+
+namespace Util
+{
+	// persistent worker threads. ParallelFor blocks until every index has run,
+	// the calling thread takes part. nested calls run serially on the caller
+	struct Jobs
+	{
+		static void ParallelFor(u32 count, const std::function<void(u32)>& job);
+
+		static u32 GetWorkerCount();
+
+		// run everything on the calling thread, for benchmarking
+		static void SetEnabled(bool enabled);
+	};
+}
@@ -4,6 +4,13 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/quaternion.hpp>
 #include <glm/gtx/rotate_vector.hpp>
+#include <glm/gtx/matrix_decompose.hpp>
+#include <glm/gtc/matrix_access.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MATH_SSE
+#include <immintrin.h>
+#endif
 
 namespace Math
 {
@@ -64,6 +71,45 @@ namespace Math
 		return glm::inverse(mat);
 	}
 
+	// inverse of a matrix with 0 0 0 1 bottom row
+	inline mat4 InverseAffine(const mat4& mat)
+	{
+		mat3 inv = glm::inverse(mat3(mat));
+		mat4 res(inv);
+		res[3] = vec4(-(inv * vec3(mat[3])), 1);
+		return res;
+	}
+
+	// out = a * b when both have a 0 0 0 1 bottom row. b's bottom row is never read, each column of out
+	// is a's columns scaled by b's column plus a's translation for the last one. all 4 rows are written,
+	// out's bottom row is 0 0 0 1 only because a's is
+	inline void MulAffine(const mat4& a, const mat4& b, mat4& out)
+	{
+#ifdef MATH_SSE
+		const __m128 a0 = _mm_loadu_ps(&a[0][0]);
+		const __m128 a1 = _mm_loadu_ps(&a[1][0]);
+		const __m128 a2 = _mm_loadu_ps(&a[2][0]);
+		const __m128 a3 = _mm_loadu_ps(&a[3][0]);
+		for (int c = 0; c < 4; ++c)
+		{
+			const __m128 bc = _mm_loadu_ps(&b[c][0]);
+			__m128 res = _mm_mul_ps(a0, _mm_shuffle_ps(bc, bc, _MM_SHUFFLE(0, 0, 0, 0)));
+			res = _mm_add_ps(res, _mm_mul_ps(a1, _mm_shuffle_ps(bc, bc, _MM_SHUFFLE(1, 1, 1, 1))));
+			res = _mm_add_ps(res, _mm_mul_ps(a2, _mm_shuffle_ps(bc, bc, _MM_SHUFFLE(2, 2, 2, 2))));
+			if (c == 3)
+				res = _mm_add_ps(res, a3);
+			_mm_storeu_ps(&out[c][0], res);
+		}
+#else
+		const vec4 a0 = a[0], a1 = a[1], a2 = a[2], a3 = a[3];
+		for (int c = 0; c < 4; ++c)
+		{
+			const vec4 bc = b[c];
+			out[c] = a0 * bc.x + a1 * bc.y + a2 * bc.z + (c == 3 ? a3 : vec4(0));
+		}
+#endif
+	}
+
 	inline mat4 InverseTranspose(mat4 mat)
 	{
 		return glm::transpose(glm::inverse(mat));
@@ -73,4 +119,118 @@ namespace Math
 	{
 		return glm::cross(v1, v2);
 	}
+
+	inline void Decompose(const mat4& mat, vec3& translation, quat& rotation, vec3& scale)
+	{
+		vec3 skew;
+		vec4 perspective;
+		glm::decompose(mat, scale, rotation, translation, skew, perspective);
+	}
+
+	// axis aligned box, empty until a point is added
+	struct AABB
+	{
+		vec3 min = vec3(std::numeric_limits<f32>::max());
+		vec3 max = vec3(std::numeric_limits<f32>::lowest());
+
+		bool IsEmpty() const { return min.x > max.x; }
+
+		void Extend(const vec3& point)
+		{
+			min = glm::min(min, point);
+			max = glm::max(max, point);
+		}
+
+		void Extend(const AABB& box)
+		{
+			min = glm::min(min, box.min);
+			max = glm::max(max, box.max);
+		}
+	};
+
+	// smallest box around the transformed box, for affine matrices
+	inline AABB Transform(const AABB& box, const mat4& mat)
+	{
+		if (box.IsEmpty())
+			return box;
+		vec3 center = vec3(mat * vec4((box.min + box.max) * 0.5f, 1));
+		vec3 extent = (box.max - box.min) * 0.5f;
+		mat3 absMat = mat3(glm::abs(vec3(mat[0])), glm::abs(vec3(mat[1])), glm::abs(vec3(mat[2])));
+		extent = absMat * extent;
+		AABB res;
+		res.min = center - extent;
+		res.max = center + extent;
+		return res;
+	}
+
+	// planes of a view projection with depth zero to one, normals pointing inside.
+	// stored per component, 4 planes per sse test. the last two never reject
+	struct Frustum
+	{
+		alignas(16) f32 nx[8];
+		alignas(16) f32 ny[8];
+		alignas(16) f32 nz[8];
+		alignas(16) f32 d[8];
+
+		explicit Frustum(const mat4& viewProj)
+		{
+			const vec4 row0 = glm::row(viewProj, 0);
+			const vec4 row1 = glm::row(viewProj, 1);
+			const vec4 row2 = glm::row(viewProj, 2);
+			const vec4 row3 = glm::row(viewProj, 3);
+			const vec4 planes[8] = { row3 + row0, row3 - row0, row3 + row1, row3 - row1, row2, row3 - row2, vec4(0, 0, 0, 1), vec4(0, 0, 0, 1) };
+			for (int i = 0; i < 8; ++i)
+			{
+				nx[i] = planes[i].x;
+				ny[i] = planes[i].y;
+				nz[i] = planes[i].z;
+				d[i] = planes[i].w;
+			}
+		}
+
+		enum class Overlap { OUTSIDE, PARTIAL, INSIDE };
+
+		// false only if the box is fully outside one plane
+		bool Intersects(const AABB& box) const
+		{
+			return Classify(box) != Overlap::OUTSIDE;
+		}
+
+		// inside when the box is on the inner side of every plane, so everything in it is too
+		Overlap Classify(const AABB& box) const
+		{
+			if (box.IsEmpty())
+				return Overlap::PARTIAL;
+			const vec3 center = (box.min + box.max) * 0.5f;
+			const vec3 extent = (box.max - box.min) * 0.5f;
+			bool inside = true;
+#ifdef MATH_SSE
+			const __m128 cx = _mm_set1_ps(center.x), cy = _mm_set1_ps(center.y), cz = _mm_set1_ps(center.z);
+			const __m128 ex = _mm_set1_ps(extent.x), ey = _mm_set1_ps(extent.y), ez = _mm_set1_ps(extent.z);
+			const __m128 signMask = _mm_set1_ps(-0.f);
+			for (int i = 0; i < 8; i += 4)
+			{
+				const __m128 px = _mm_load_ps(nx + i), py = _mm_load_ps(ny + i), pz = _mm_load_ps(nz + i);
+				// signed distance of the center and projected radius of the box, both scaled by the plane normal length
+				__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, cx), _mm_mul_ps(py, cy)), _mm_add_ps(_mm_mul_ps(pz, cz), _mm_load_ps(d + i)));
+				__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, px), ex), _mm_mul_ps(_mm_andnot_ps(signMask, py), ey)), _mm_mul_ps(_mm_andnot_ps(signMask, pz), ez));
+				if (_mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps())) != 0)
+					return Overlap::OUTSIDE;
+				if (_mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(distance, radius), _mm_setzero_ps())) != 0)
+					inside = false;
+			}
+#else
+			for (int i = 0; i < 6; ++i)
+			{
+				f32 distance = nx[i] * center.x + ny[i] * center.y + nz[i] * center.z + d[i];
+				f32 radius = std::abs(nx[i]) * extent.x + std::abs(ny[i]) * extent.y + std::abs(nz[i]) * extent.z;
+				if (distance + radius < 0.f)
+					return Overlap::OUTSIDE;
+				if (distance - radius < 0.f)
+					inside = false;
+			}
+#endif
+			return inside ? Overlap::INSIDE : Overlap::PARTIAL;
+		}
+	};
 }
@@ -18,6 +18,7 @@
 
 #define concat_str(first, second) first second
 
+typedef uint64_t u64;
 typedef uint32_t u32;
 typedef uint16_t u16;
 typedef uint8_t u8;